@@ -1,5 +1,6 @@
 #include "../common/common.h"
 #include "../common/errors.h"
+#include "../common/threads.h"
 
 #include "asm.h"
 #include "tokenizer.h"
@@ -7,8 +8,21 @@
 #include "proto-values.h"
 #include "parser.h"
 
+static
+NOnce ASM_ONCE = N_ONCE_INIT;
+
+static void
+init_asm(NError* error);
+
+
 void
 n_init_asm(NError* error) {
+    n_call_once(&ASM_ONCE, init_asm, error);
+}
+
+
+static void
+init_asm(NError* error) {
 #define EC ON_ERROR(error, return)
     n_init_common(error);                                          EC;
 
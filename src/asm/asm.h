@@ -3,6 +3,7 @@
 
 #include "../common/errors.h"
 
+/* Initializes the assembler, once, see n_init_common. */
 void
 n_init_asm(NError* error);
 
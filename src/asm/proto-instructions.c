@@ -14,13 +14,26 @@ NProtoInstructionVTable NOP_VTABLE         = { 0, 0, 0, 0 },
                         JUMP_UNLESS_VTABLE = { 0, 0, 0, 0 },
                         JUMP_VTABLE        = { 0, 0, 0, 0 },
                         CALL_VTABLE        = { 0, 0, 0, 0 },
+                        TAIL_CALL_VTABLE   = { 0, 0, 0, 0 },
                         RETURN_VTABLE      = { 0, 0, 0, 0 },
                         GLOBAL_REF_VTABLE  = { 0, 0, 0, 0 },
-                        GLOBAL_SET_VTABLE  = { 0, 0, 0, 0 };
+                        GLOBAL_SET_VTABLE  = { 0, 0, 0, 0 },
+                        ARITHMETIC_VTABLE  = { 0, 0, 0, 0 },
+                        JUMP_IF_LT_VTABLE  = { 0, 0, 0, 0 },
+                        JUMP_IF_LE_VTABLE  = { 0, 0, 0, 0 },
+                        JUMP_IF_EQ_VTABLE  = { 0, 0, 0, 0 },
+                        JUMP_IF_FIXNUM_ZERO_VTABLE = { 0, 0, 0, 0 };
 
 static
 void init_vtables(void);
 
+static NProtoInstruction
+proto_arithmetic(uint8_t opcode, uint8_t dest, uint8_t left, uint8_t right);
+
+static NProtoInstruction
+proto_compare_and_jump(NProtoInstructionVTable* vtable, uint8_t left,
+                       uint8_t right, uint16_t anchor);
+
 static
 NErrorType* BAD_ALLOCATION = NULL;
 
@@ -136,6 +149,31 @@ n_proto_call(uint8_t dest, uint8_t target, uint8_t n_args, uint8_t* args,
 }
 
 
+NProtoInstruction
+n_proto_tail_call(uint8_t target, uint8_t n_args, uint8_t* args,
+                  NError* error) {
+    NProtoInstruction result;
+    uint8_t *internal_args = NULL;
+    if (n_args > 0) {
+        internal_args = malloc(sizeof(uint8_t) * n_args);
+        if (internal_args == NULL) {
+            n_set_error(error, BAD_ALLOCATION, "Could not allocate space for "
+                        "the argument list on tail-call instruction.");
+            result.vtable = NULL;
+            result.u8s_extra = NULL;
+            return result;
+        }
+        memcpy(internal_args, args, sizeof(uint8_t) * n_args);
+    }
+
+    result.vtable = &TAIL_CALL_VTABLE;
+    result.u8s[1] = target;
+    result.u8s[2] = n_args;
+    result.u8s_extra = internal_args;
+    return result;
+}
+
+
 NProtoInstruction
 n_proto_global_ref(uint8_t dest, uint16_t source) {
     NProtoInstruction result;
@@ -166,6 +204,102 @@ n_proto_return(uint8_t source) {
 }
 
 
+NProtoInstruction
+n_proto_add(uint8_t dest, uint8_t left, uint8_t right) {
+    return proto_arithmetic(N_OP_ADD, dest, left, right);
+}
+
+
+NProtoInstruction
+n_proto_sub(uint8_t dest, uint8_t left, uint8_t right) {
+    return proto_arithmetic(N_OP_SUB, dest, left, right);
+}
+
+
+NProtoInstruction
+n_proto_mul(uint8_t dest, uint8_t left, uint8_t right) {
+    return proto_arithmetic(N_OP_MUL, dest, left, right);
+}
+
+
+NProtoInstruction
+n_proto_lt(uint8_t dest, uint8_t left, uint8_t right) {
+    return proto_arithmetic(N_OP_LT, dest, left, right);
+}
+
+
+NProtoInstruction
+n_proto_le(uint8_t dest, uint8_t left, uint8_t right) {
+    return proto_arithmetic(N_OP_LE, dest, left, right);
+}
+
+
+NProtoInstruction
+n_proto_eq(uint8_t dest, uint8_t left, uint8_t right) {
+    return proto_arithmetic(N_OP_EQ, dest, left, right);
+}
+
+
+/* The arithmetic and comparison instructions share a single vtable, and
+ * keep their opcode in u16s[0]. */
+static NProtoInstruction
+proto_arithmetic(uint8_t opcode, uint8_t dest, uint8_t left, uint8_t right) {
+    NProtoInstruction result;
+    result.vtable = &ARITHMETIC_VTABLE;
+    result.u16s[0] = opcode;
+    result.u8s[0] = dest;
+    result.u8s[1] = left;
+    result.u8s[2] = right;
+    return result;
+}
+
+
+NProtoInstruction
+n_proto_jump_if_lt(uint8_t left, uint8_t right, uint16_t anchor) {
+    return proto_compare_and_jump(&JUMP_IF_LT_VTABLE, left, right, anchor);
+}
+
+
+NProtoInstruction
+n_proto_jump_if_le(uint8_t left, uint8_t right, uint16_t anchor) {
+    return proto_compare_and_jump(&JUMP_IF_LE_VTABLE, left, right, anchor);
+}
+
+
+NProtoInstruction
+n_proto_jump_if_eq(uint8_t left, uint8_t right, uint16_t anchor) {
+    return proto_compare_and_jump(&JUMP_IF_EQ_VTABLE, left, right, anchor);
+}
+
+
+NProtoInstruction
+n_proto_jump_if_fixnum_zero(uint8_t cond, uint16_t anchor) {
+    NProtoInstruction result;
+    result.vtable = &JUMP_IF_FIXNUM_ZERO_VTABLE;
+    result.u8s[0] = cond;
+    result.u16s[0] = anchor;
+    /* Mark flag to indicate the labels haven't been resolved. */
+    result.u8s[2] = 1;
+    return result;
+}
+
+
+/* There is no room left for the opcode, so each of the compare and jump
+ * instructions has its own vtable. */
+static NProtoInstruction
+proto_compare_and_jump(NProtoInstructionVTable* vtable, uint8_t left,
+                       uint8_t right, uint16_t anchor) {
+    NProtoInstruction result;
+    result.vtable = vtable;
+    result.u8s[0] = left;
+    result.u8s[1] = right;
+    result.u16s[0] = anchor;
+    /* Mark flag to indicate the labels haven't been resolved. */
+    result.u8s[2] = 1;
+    return result;
+}
+
+
 
 
 static uint16_t
@@ -306,6 +440,28 @@ call_destruct(NProtoInstruction* self) {
 }
 
 
+static uint16_t
+tail_call_size(NProtoInstruction* self) {
+    return n_get_opcode_size(N_OP_TAIL_CALL) + self->u8s[2];
+}
+
+
+static void
+tail_call_emit(NByteWriter* writer, NProtoInstruction* instr, NError* error) {
+#define EC ON_ERROR(error, return)
+    int i;
+    n_write_byte(writer, N_OP_TAIL_CALL, error);                  EC;
+    n_write_byte(writer, instr->u8s[1], error);                   EC;
+    n_write_byte(writer, instr->u8s[2], error);                   EC;
+    if (instr->u8s_extra != NULL) {
+        for (i = 0; i < instr->u8s[2]; i++) {
+            n_write_byte(writer, instr->u8s_extra[i], error);     EC;
+        }
+    }
+#undef EC
+}
+
+
 static uint16_t
 return_size(NProtoInstruction* self) {
     return n_get_opcode_size(N_OP_RETURN);
@@ -355,6 +511,110 @@ global_set_emit(NByteWriter* writer, NProtoInstruction* instr, NError* error) {
 }
 
 
+static uint16_t
+arithmetic_size(NProtoInstruction* self) {
+    return n_get_opcode_size((NOpcode) self->u16s[0]);
+}
+
+
+static void
+arithmetic_emit(NByteWriter* writer, NProtoInstruction* instr, NError* error) {
+#define EC ON_ERROR(error, return)
+    n_write_byte(writer, (uint8_t) instr->u16s[0], error);         EC;
+    n_write_byte(writer, instr->u8s[0], error);                    EC;
+    n_write_byte(writer, instr->u8s[1], error);                    EC;
+    n_write_byte(writer, instr->u8s[2], error);
+#undef EC
+}
+
+
+static uint16_t
+compare_and_jump_size(NProtoInstruction* self) {
+    return n_get_opcode_size(N_OP_JUMP_IF_LT);
+}
+
+
+static void
+compare_and_jump_emit(NByteWriter* writer, uint8_t opcode,
+                      NProtoInstruction* instr, NError* error) {
+#define EC ON_ERROR(error, return)
+    if (instr->u8s[2]) {
+        /* Anchors were not resolved, somethings is very wrong. */
+        n_set_error(error, ILLEGAL_ARGUMENT, "Trying to emit a compare and "
+                    "jump proto instruction without resolving anchors.");
+        return;
+    }
+    n_write_byte(writer, opcode, error);                           EC;
+    n_write_byte(writer, instr->u8s[0], error);                    EC;
+    n_write_byte(writer, instr->u8s[1], error);                    EC;
+    n_write_int16(writer, instr->i16s[0], error);
+#undef EC
+}
+
+
+static void
+jump_if_lt_emit(NByteWriter* writer, NProtoInstruction* instr, NError* error) {
+    compare_and_jump_emit(writer, N_OP_JUMP_IF_LT, instr, error);
+}
+
+
+static void
+jump_if_le_emit(NByteWriter* writer, NProtoInstruction* instr, NError* error) {
+    compare_and_jump_emit(writer, N_OP_JUMP_IF_LE, instr, error);
+}
+
+
+static void
+jump_if_eq_emit(NByteWriter* writer, NProtoInstruction* instr, NError* error) {
+    compare_and_jump_emit(writer, N_OP_JUMP_IF_EQ, instr, error);
+}
+
+
+static uint16_t
+jump_if_fixnum_zero_size(NProtoInstruction* self) {
+    return n_get_opcode_size(N_OP_JUMP_IF_FIXNUM_ZERO);
+}
+
+
+static void
+jump_if_fixnum_zero_emit(NByteWriter* writer, NProtoInstruction* instr,
+                         NError* error) {
+#define EC ON_ERROR(error, return)
+    if (instr->u8s[2]) {
+        /* Anchors were not resolved, somethings is very wrong. */
+        n_set_error(error, ILLEGAL_ARGUMENT, "Trying to emit a Jump If "
+                    "Fixnum Zero proto instruction without resolving "
+                    "anchors.");
+        return;
+    }
+    n_write_byte(writer, N_OP_JUMP_IF_FIXNUM_ZERO, error);         EC;
+    n_write_byte(writer, instr->u8s[0], error);                    EC;
+    n_write_int16(writer, instr->i16s[0], error);
+#undef EC
+}
+
+
+/* Shared by all the conditional jumps added along with the compare and jump
+ * opcodes, which keep their anchor in the same place. */
+static void
+conditional_jump_resolve_anchors(NProtoInstruction* self, uint16_t own_offset,
+                                 NAnchorMap* anchor_map, NError* error) {
+    uint16_t anchor_offset;
+    int16_t offset;
+
+    if (!anchor_map->vtable->has_anchor(anchor_map, self->u16s[0])) {
+        n_set_error(error, ILLEGAL_ARGUMENT, "Anchor not found while trying "
+                    "to resolve conditional jump instruction.");
+        return;
+    }
+    anchor_offset = anchor_map->vtable->get_offset(anchor_map, self->u16s[0]);
+    offset = (int16_t) (((int32_t) anchor_offset) - ((int32_t) own_offset));
+    self->i16s[0] = offset;
+    /* Unmark the flag to indicate anchors were already resolved. */
+    self->u8s[2] = 0;
+}
+
+
 static
 void init_vtables(void) {
     NOP_VTABLE.size = nop_size;
@@ -375,6 +635,10 @@ void init_vtables(void) {
     CALL_VTABLE.emit = call_emit;
     CALL_VTABLE.destruct = call_destruct;
 
+    TAIL_CALL_VTABLE.size = tail_call_size;
+    TAIL_CALL_VTABLE.emit = tail_call_emit;
+    TAIL_CALL_VTABLE.destruct = call_destruct;
+
     RETURN_VTABLE.size = return_size;
     RETURN_VTABLE.emit = return_emit;
 
@@ -383,6 +647,26 @@ void init_vtables(void) {
 
     GLOBAL_SET_VTABLE.size = global_set_size;
     GLOBAL_SET_VTABLE.emit = global_set_emit;
+
+    ARITHMETIC_VTABLE.size = arithmetic_size;
+    ARITHMETIC_VTABLE.emit = arithmetic_emit;
+
+    JUMP_IF_LT_VTABLE.size = compare_and_jump_size;
+    JUMP_IF_LT_VTABLE.emit = jump_if_lt_emit;
+    JUMP_IF_LT_VTABLE.resolve_anchors = conditional_jump_resolve_anchors;
+
+    JUMP_IF_LE_VTABLE.size = compare_and_jump_size;
+    JUMP_IF_LE_VTABLE.emit = jump_if_le_emit;
+    JUMP_IF_LE_VTABLE.resolve_anchors = conditional_jump_resolve_anchors;
+
+    JUMP_IF_EQ_VTABLE.size = compare_and_jump_size;
+    JUMP_IF_EQ_VTABLE.emit = jump_if_eq_emit;
+    JUMP_IF_EQ_VTABLE.resolve_anchors = conditional_jump_resolve_anchors;
+
+    JUMP_IF_FIXNUM_ZERO_VTABLE.size = jump_if_fixnum_zero_size;
+    JUMP_IF_FIXNUM_ZERO_VTABLE.emit = jump_if_fixnum_zero_emit;
+    JUMP_IF_FIXNUM_ZERO_VTABLE.resolve_anchors =
+        conditional_jump_resolve_anchors;
 }
 
 
@@ -420,6 +704,15 @@ nt_matches_proto_call(NProtoInstruction* instr, uint8_t dest,
 }
 
 
+int
+nt_matches_proto_tail_call(NProtoInstruction* instr, uint8_t target,
+                           uint8_t n_args, uint8_t* args) {
+    return instr->vtable == &TAIL_CALL_VTABLE && instr->u8s[1] == target
+        && instr->u8s[2] == n_args
+        && extra_u8s_eq(instr->u8s_extra, args, n_args);
+}
+
+
 int
 nt_matches_proto_global_ref(NProtoInstruction* instr, uint8_t dest,
                             uint16_t source) {
@@ -440,4 +733,35 @@ int
 nt_matches_proto_return(NProtoInstruction* instr, uint8_t source) {
     return instr->vtable == &RETURN_VTABLE && instr->u8s[0] == source;
 }
+
+
+int
+nt_matches_proto_arithmetic(NProtoInstruction* instr, uint8_t opcode,
+                            uint8_t dest, uint8_t left, uint8_t right) {
+    return instr->vtable == &ARITHMETIC_VTABLE && instr->u16s[0] == opcode
+        && instr->u8s[0] == dest && instr->u8s[1] == left
+        && instr->u8s[2] == right;
+}
+
+
+int
+nt_matches_proto_compare_and_jump(NProtoInstruction* instr, uint8_t opcode,
+                                  uint8_t left, uint8_t right,
+                                  uint16_t anchor) {
+    NProtoInstructionVTable* vtable =
+          opcode == N_OP_JUMP_IF_LT ? &JUMP_IF_LT_VTABLE
+        : opcode == N_OP_JUMP_IF_LE ? &JUMP_IF_LE_VTABLE
+        : opcode == N_OP_JUMP_IF_EQ ? &JUMP_IF_EQ_VTABLE
+        : NULL;
+    return instr->vtable == vtable && instr->u8s[0] == left
+        && instr->u8s[1] == right && instr->u16s[0] == anchor;
+}
+
+
+int
+nt_matches_proto_jump_if_fixnum_zero(NProtoInstruction* instr, uint8_t cond,
+                                     uint16_t anchor) {
+    return instr->vtable == &JUMP_IF_FIXNUM_ZERO_VTABLE
+        && instr->u8s[0] == cond && instr->u16s[0] == anchor;
+}
 #endif /*N_TEST*/
@@ -71,6 +71,10 @@ NProtoInstruction
 n_proto_call(uint8_t dest, uint8_t target, uint8_t n_args, uint8_t* args,
              NError* error);
 
+NProtoInstruction
+n_proto_tail_call(uint8_t target, uint8_t n_args, uint8_t* args,
+                  NError* error);
+
 NProtoInstruction
 n_proto_global_ref(uint8_t dest, uint16_t source);
 
@@ -80,6 +84,36 @@ n_proto_global_set(uint16_t dest, uint8_t source);
 NProtoInstruction
 n_proto_return(uint8_t source);
 
+NProtoInstruction
+n_proto_add(uint8_t dest, uint8_t left, uint8_t right);
+
+NProtoInstruction
+n_proto_sub(uint8_t dest, uint8_t left, uint8_t right);
+
+NProtoInstruction
+n_proto_mul(uint8_t dest, uint8_t left, uint8_t right);
+
+NProtoInstruction
+n_proto_lt(uint8_t dest, uint8_t left, uint8_t right);
+
+NProtoInstruction
+n_proto_le(uint8_t dest, uint8_t left, uint8_t right);
+
+NProtoInstruction
+n_proto_eq(uint8_t dest, uint8_t left, uint8_t right);
+
+NProtoInstruction
+n_proto_jump_if_lt(uint8_t left, uint8_t right, uint16_t anchor);
+
+NProtoInstruction
+n_proto_jump_if_le(uint8_t left, uint8_t right, uint16_t anchor);
+
+NProtoInstruction
+n_proto_jump_if_eq(uint8_t left, uint8_t right, uint16_t anchor);
+
+NProtoInstruction
+n_proto_jump_if_fixnum_zero(uint8_t cond, uint16_t anchor);
+
 #ifdef N_TEST
 int
 nt_matches_proto_nop(NProtoInstruction* instr);
@@ -91,6 +125,10 @@ int
 nt_matches_proto_call(NProtoInstruction* instr, uint8_t dest,
                       uint8_t target, uint8_t n_args, uint8_t* args);
 
+int
+nt_matches_proto_tail_call(NProtoInstruction* instr, uint8_t target,
+                           uint8_t n_args, uint8_t* args);
+
 int
 nt_matches_proto_global_ref(NProtoInstruction* instr, uint8_t dest,
                             uint16_t source);
@@ -102,6 +140,19 @@ nt_matches_proto_global_set(NProtoInstruction* instr, uint16_t dest,
 int
 nt_matches_proto_return(NProtoInstruction* instr, uint8_t source);
 
+int
+nt_matches_proto_arithmetic(NProtoInstruction* instr, uint8_t opcode,
+                            uint8_t dest, uint8_t left, uint8_t right);
+
+int
+nt_matches_proto_compare_and_jump(NProtoInstruction* instr, uint8_t opcode,
+                                  uint8_t left, uint8_t right,
+                                  uint16_t anchor);
+
+int
+nt_matches_proto_jump_if_fixnum_zero(NProtoInstruction* instr, uint8_t cond,
+                                     uint16_t anchor);
+
 #endif /*N_TEST*/
 
 #endif /*N_A_PROTO_INSTRUCTIONS_H*/
@@ -287,6 +287,15 @@ ni_add_proto_call(NProtoProcedure* self, uint8_t dest, uint8_t target,
 }
 
 
+void
+ni_add_proto_tail_call(NProtoProcedure* self, uint8_t target,
+                       uint8_t n_args, uint8_t* args, NError* error) {
+    NProtoInstruction instr = n_proto_tail_call(target, n_args, args, error);
+    if (!n_is_ok(error)) return;
+    add_proto_instruction(self, &instr, error);
+}
+
+
 void
 ni_add_proto_global_ref(NProtoProcedure* self, uint8_t dest, uint16_t source,
                         NError* error) {
@@ -310,6 +319,86 @@ ni_add_proto_return(NProtoProcedure* self, uint8_t source, NError* error) {
 }
 
 
+void
+ni_add_proto_add(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                 uint8_t right, NError* error) {
+    NProtoInstruction instr = n_proto_add(dest, left, right);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_sub(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                 uint8_t right, NError* error) {
+    NProtoInstruction instr = n_proto_sub(dest, left, right);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_mul(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                 uint8_t right, NError* error) {
+    NProtoInstruction instr = n_proto_mul(dest, left, right);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_lt(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                uint8_t right, NError* error) {
+    NProtoInstruction instr = n_proto_lt(dest, left, right);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_le(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                uint8_t right, NError* error) {
+    NProtoInstruction instr = n_proto_le(dest, left, right);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_eq(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                uint8_t right, NError* error) {
+    NProtoInstruction instr = n_proto_eq(dest, left, right);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_jump_if_lt(NProtoProcedure* self, uint8_t left, uint8_t right,
+                        uint16_t anchor, NError* error) {
+    NProtoInstruction instr = n_proto_jump_if_lt(left, right, anchor);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_jump_if_le(NProtoProcedure* self, uint8_t left, uint8_t right,
+                        uint16_t anchor, NError* error) {
+    NProtoInstruction instr = n_proto_jump_if_le(left, right, anchor);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_jump_if_eq(NProtoProcedure* self, uint8_t left, uint8_t right,
+                        uint16_t anchor, NError* error) {
+    NProtoInstruction instr = n_proto_jump_if_eq(left, right, anchor);
+    add_proto_instruction(self, &instr, error);
+}
+
+
+void
+ni_add_proto_jump_if_fixnum_zero(NProtoProcedure* self, uint8_t cond,
+                                 uint16_t anchor, NError* error) {
+    NProtoInstruction instr = n_proto_jump_if_fixnum_zero(cond, anchor);
+    add_proto_instruction(self, &instr, error);
+}
+
+
 
 
 static void
@@ -63,6 +63,10 @@ void
 ni_add_proto_call(NProtoProcedure* self, uint8_t dest, uint8_t target,
                        uint8_t n_args, uint8_t* args, NError* error);
 
+void
+ni_add_proto_tail_call(NProtoProcedure* self, uint8_t target,
+                       uint8_t n_args, uint8_t* args, NError* error);
+
 void
 ni_add_proto_global_ref(NProtoProcedure* self, uint8_t dest,
                              uint16_t source, NError* error);
@@ -74,6 +78,46 @@ ni_add_proto_global_set(NProtoProcedure* self, uint16_t dest,
 void
 ni_add_proto_return(NProtoProcedure* self, uint8_t source, NError* error);
 
+void
+ni_add_proto_add(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                 uint8_t right, NError* error);
+
+void
+ni_add_proto_sub(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                 uint8_t right, NError* error);
+
+void
+ni_add_proto_mul(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                 uint8_t right, NError* error);
+
+void
+ni_add_proto_lt(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                uint8_t right, NError* error);
+
+void
+ni_add_proto_le(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                uint8_t right, NError* error);
+
+void
+ni_add_proto_eq(NProtoProcedure* self, uint8_t dest, uint8_t left,
+                uint8_t right, NError* error);
+
+void
+ni_add_proto_jump_if_lt(NProtoProcedure* self, uint8_t left, uint8_t right,
+                        uint16_t anchor, NError* error);
+
+void
+ni_add_proto_jump_if_le(NProtoProcedure* self, uint8_t left, uint8_t right,
+                        uint16_t anchor, NError* error);
+
+void
+ni_add_proto_jump_if_eq(NProtoProcedure* self, uint8_t left, uint8_t right,
+                        uint16_t anchor, NError* error);
+
+void
+ni_add_proto_jump_if_fixnum_zero(NProtoProcedure* self, uint8_t cond,
+                                 uint16_t anchor, NError* error);
+
 
 #ifdef N_TEST
 
@@ -169,6 +169,17 @@ ni_get_token_name(NTokenType type) {
         case N_TK_OP_GLOBAL_SET: return "TK_OP_GLOBAL_SET";
         case N_TK_OP_LOAD_I16: return "TK_OP_LOAD_I16";
         case N_TK_OP_CALL: return "TK_OP_CALL";
+        case N_TK_OP_TAIL_CALL: return "TK_OP_TAIL_CALL";
+        case N_TK_OP_ADD: return "TK_OP_ADD";
+        case N_TK_OP_SUB: return "TK_OP_SUB";
+        case N_TK_OP_MUL: return "TK_OP_MUL";
+        case N_TK_OP_LT: return "TK_OP_LT";
+        case N_TK_OP_LE: return "TK_OP_LE";
+        case N_TK_OP_EQ: return "TK_OP_EQ";
+        case N_TK_OP_JUMP_IF_LT: return "TK_OP_JUMP_IF_LT";
+        case N_TK_OP_JUMP_IF_LE: return "TK_OP_JUMP_IF_LE";
+        case N_TK_OP_JUMP_IF_EQ: return "TK_OP_JUMP_IF_EQ";
+        case N_TK_OP_JUMP_IF_FIXNUM_ZERO: return "TK_OP_JUMP_IF_FIXNUM_ZERO";
         default: return "null";
     }
 }
@@ -249,6 +260,17 @@ NTokenMapping INSTRUCTIONS[] = {
     { "global-set", N_TK_OP_GLOBAL_SET },
     { "load-i16", N_TK_OP_LOAD_I16 },
     { "call", N_TK_OP_CALL },
+    { "tail-call", N_TK_OP_TAIL_CALL },
+    { "add", N_TK_OP_ADD },
+    { "sub", N_TK_OP_SUB },
+    { "mul", N_TK_OP_MUL },
+    { "lt", N_TK_OP_LT },
+    { "le", N_TK_OP_LE },
+    { "eq", N_TK_OP_EQ },
+    { "jump-if-lt", N_TK_OP_JUMP_IF_LT },
+    { "jump-if-le", N_TK_OP_JUMP_IF_LE },
+    { "jump-if-eq", N_TK_OP_JUMP_IF_EQ },
+    { "jump-if-fixnum-zero", N_TK_OP_JUMP_IF_FIXNUM_ZERO },
     { NULL, 0 }
 };
 
@@ -28,6 +28,17 @@ enum NTokenType {
     N_TK_OP_GLOBAL_SET,
     N_TK_OP_LOAD_I16,
     N_TK_OP_CALL,
+    N_TK_OP_TAIL_CALL,
+    N_TK_OP_ADD,
+    N_TK_OP_SUB,
+    N_TK_OP_MUL,
+    N_TK_OP_LT,
+    N_TK_OP_LE,
+    N_TK_OP_EQ,
+    N_TK_OP_JUMP_IF_LT,
+    N_TK_OP_JUMP_IF_LE,
+    N_TK_OP_JUMP_IF_EQ,
+    N_TK_OP_JUMP_IF_FIXNUM_ZERO,
     N_TK_XX_END_OPS,
 
     N_TK_XX_END_TOKENS
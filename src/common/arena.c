@@ -0,0 +1,92 @@
+#include <stdlib.h>
+
+#include "arena.h"
+
+/* The strictest alignment any value may need. */
+typedef union {
+    long l;
+    double d;
+    void *p;
+} NAligned;
+
+#define ALIGNMENT sizeof(NAligned)
+#define ALIGN(SIZE) (((SIZE) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+/* The header of a block, its memory follows it. */
+struct NArenaBlock {
+    NArenaBlock *next;
+    size_t size;
+    size_t used;
+};
+
+#define BLOCK_HEADER_SIZE ALIGN(sizeof(NArenaBlock))
+
+static NArenaBlock*
+create_block(size_t size);
+
+
+void
+n_construct_arena(NArena* self, size_t block_size) {
+    self->blocks = NULL;
+    self->block_size = block_size;
+    self->allocated = 0;
+}
+
+
+void
+n_destruct_arena(NArena* self) {
+    NArenaBlock *block = self->blocks;
+    while (block != NULL) {
+        NArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    self->blocks = NULL;
+    self->allocated = 0;
+}
+
+
+void*
+n_arena_allocate(NArena* self, size_t size) {
+    NArenaBlock *block = self->blocks;
+    void *memory;
+
+    size = ALIGN(size > 0 ? size : 1);
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = size > self->block_size ? size
+                                                    : self->block_size;
+        NArenaBlock *new_block = create_block(block_size);
+        if (new_block == NULL) {
+            return NULL;
+        }
+
+        /* A block made for a big allocation is full right away, so the
+         * current block keeps being bumped. */
+        if (block != NULL && block_size == size) {
+            new_block->next = block->next;
+            block->next = new_block;
+        }
+        else {
+            new_block->next = block;
+            self->blocks = new_block;
+        }
+        block = new_block;
+    }
+
+    memory = (char*) block + BLOCK_HEADER_SIZE + block->used;
+    block->used += size;
+    self->allocated += size;
+    return memory;
+}
+
+
+static NArenaBlock*
+create_block(size_t size) {
+    NArenaBlock *block = malloc(BLOCK_HEADER_SIZE + size);
+    if (block != NULL) {
+        block->next = NULL;
+        block->size = size;
+        block->used = 0;
+    }
+    return block;
+}
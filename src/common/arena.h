@@ -0,0 +1,33 @@
+#ifndef N_C_ARENA_H
+#define N_C_ARENA_H
+
+#include <stddef.h>
+
+typedef struct NArena NArena;
+typedef struct NArenaBlock NArenaBlock;
+
+/* Hands out memory bumped out of blocks of at least block_size bytes,
+ * which are only freed all together, when the arena is destructed. Every
+ * allocation is aligned for any value. An allocation bigger than the room
+ * left in the current block gets a new one, unless it is bigger than
+ * block_size: it then gets a block of its own, and the current block keeps
+ * being bumped. */
+struct NArena {
+    NArenaBlock *blocks;
+    size_t block_size;
+    /* Bytes handed out so far. */
+    size_t allocated;
+};
+
+
+void
+n_construct_arena(NArena* self, size_t block_size);
+
+void
+n_destruct_arena(NArena* self);
+
+/* Returns NULL when no block can be allocated. */
+void*
+n_arena_allocate(NArena* self, size_t size);
+
+#endif /* N_C_ARENA_H */
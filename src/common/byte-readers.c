@@ -1,8 +1,21 @@
+/* Needed for the POSIX file functions when building as C89. */
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
 #include <string.h>
 
 #include "byte-readers.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#  define N_MMAP_ENABLED
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
 typedef struct NMemoryByteReader NMemoryByteReader;
+typedef struct NFileByteReader NFileByteReader;
 
 struct NByteReader {
     const NByteReaderVTable *vtable;
@@ -15,14 +28,29 @@ struct NMemoryByteReader {
     int size;
 };
 
+/* Reads its mapping like a memory reader. */
+struct NFileByteReader {
+    NMemoryByteReader parent;
+    NMapping *mapping;
+};
+
 
 
 static
 NByteReaderVTable MEMORY_VTABLE;
 
+static
+NByteReaderVTable FILE_VTABLE;
+
 static
 NErrorType *UNEXPECTED_EOF =  NULL;
 
+static
+NErrorType *BAD_ALLOCATION = NULL;
+
+static
+NErrorType *IO_ERROR = NULL;
+
 
 static void
 construct_byte_reader(NByteReader*, NByteReaderVTable*);
@@ -57,6 +85,21 @@ memory_has_data(NByteReader*);
 static void
 memory_destroy(NByteReader*, NError*);
 
+static void*
+memory_map_bytes(NByteReader*, int, NError*);
+
+static NMapping*
+memory_mapping(NByteReader*);
+
+static NMapping*
+file_mapping(NByteReader*);
+
+static void
+file_destroy(NByteReader*, NError*);
+
+static NMapping*
+map_file(const char* file_name, NError* error);
+
 
 
 void
@@ -73,6 +116,16 @@ ni_init_byte_readers(NError* error) {
     MEMORY_VTABLE.skip_bytes = memory_skip_bytes;
     MEMORY_VTABLE.has_data   = memory_has_data;
     MEMORY_VTABLE.destroy    = memory_destroy;
+    MEMORY_VTABLE.map_bytes  = memory_map_bytes;
+    MEMORY_VTABLE.mapping    = memory_mapping;
+
+    FILE_VTABLE = MEMORY_VTABLE;
+    FILE_VTABLE.destroy      = file_destroy;
+    FILE_VTABLE.mapping      = file_mapping;
+
+    BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);         EC;
+    IO_ERROR = n_error_type("nuvm.IoError", error);                     EC;
+#undef EC
 }
 
 
@@ -85,7 +138,29 @@ n_new_byte_reader_from_data(void* data, int size, NError* error) {
 
 NByteReader*
 n_new_byte_reader_from_file(const char* file_name, NError* error) {
-    return NULL;
+    NFileByteReader *self;
+    NMapping *mapping = map_file(file_name, error);
+    if (mapping == NULL) {
+        return NULL;
+    }
+    if (mapping->size > (size_t) 0x7FFFFFFF) {
+        n_set_error(error, IO_ERROR, "File too big for a byte reader.");
+        n_release_mapping(mapping);
+        return NULL;
+    }
+
+    self = malloc(sizeof(NFileByteReader));
+    if (self == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Could not allocate byte reader.");
+        n_release_mapping(mapping);
+        return NULL;
+    }
+    construct_byte_reader((NByteReader*) self, &FILE_VTABLE);
+    self->parent.buffer = mapping->data;
+    self->parent.size = (int) mapping->size;
+    self->parent.current_index = 0;
+    self->mapping = mapping;
+    return (NByteReader*) self;
 }
 
 
@@ -143,6 +218,42 @@ n_destroy_byte_reader(NByteReader* self, NError* error) {
 }
 
 
+void*
+n_map_bytes(NByteReader* self, int size, NError* error) {
+    return self->vtable->map_bytes(self, size, error);
+}
+
+
+NMapping*
+n_byte_reader_mapping(NByteReader* self) {
+    return self->vtable->mapping(self);
+}
+
+
+void
+n_retain_mapping(NMapping* self) {
+    self->references++;
+}
+
+
+void
+n_release_mapping(NMapping* self) {
+    if (self != NULL && --self->references == 0) {
+#ifdef N_MMAP_ENABLED
+        if (self->mapped) {
+            munmap(self->data, self->size);
+        }
+        else {
+            free(self->data);
+        }
+#else
+        free(self->data);
+#endif
+        free(self);
+    }
+}
+
+
 static NMemoryByteReader*
 new_memory_byte_reader(const void* data, int size) {
     NMemoryByteReader* self = malloc(sizeof(NMemoryByteReader));
@@ -270,6 +381,114 @@ memory_destroy(NByteReader* generic_self, NError* error) {
 }
 
 
+static void*
+memory_map_bytes(NByteReader* generic_self, int size, NError* error) {
+    NMemoryByteReader* self = (NMemoryByteReader*) generic_self;
+    void *bytes = (char*) self->buffer + self->current_index;
+
+    if (!assert_readable_size(self, size, error)) return NULL;
+
+    self->current_index += size;
+    return bytes;
+}
+
+
+static NMapping*
+memory_mapping(NByteReader* generic_self) {
+    return NULL;
+}
+
+
+static NMapping*
+file_mapping(NByteReader* generic_self) {
+    NFileByteReader* self = (NFileByteReader*) generic_self;
+    return self->mapping;
+}
+
+
+static void
+file_destroy(NByteReader* generic_self, NError* error) {
+    NFileByteReader* self = (NFileByteReader*) generic_self;
+    n_release_mapping(self->mapping);
+    free(self);
+}
+
+
+/* The pages are mapped writable but private, so that the code loaded from
+ * them can still be patched: only the pages written to get copied. */
+static NMapping*
+map_file(const char* file_name, NError* error) {
+    NMapping *self = malloc(sizeof(NMapping));
+    if (self == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Could not allocate mapping.");
+        return NULL;
+    }
+    self->data = NULL;
+    self->size = 0;
+    self->mapped = 0;
+    self->references = 1;
+
+#ifdef N_MMAP_ENABLED
+    {
+        struct stat status;
+        int fd = open(file_name, O_RDONLY);
+        if (fd < 0 || fstat(fd, &status) != 0) {
+            n_set_error(error, IO_ERROR, "Could not open file.");
+            goto clean_up;
+        }
+        self->size = (size_t) status.st_size;
+        if (self->size > 0) {
+            self->data = mmap(NULL, self->size, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE, fd, 0);
+            if (self->data == MAP_FAILED) {
+                self->data = NULL;
+                n_set_error(error, IO_ERROR, "Could not map file.");
+                goto clean_up;
+            }
+            self->mapped = 1;
+        }
+        close(fd);
+        return self;
+clean_up:
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(self);
+        return NULL;
+    }
+#else
+    {
+        long size;
+        FILE *file = fopen(file_name, "rb");
+        if (file == NULL || fseek(file, 0, SEEK_END) != 0
+            || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET) != 0) {
+            n_set_error(error, IO_ERROR, "Could not open file.");
+            goto clean_up;
+        }
+        self->size = (size_t) size;
+        self->data = malloc(size > 0 ? size : 1);
+        if (self->data == NULL) {
+            n_set_error(error, BAD_ALLOCATION, "Could not allocate buffer.");
+            goto clean_up;
+        }
+        if (fread(self->data, 1, self->size, file) != self->size) {
+            n_set_error(error, IO_ERROR, "Could not read file.");
+            goto clean_up;
+        }
+        fclose(file);
+        return self;
+clean_up:
+        if (file != NULL) {
+            fclose(file);
+        }
+        free(self->data);
+        free(self);
+        return NULL;
+    }
+#endif
+}
+
+
 static void
 construct_byte_reader(NByteReader* self, NByteReaderVTable* vtable) {
     self->vtable = vtable;
@@ -8,6 +8,7 @@
 
 typedef struct NByteReader NByteReader;
 typedef struct NByteReaderVTable NByteReaderVTable;
+typedef struct NMapping NMapping;
 
 
 struct NByteReaderVTable {
@@ -20,6 +21,20 @@ struct NByteReaderVTable {
     int (*has_data)(NByteReader*);
     int (*skip_bytes)(NByteReader*, int, NError*);
     void (*destroy)(NByteReader*, NError*);
+    void* (*map_bytes)(NByteReader*, int, NError*);
+    NMapping* (*mapping)(NByteReader*);
+};
+
+/* The contents of a file, mapped privately in memory where the platform
+ * allows it, so that the pages nobody writes to are shared with every
+ * other process mapping the file, or else read into a buffer. It is
+ * released along with the last reference to it: the reader reading it
+ * holds one, and so does whatever keeps pointers into it. */
+struct NMapping {
+    void *data;
+    size_t size;
+    int mapped;
+    int references;
 };
 
 void
@@ -28,6 +43,7 @@ ni_init_byte_readers(NError* error);
 NByteReader*
 n_new_byte_reader_from_data(void* data, int size, NError* error);
 
+/* Reads the file in place, see NMapping. */
 NByteReader*
 n_new_byte_reader_from_file(const char* file_name, NError* error);
 
@@ -55,6 +71,23 @@ n_skip_bytes(NByteReader*self, int num_bytes, NError* error);
 int
 n_has_bytes_to_read(NByteReader* self);
 
+/* Returns the next size bytes of the reader where they are, skipping them
+ * instead of copying them. They stay valid as long as the data the reader
+ * was created from, or the mapping of a file reader. Fails with
+ * nuvm.UnexpectedEoF, returning NULL, if fewer bytes are left. */
+void*
+n_map_bytes(NByteReader* self, int size, NError* error);
+
+/* The mapping of a file reader, NULL for other readers. */
+NMapping*
+n_byte_reader_mapping(NByteReader* self);
+
+void
+n_retain_mapping(NMapping* self);
+
+void
+n_release_mapping(NMapping* self);
+
 void
 n_destroy_byte_reader(NByteReader* self, NError* error);
 
@@ -1,11 +1,25 @@
 #include "common.h"
+#include "threads.h"
 
 #include "byte-readers.h"
 #include "char-readers.h"
 #include "byte-writers.h"
 
+static
+NOnce COMMON_ONCE = N_ONCE_INIT;
+
+static void
+init_common(NError* error);
+
+
 void
 n_init_common(NError* error) {
+    n_call_once(&COMMON_ONCE, init_common, error);
+}
+
+
+static void
+init_common(NError* error) {
 #define EC ON_ERROR(error, return)
     ni_init_errors(error);                                          EC;
     ni_init_byte_readers(error);                                    EC;
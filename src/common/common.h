@@ -3,6 +3,8 @@
 
 #include "errors.h"
 
+/* Initializes the module the first time it is called, and only reports how
+ * that went afterwards. Safe to call from several threads. */
 void
 n_init_common(NError* error);
 
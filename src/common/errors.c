@@ -1,5 +1,6 @@
 #include "errors.h"
 #include "name-registry.h"
+#include "threads.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -46,6 +47,10 @@ NErrorType* UNKNOWN_ERROR_TYPE = ERROR_TYPES+5;
 static
 NErrorRegistry DEFAULT_REGISTRY;
 
+/* Serializes registrations, lookups don't need it. */
+static
+NMutex REGISTRY_LOCK = N_MUTEX_INIT;
+
 static
 int INITIALIZED = 0;
 
@@ -197,7 +202,9 @@ register_error_type(NErrorRegistry* self, NErrorType* type, NError* error) {
         return;
     }
 
+    n_lock(&REGISTRY_LOCK);
     status = ni_register_named_object(&self->reg, type->name, type);
+    n_unlock(&REGISTRY_LOCK);
     if (status == N_NAMED_REG_INVALID_NAME) {
         n_set_error(error, INVALID_NAME, "The name of an error type must "
                     "be non-NULL, non-empty and contain only alphanumeric "
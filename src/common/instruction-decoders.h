@@ -31,7 +31,7 @@ n_decode_op_jump(unsigned char* stream, int16_t *offset) {
 }
 
 
-int
+static int
 n_decode_op_call(unsigned char* stream, uint8_t *dest, uint8_t *target,
                  uint8_t *n_args) {
     *dest   = stream[1];
@@ -41,7 +41,16 @@ n_decode_op_call(unsigned char* stream, uint8_t *dest, uint8_t *target,
 }
 
 
-int
+static int
+n_decode_op_tail_call(unsigned char* stream, uint8_t *target,
+                      uint8_t *n_args) {
+    *target = stream[1];
+    *n_args = stream[2];
+    return 3;
+}
+
+
+static int
 n_decode_op_global_ref(unsigned char* stream, uint8_t* dest, uint16_t* source) {
     unsigned char* source_bytes = (unsigned char*) source;
     *dest = stream[1];
@@ -51,7 +60,7 @@ n_decode_op_global_ref(unsigned char* stream, uint8_t* dest, uint16_t* source) {
 }
 
 
-int
+static int
 n_decode_op_global_set(unsigned char* stream, uint16_t* dest, uint8_t* source) {
     unsigned char* dest_bytes = (unsigned char*) dest;
     dest_bytes[0] = stream[2];
@@ -61,9 +70,46 @@ n_decode_op_global_set(unsigned char* stream, uint16_t* dest, uint8_t* source) {
 }
 
 
-int
+static int
 n_decode_op_return(unsigned char* stream, uint8_t* source) {
     *source = stream[1];
     return 2;
 }
+
+
+/* Decodes any of the arithmetic and comparison opcodes, which all share the
+ * same layout. */
+static int
+n_decode_op_arithmetic(unsigned char* stream, uint8_t* dest, uint8_t* left,
+                       uint8_t* right) {
+    *dest  = stream[1];
+    *left  = stream[2];
+    *right = stream[3];
+    return 4;
+}
+
+
+/* Decodes any of the jump-if-lt, jump-if-le and jump-if-eq opcodes, which
+ * all share the same layout. */
+static int
+n_decode_op_compare_and_jump(unsigned char* stream, uint8_t* left,
+                             uint8_t* right, int16_t* offset) {
+    unsigned char* offset_bytes = (unsigned char*) offset;
+    *left           = stream[1];
+    *right          = stream[2];
+    offset_bytes[1] = stream[3];
+    offset_bytes[0] = stream[4];
+    return 5;
+}
+
+
+static int
+n_decode_op_jump_if_fixnum_zero(unsigned char* stream, uint8_t* cond,
+                                int16_t* offset) {
+    unsigned char* offset_bytes = (unsigned char*) offset;
+    *cond           = stream[1];
+    offset_bytes[1] = stream[2];
+    offset_bytes[0] = stream[3];
+    return 4;
+}
 #endif /* N_C_INSTRUCTION_ENCODING_H*/
@@ -1,6 +1,14 @@
 #include "instruction-encoders.h"
 #include "opcodes.h"
 
+static int
+encode_arithmetic(unsigned char* stream, uint8_t opcode, uint8_t dest,
+                  uint8_t left, uint8_t right);
+
+static int
+encode_compare_and_jump(unsigned char* stream, uint8_t opcode, uint8_t left,
+                        uint8_t right, int16_t offset);
+
 int
 n_encode_op_nop(unsigned char* stream) {
     stream[0] = N_OP_NOP;
@@ -58,6 +66,15 @@ n_encode_op_call(unsigned char* stream, uint8_t dest, uint8_t target,
 }
 
 
+int
+n_encode_op_tail_call(unsigned char* stream, uint8_t target, uint8_t n_args) {
+    stream[0] = N_OP_TAIL_CALL;
+    stream[1] = target;
+    stream[2] = n_args;
+    return 3;
+}
+
+
 int
 n_encode_op_global_ref(unsigned char* stream, uint8_t dest, uint16_t source) {
     unsigned char* source_bytes = (unsigned char*) &source;
@@ -86,3 +103,107 @@ n_encode_op_return(unsigned char* stream, uint8_t source) {
     stream[1] = source;
     return 2;
 }
+
+
+int
+n_encode_op_add(unsigned char* stream, uint8_t dest, uint8_t left,
+                uint8_t right) {
+    return encode_arithmetic(stream, N_OP_ADD, dest, left, right);
+}
+
+
+int
+n_encode_op_sub(unsigned char* stream, uint8_t dest, uint8_t left,
+                uint8_t right) {
+    return encode_arithmetic(stream, N_OP_SUB, dest, left, right);
+}
+
+
+int
+n_encode_op_mul(unsigned char* stream, uint8_t dest, uint8_t left,
+                uint8_t right) {
+    return encode_arithmetic(stream, N_OP_MUL, dest, left, right);
+}
+
+
+int
+n_encode_op_lt(unsigned char* stream, uint8_t dest, uint8_t left,
+               uint8_t right) {
+    return encode_arithmetic(stream, N_OP_LT, dest, left, right);
+}
+
+
+int
+n_encode_op_le(unsigned char* stream, uint8_t dest, uint8_t left,
+               uint8_t right) {
+    return encode_arithmetic(stream, N_OP_LE, dest, left, right);
+}
+
+
+int
+n_encode_op_eq(unsigned char* stream, uint8_t dest, uint8_t left,
+               uint8_t right) {
+    return encode_arithmetic(stream, N_OP_EQ, dest, left, right);
+}
+
+
+int
+n_encode_op_jump_if_lt(unsigned char* stream, uint8_t left, uint8_t right,
+                       int16_t offset) {
+    return encode_compare_and_jump(stream, N_OP_JUMP_IF_LT, left, right,
+                                   offset);
+}
+
+
+int
+n_encode_op_jump_if_le(unsigned char* stream, uint8_t left, uint8_t right,
+                       int16_t offset) {
+    return encode_compare_and_jump(stream, N_OP_JUMP_IF_LE, left, right,
+                                   offset);
+}
+
+
+int
+n_encode_op_jump_if_eq(unsigned char* stream, uint8_t left, uint8_t right,
+                       int16_t offset) {
+    return encode_compare_and_jump(stream, N_OP_JUMP_IF_EQ, left, right,
+                                   offset);
+}
+
+
+int
+n_encode_op_jump_if_fixnum_zero(unsigned char* stream, uint8_t cond,
+                                int16_t offset) {
+    unsigned char* offset_bytes = (unsigned char*) &offset;
+    stream[0] = N_OP_JUMP_IF_FIXNUM_ZERO;
+    stream[1] = cond;
+    stream[2] = offset_bytes[1];
+    stream[3] = offset_bytes[0];
+    return 4;
+}
+
+
+/* All arithmetic and comparison opcodes share the same layout. */
+static int
+encode_arithmetic(unsigned char* stream, uint8_t opcode, uint8_t dest,
+                  uint8_t left, uint8_t right) {
+    stream[0] = opcode;
+    stream[1] = dest;
+    stream[2] = left;
+    stream[3] = right;
+    return 4;
+}
+
+
+/* As do the opcodes that compare two locals and jump. */
+static int
+encode_compare_and_jump(unsigned char* stream, uint8_t opcode, uint8_t left,
+                        uint8_t right, int16_t offset) {
+    unsigned char* offset_bytes = (unsigned char*) &offset;
+    stream[0] = opcode;
+    stream[1] = left;
+    stream[2] = right;
+    stream[3] = offset_bytes[1];
+    stream[4] = offset_bytes[0];
+    return 5;
+}
@@ -22,6 +22,9 @@ int
 n_encode_op_call(unsigned char* stream, uint8_t dest, uint8_t target,
                  uint8_t n_args);
 
+int
+n_encode_op_tail_call(unsigned char* stream, uint8_t target, uint8_t n_args);
+
 int
 n_encode_op_global_ref(unsigned char* stream, uint8_t dest, uint16_t source);
 
@@ -30,4 +33,45 @@ n_encode_op_global_set(unsigned char* stream, uint16_t dest, uint8_t source);
 
 int
 n_encode_op_return(unsigned char* stream, uint8_t source);
+
+int
+n_encode_op_add(unsigned char* stream, uint8_t dest, uint8_t left,
+                uint8_t right);
+
+int
+n_encode_op_sub(unsigned char* stream, uint8_t dest, uint8_t left,
+                uint8_t right);
+
+int
+n_encode_op_mul(unsigned char* stream, uint8_t dest, uint8_t left,
+                uint8_t right);
+
+int
+n_encode_op_lt(unsigned char* stream, uint8_t dest, uint8_t left,
+               uint8_t right);
+
+int
+n_encode_op_le(unsigned char* stream, uint8_t dest, uint8_t left,
+               uint8_t right);
+
+int
+n_encode_op_eq(unsigned char* stream, uint8_t dest, uint8_t left,
+               uint8_t right);
+
+int
+n_encode_op_jump_if_lt(unsigned char* stream, uint8_t left, uint8_t right,
+                       int16_t offset);
+
+int
+n_encode_op_jump_if_le(unsigned char* stream, uint8_t left, uint8_t right,
+                       int16_t offset);
+
+int
+n_encode_op_jump_if_eq(unsigned char* stream, uint8_t left, uint8_t right,
+                       int16_t offset);
+
+int
+n_encode_op_jump_if_fixnum_zero(unsigned char* stream, uint8_t cond,
+                                int16_t offset);
+
 #endif /* N_C_INSTRUCTION_ENCODING_H*/
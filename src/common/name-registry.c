@@ -1,14 +1,21 @@
 #include "name-registry.h"
+#include "threads.h"
 
 #include <stdlib.h>
-#include <string.h>
 #include <ctype.h>
 
+/* An entry is free until its object is set, which is done last. */
 struct NNamedEntry {
-    const char* name;
+    NSymbol symbol;
     const void* object;
 };
 
+/* The entries follow the table in the same block. */
+struct NNameTable {
+    size_t mask;
+    NNamedEntry *entries;
+};
+
 
 
 static int
@@ -17,26 +24,35 @@ is_valid_name_char(char c);
 static int
 is_valid_name(const char* name);
 
+static NNameTable*
+create_table(size_t size);
+
+static NNamedEntry*
+find_entry(NNameTable* table, NSymbol symbol);
+
 static int
-grow_pool(NNameRegistry* self);
+grow_table(NNameRegistry* self);
 
 
 
 int
 ni_construct_name_registry(NNameRegistry* self, int initial_size) {
-    NNamedEntry* new_pool = NULL;
+    size_t size = 4;
 
     if (initial_size <= 0) {
         return N_NAMED_REG_INVALID_SIZE;
     }
 
-    new_pool = malloc(sizeof(NNamedEntry) * initial_size);
-    if (new_pool == NULL) {
+    while (size / 4 * 3 < (size_t) initial_size) {
+        size *= 2;
+    }
+    self->table = create_table(size);
+    if (self->table == NULL) {
         return N_NAMED_REG_BAD_ALLOCATION;
     }
-    self->pool = new_pool;
-    self->pool_size = initial_size;
     self->num_objects = 0;
+    self->retired = NULL;
+    self->num_retired = 0;
     return N_NAMED_REG_SUCCESS;
 
 }
@@ -44,7 +60,12 @@ ni_construct_name_registry(NNameRegistry* self, int initial_size) {
 
 void
 ni_destruct_name_registry(NNameRegistry* self) {
-    free(self->pool);
+    int i;
+    for (i = 0; i < self->num_retired; i++) {
+        free(self->retired[i]);
+    }
+    free(self->retired);
+    free(self->table);
     return;
 }
 
@@ -52,45 +73,54 @@ ni_destruct_name_registry(NNameRegistry* self) {
 int
 ni_register_named_object(NNameRegistry* self, const char* name,
                          const void* obj) {
+    NSymbol symbol;
+    NNamedEntry *entry;
+
     if (name == NULL || *name == '\0' || !is_valid_name(name)) {
         return N_NAMED_REG_INVALID_NAME;
     }
     if (obj == NULL) {
         return N_NAMED_REG_INVALID_OBJECT;
     }
-    if (self->num_objects >= self->pool_size) {
-        int status = grow_pool(self);
+
+    symbol = n_intern(name);
+    if (symbol == N_NO_SYMBOL) {
+        return N_NAMED_REG_BAD_ALLOCATION;
+    }
+    if (find_entry(self->table, symbol)->object != NULL) {
+        return N_NAMED_REG_REPEATED_NAME;
+    }
+    if ((size_t) self->num_objects >= (self->table->mask + 1) / 4 * 3) {
+        int status = grow_table(self);
         if (status != N_NAMED_REG_SUCCESS) {
             return status;
         }
     }
 
-    {
-        const void* original = ni_find_named_object(self, name);
-        if (original != NULL) {
-            return N_NAMED_REG_REPEATED_NAME;
-        }
-    }
-
-    {
-        int index = self->num_objects++;
-        self->pool[index].name = name;
-        self->pool[index].object = obj;
-    }
+    entry = find_entry(self->table, symbol);
+    entry->symbol = symbol;
+    N_STORE_RELEASE(&entry->object, obj);
+    self->num_objects++;
     return N_NAMED_REG_SUCCESS;
 
 }
 
 
+/* Names that were never interned can't have been registered. */
 const void*
 ni_find_named_object(NNameRegistry* self, const char* name) {
-    int i;
-    for (i = 0; i < self->num_objects; i++) {
-        if (! strcmp(self->pool[i].name, name)) {
-            return self->pool[i].object;
-        }
+    NSymbol symbol = n_find_symbol(name);
+    if (symbol == N_NO_SYMBOL) {
+        return NULL;
     }
-    return NULL;
+    return ni_find_symbol_object(self, symbol);
+}
+
+
+const void*
+ni_find_symbol_object(NNameRegistry* self, NSymbol symbol) {
+    NNameTable *table = N_LOAD_ACQUIRE(&self->table);
+    return N_LOAD_ACQUIRE(&find_entry(table, symbol)->object);
 }
 
 
@@ -113,15 +143,66 @@ is_valid_name(const char* name) {
 }
 
 
+/* The size must be a power of two. */
+static NNameTable*
+create_table(size_t size) {
+    NNameTable *table;
+    size_t i;
+
+    table = malloc(sizeof(NNameTable) + sizeof(NNamedEntry) * size);
+    if (table == NULL) {
+        return NULL;
+    }
+    table->mask = size - 1;
+    table->entries = (NNamedEntry*) (table + 1);
+    for (i = 0; i < size; i++) {
+        table->entries[i].object = NULL;
+    }
+    return table;
+}
+
+
+/* Returns the entry of the symbol, or the free one it would go in. Symbols
+ * are dense, so they are spread over the table by a multiplicative
+ * hash. */
+static NNamedEntry*
+find_entry(NNameTable* table, NSymbol symbol) {
+    size_t index = (uint32_t) (symbol * 2654435761u) & table->mask;
+    for (;;) {
+        NNamedEntry *entry = table->entries + index;
+        if (N_LOAD_ACQUIRE(&entry->object) == NULL
+            || entry->symbol == symbol) {
+            return entry;
+        }
+        index = (index + 1) & table->mask;
+    }
+}
+
+
+/* The entries are rehashed into a new table rather than moved in place,
+ * so that lookups running meanwhile can go on reading the old one. */
 static int
-grow_pool(NNameRegistry* self) {
-    int new_size = self->pool_size * 2;
-    NNamedEntry* new_pool =
-        realloc(self->pool, sizeof(NNamedEntry) * new_size);
-    if (new_pool == NULL) {
+grow_table(NNameRegistry* self) {
+    NNameTable *old_table = self->table;
+    size_t old_size = old_table->mask + 1;
+    size_t retired_size = sizeof(NNameTable*) * (self->num_retired + 1);
+    NNameTable* new_table = create_table(old_size * 2);
+    NNameTable** new_retired = realloc(self->retired, retired_size);
+    size_t i;
+    if (new_retired != NULL) {
+        self->retired = new_retired;
+    }
+    if (new_table == NULL || new_retired == NULL) {
+        free(new_table);
         return N_NAMED_REG_BAD_ALLOCATION;
     }
-    self->pool = new_pool;
-    self->pool_size = new_size;
+    for (i = 0; i < old_size; i++) {
+        NNamedEntry *old_entry = old_table->entries + i;
+        if (old_entry->object != NULL) {
+            *find_entry(new_table, old_entry->symbol) = *old_entry;
+        }
+    }
+    self->retired[self->num_retired++] = old_table;
+    N_STORE_RELEASE(&self->table, new_table);
     return N_NAMED_REG_SUCCESS;
 }
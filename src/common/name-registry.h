@@ -1,6 +1,8 @@
 #ifndef N_C_NAMED_REG_H
 #define N_C_NAMED_REG_H
 
+#include "symbols.h"
+
 
 #define N_NAMED_REG_INVALID_OBJECT -5
 #define N_NAMED_REG_UNKNOWN_NAME   -5
@@ -13,14 +15,29 @@
 
 typedef struct NNameRegistry NNameRegistry;
 typedef struct NNamedEntry NNamedEntry;
-
+typedef struct NNameTable NNameTable;
+
+/* Objects are kept in an open addressing hash table keyed by the symbols
+ * of their names, see symbols.h, which doubles once it is three quarters
+ * full.
+ *
+ * Lookups never lock, so they can run on any number of threads, alongside
+ * a single registration at a time: callers that register from several
+ * threads must serialize the registrations themselves. A new object is
+ * only published once its entry is complete, and tables that have been
+ * outgrown are kept until the registry is destructed, since lookups may
+ * still be reading them. */
 struct NNameRegistry {
-    int pool_size;
     int num_objects;
-    NNamedEntry *pool;
+    NNameTable *table;
+    NNameTable **retired;
+    int num_retired;
 };
 
 
+/* The registry holds initial_size objects before its table first grows,
+ * so registries whose size is known up front are filled without
+ * rehashing. */
 int
 ni_construct_name_registry(NNameRegistry* self, int initial_size);
 
@@ -34,5 +51,8 @@ ni_register_named_object(NNameRegistry* self, const char* name,
 const void*
 ni_find_named_object(NNameRegistry*, const char* name);
 
+const void*
+ni_find_symbol_object(NNameRegistry* self, NSymbol symbol);
+
 #endif /*N_C_NAMED_REG_H*/
 
@@ -15,6 +15,17 @@ n_get_opcode_name(NOpcode opcode) {
         case N_OP_RETURN:      return "return";
         case N_OP_GLOBAL_REF:  return "global-ref";
         case N_OP_GLOBAL_SET:  return "global-set";
+        case N_OP_TAIL_CALL:   return "tail-call";
+        case N_OP_ADD:         return "add";
+        case N_OP_SUB:         return "sub";
+        case N_OP_MUL:         return "mul";
+        case N_OP_LT:          return "lt";
+        case N_OP_LE:          return "le";
+        case N_OP_EQ:          return "eq";
+        case N_OP_JUMP_IF_LT:  return "jump-if-lt";
+        case N_OP_JUMP_IF_LE:  return "jump-if-le";
+        case N_OP_JUMP_IF_EQ:  return "jump-if-eq";
+        case N_OP_JUMP_IF_FIXNUM_ZERO: return "jump-if-fixnum-zero";
     }
     return NULL;
 }
@@ -31,6 +42,17 @@ n_get_opcode_size(NOpcode opcode) {
         case N_OP_RETURN:      return 2;
         case N_OP_GLOBAL_REF:  return 4;
         case N_OP_GLOBAL_SET:  return 4;
+        case N_OP_TAIL_CALL:   return 3;
+        case N_OP_ADD:         return 4;
+        case N_OP_SUB:         return 4;
+        case N_OP_MUL:         return 4;
+        case N_OP_LT:          return 4;
+        case N_OP_LE:          return 4;
+        case N_OP_EQ:          return 4;
+        case N_OP_JUMP_IF_LT:  return 5;
+        case N_OP_JUMP_IF_LE:  return 5;
+        case N_OP_JUMP_IF_EQ:  return 5;
+        case N_OP_JUMP_IF_FIXNUM_ZERO: return 4;
     }
     return 0;
 }
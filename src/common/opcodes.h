@@ -12,11 +12,26 @@ enum NOpcode {
  N_OP_CALL         = 0x05,
  N_OP_RETURN       = 0x06,
  N_OP_GLOBAL_REF   = 0x07,
- N_OP_GLOBAL_SET   = 0x08
+ N_OP_GLOBAL_SET   = 0x08,
+ N_OP_TAIL_CALL    = 0x09,
+ N_OP_ADD          = 0x0A,
+ N_OP_SUB          = 0x0B,
+ N_OP_MUL          = 0x0C,
+ N_OP_LT           = 0x0D,
+ N_OP_LE           = 0x0E,
+ N_OP_EQ           = 0x0F,
+ N_OP_JUMP_IF_LT   = 0x10,
+ N_OP_JUMP_IF_LE   = 0x11,
+ N_OP_JUMP_IF_EQ   = 0x12,
+ N_OP_JUMP_IF_FIXNUM_ZERO = 0x13
 };
 
 typedef enum NOpcode NOpcode;
 
+/* Opcodes are numbered sequentially from zero, so any value not below this
+ * one is not a known opcode. */
+#define N_NUM_OPCODES (N_OP_JUMP_IF_FIXNUM_ZERO + 1)
+
 const char*
 n_get_opcode_name(NOpcode opcode);
 
@@ -0,0 +1,208 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "symbols.h"
+#include "threads.h"
+
+#define INITIAL_TABLE_SIZE 256
+#define NAMES_BLOCK_SIZE 4096
+
+/* Names are kept in chunks, so that they never move once published. */
+#define CHUNK_BITS 10
+#define CHUNK_SIZE (1L << CHUNK_BITS)
+#define NUM_CHUNKS ((N_MAX_SYMBOLS + CHUNK_SIZE - 1) / CHUNK_SIZE)
+
+typedef struct NSymbolEntry NSymbolEntry;
+typedef struct NSymbolTable NSymbolTable;
+
+/* An entry is free until its symbol is set, which is done last. */
+struct NSymbolEntry {
+    uint32_t hash;
+    NSymbol symbol;
+};
+
+/* The entries follow the table in the same block. Outgrown tables are
+ * kept, lookups may still be reading them. */
+struct NSymbolTable {
+    size_t mask;
+    NSymbolEntry *entries;
+    NSymbolTable *previous;
+};
+
+
+/* Serializes interning, lookups don't need it. */
+static
+NMutex SYMBOLS_LOCK = N_MUTEX_INIT;
+
+static
+NSymbolTable *TABLE = NULL;
+
+static
+const char **NAMES[NUM_CHUNKS];
+
+static
+NSymbol NUM_SYMBOLS = 0;
+
+static
+NArena NAMES_ARENA = { NULL, NAMES_BLOCK_SIZE, 0 };
+
+
+static uint32_t
+hash_name(const char* name);
+
+static NSymbolEntry*
+find_entry(NSymbolTable* table, const char* name, uint32_t hash);
+
+static NSymbolTable*
+create_table(size_t size, NSymbolTable* previous);
+
+static int
+grow_table(void);
+
+static NSymbol
+add_symbol(const char* name);
+
+
+NSymbol
+n_intern(const char* name) {
+    uint32_t hash = hash_name(name);
+    NSymbolEntry *entry;
+    NSymbol symbol = n_find_symbol(name);
+    if (symbol != N_NO_SYMBOL) {
+        return symbol;
+    }
+
+    n_lock(&SYMBOLS_LOCK);
+    if (TABLE == NULL || NUM_SYMBOLS >= (TABLE->mask + 1) / 4 * 3) {
+        if (!grow_table()) {
+            n_unlock(&SYMBOLS_LOCK);
+            return N_NO_SYMBOL;
+        }
+    }
+    entry = find_entry(TABLE, name, hash);
+    symbol = entry->symbol;
+    if (symbol == N_NO_SYMBOL) {
+        symbol = add_symbol(name);
+        if (symbol != N_NO_SYMBOL) {
+            entry->hash = hash;
+            N_STORE_RELEASE(&entry->symbol, symbol);
+        }
+    }
+    n_unlock(&SYMBOLS_LOCK);
+    return symbol;
+}
+
+
+NSymbol
+n_find_symbol(const char* name) {
+    NSymbolTable *table = N_LOAD_ACQUIRE(&TABLE);
+    if (table == NULL) {
+        return N_NO_SYMBOL;
+    }
+    return find_entry(table, name, hash_name(name))->symbol;
+}
+
+
+const char*
+n_symbol_name(NSymbol symbol) {
+    return NAMES[symbol >> CHUNK_BITS][symbol & (CHUNK_SIZE - 1)];
+}
+
+
+
+/********** STATIC FUNCTIONS **********/
+
+/* FNV-1a. */
+static uint32_t
+hash_name(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (unsigned char) *name++) * 16777619u;
+    }
+    return hash;
+}
+
+
+/* Returns the entry of the name, or the free one it would go in. */
+static NSymbolEntry*
+find_entry(NSymbolTable* table, const char* name, uint32_t hash) {
+    size_t index = hash & table->mask;
+    for (;;) {
+        NSymbolEntry *entry = table->entries + index;
+        NSymbol symbol = N_LOAD_ACQUIRE(&entry->symbol);
+        if (symbol == N_NO_SYMBOL
+            || (entry->hash == hash
+                && !strcmp(n_symbol_name(symbol), name))) {
+            return entry;
+        }
+        index = (index + 1) & table->mask;
+    }
+}
+
+
+/* The size must be a power of two. */
+static NSymbolTable*
+create_table(size_t size, NSymbolTable* previous) {
+    NSymbolTable *table;
+    size_t i;
+
+    table = malloc(sizeof(NSymbolTable) + sizeof(NSymbolEntry) * size);
+    if (table == NULL) {
+        return NULL;
+    }
+    table->mask = size - 1;
+    table->entries = (NSymbolEntry*) (table + 1);
+    table->previous = previous;
+    for (i = 0; i < size; i++) {
+        table->entries[i].symbol = N_NO_SYMBOL;
+    }
+    return table;
+}
+
+
+static int
+grow_table(void) {
+    size_t size = TABLE != NULL ? (TABLE->mask + 1) * 2 : INITIAL_TABLE_SIZE;
+    NSymbolTable *table = create_table(size, TABLE);
+    size_t i;
+    if (table == NULL) {
+        return 0;
+    }
+    for (i = 0; TABLE != NULL && i <= TABLE->mask; i++) {
+        NSymbolEntry *entry = TABLE->entries + i;
+        if (entry->symbol != N_NO_SYMBOL) {
+            *find_entry(table, n_symbol_name(entry->symbol), entry->hash)
+                = *entry;
+        }
+    }
+    N_STORE_RELEASE(&TABLE, table);
+    return 1;
+}
+
+
+/* Symbol 0 is left unused, so that N_NO_SYMBOL has no name. */
+static NSymbol
+add_symbol(const char* name) {
+    NSymbol symbol = NUM_SYMBOLS + 1;
+    const char ***chunk = NAMES + (symbol >> CHUNK_BITS);
+    char *copy;
+
+    if (symbol >= N_MAX_SYMBOLS) {
+        return N_NO_SYMBOL;
+    }
+    if (*chunk == NULL) {
+        *chunk = calloc(CHUNK_SIZE, sizeof(const char*));
+        if (*chunk == NULL) {
+            return N_NO_SYMBOL;
+        }
+    }
+    copy = n_arena_allocate(&NAMES_ARENA, strlen(name) + 1);
+    if (copy == NULL) {
+        return N_NO_SYMBOL;
+    }
+    strcpy(copy, name);
+    (*chunk)[symbol & (CHUNK_SIZE - 1)] = copy;
+    NUM_SYMBOLS = symbol;
+    return symbol;
+}
@@ -0,0 +1,36 @@
+#ifndef N_C_SYMBOLS_H
+#define N_C_SYMBOLS_H
+
+#include "compatibility/stdint.h"
+
+/* Symbols are small integers standing for interned names: a name is
+ * interned once, and every later interning of an equal string gives the
+ * same symbol, so names can be compared, hashed and used as keys as
+ * integers. Symbols are dense and start at 1, N_NO_SYMBOL standing for
+ * none, and are never released.
+ *
+ * The symbol table is shared by the whole process. Lookups never lock,
+ * interning new names is serialized internally. */
+typedef uint32_t NSymbol;
+
+#define N_NO_SYMBOL 0
+
+#ifndef N_MAX_SYMBOLS
+#define N_MAX_SYMBOLS (1024L * 1024L)
+#endif
+
+
+/* Copies the name the first time it is interned. Returns N_NO_SYMBOL when
+ * there is no memory or no symbol left. */
+NSymbol
+n_intern(const char* name);
+
+/* Returns the symbol of an already interned name, or N_NO_SYMBOL. */
+NSymbol
+n_find_symbol(const char* name);
+
+/* The symbol must have been returned by n_intern. */
+const char*
+n_symbol_name(NSymbol symbol);
+
+#endif /* N_C_SYMBOLS_H */
@@ -0,0 +1,73 @@
+#include "threads.h"
+
+
+void
+n_construct_mutex(NMutex* mutex) {
+#ifdef N_THREADS_ENABLED
+    pthread_mutex_init(mutex, NULL);
+#else
+    *mutex = N_MUTEX_INIT;
+#endif
+}
+
+
+void
+n_destruct_mutex(NMutex* mutex) {
+#ifdef N_THREADS_ENABLED
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+
+void
+n_lock(NMutex* mutex) {
+#ifdef N_THREADS_ENABLED
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+
+void
+n_unlock(NMutex* mutex) {
+#ifdef N_THREADS_ENABLED
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+
+NThreadId
+n_current_thread(void) {
+#ifdef N_THREADS_ENABLED
+    return pthread_self();
+#else
+    return 0;
+#endif
+}
+
+
+int
+n_same_thread(NThreadId left, NThreadId right) {
+#ifdef N_THREADS_ENABLED
+    return pthread_equal(left, right);
+#else
+    return left == right;
+#endif
+}
+
+
+/* Once done is set, the results of init are published and no lock is
+ * taken anymore. */
+void
+n_call_once(NOnce* once, void (*init)(NError*), NError* error) {
+    if (!N_LOAD_ACQUIRE(&once->done)) {
+        n_lock(&once->lock);
+        if (!once->done) {
+            init(&once->result);
+            N_STORE_RELEASE(&once->done, 1);
+        }
+        n_unlock(&once->lock);
+    }
+    if (!n_is_ok(&once->result)) {
+        n_set_error(error, once->result.type, once->result.message);
+    }
+}
@@ -0,0 +1,73 @@
+#ifndef N_C_THREADS_H
+#define N_C_THREADS_H
+
+#include "errors.h"
+
+/* Support for threads is only built in when N_THREADS is defined, and needs
+ * pthreads and the atomic builtins of GCC and Clang. Everywhere else the
+ * primitives below do no synchronization at all. */
+#if defined(N_THREADS) && defined(__GNUC__)
+#  define N_THREADS_ENABLED
+#endif
+
+#ifdef N_THREADS_ENABLED
+#include <pthread.h>
+
+typedef pthread_mutex_t NMutex;
+#define N_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+
+typedef pthread_t NThreadId;
+
+/* Publishes the stores made before a release to the threads that load the
+ * stored value with an acquire. */
+#define N_LOAD_ACQUIRE(P)     __atomic_load_n((P), __ATOMIC_ACQUIRE)
+#define N_STORE_RELEASE(P, V) __atomic_store_n((P), (V), __ATOMIC_RELEASE)
+#else
+typedef int NMutex;
+#define N_MUTEX_INIT 0
+
+typedef int NThreadId;
+
+#define N_LOAD_ACQUIRE(P)     (*(P))
+#define N_STORE_RELEASE(P, V) (*(P) = (V))
+#endif /* N_THREADS_ENABLED */
+
+typedef struct NOnce NOnce;
+
+/* Runs an initialization function a single time, however many threads ask
+ * for it. Must be statically initialized with N_ONCE_INIT. */
+struct NOnce {
+    NMutex lock;
+    int done;
+    NError result;
+};
+
+#define N_ONCE_INIT { N_MUTEX_INIT, 0, { NULL, NULL, NULL, NULL } }
+
+
+/* For mutexes that can't be statically initialized with N_MUTEX_INIT. */
+void
+n_construct_mutex(NMutex* mutex);
+
+void
+n_destruct_mutex(NMutex* mutex);
+
+void
+n_lock(NMutex* mutex);
+
+void
+n_unlock(NMutex* mutex);
+
+NThreadId
+n_current_thread(void);
+
+int
+n_same_thread(NThreadId left, NThreadId right);
+
+/* Calls init unless it was already called through the same once, waiting
+ * for it to finish when another thread is running it. The error it failed
+ * with, if any, is reported to every caller, and init is not retried. */
+void
+n_call_once(NOnce* once, void (*init)(NError*), NError* error);
+
+#endif /* N_C_THREADS_H */
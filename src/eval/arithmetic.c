@@ -0,0 +1,53 @@
+#include "../common/common.h"
+
+#include "arithmetic.h"
+#include "singletons.h"
+
+static
+NErrorType* ILLEGAL_ARGUMENT = NULL;
+
+static
+NErrorType* OVERFLOW = NULL;
+
+
+void
+ni_init_arithmetic(NError* error) {
+#define EC ON_ERROR(error, return)
+	ILLEGAL_ARGUMENT = n_error_type("nuvm.IllegalArgument", error);  EC;
+	OVERFLOW = n_error_type("nuvm.Overflow", error);                 EC;
+#undef EC
+}
+
+
+NValue
+n_arithmetic(NOpcode opcode, NValue left, NValue right, NError *error) {
+    int64_t l, r, result;
+
+    if (!n_is_fixnum(left) || !n_is_fixnum(right)) {
+        n_set_error(error, ILLEGAL_ARGUMENT, "Operands to arithmetic "
+                    "instructions must be fixnums.");
+        return N_UNKNOWN;
+    }
+    l = n_unwrap_fixnum(left);
+    r = n_unwrap_fixnum(right);
+
+    switch (opcode) {
+        case N_OP_ADD: result = l + r; break;
+        case N_OP_SUB: result = l - r; break;
+        case N_OP_MUL: result = l * r; break;
+        case N_OP_LT:  return n_wrap_boolean(l < r);
+        case N_OP_LE:  return n_wrap_boolean(l <= r);
+        case N_OP_EQ:  return n_wrap_boolean(l == r);
+        default:
+            n_set_error(error, ILLEGAL_ARGUMENT, "Opcode is not an "
+                        "arithmetic instruction.");
+            return N_UNKNOWN;
+    }
+
+    if (result < N_FIXNUM_MIN || result > N_FIXNUM_MAX) {
+        n_set_error(error, OVERFLOW, "Result of arithmetic instruction "
+                    "does not fit in a fixnum.");
+        return N_UNKNOWN;
+    }
+    return n_wrap_fixnum((NFixnum) result);
+}
@@ -0,0 +1,18 @@
+#ifndef N_E_ARITHMETIC_H
+#define N_E_ARITHMETIC_H
+
+#include "../common/errors.h"
+#include "../common/opcodes.h"
+
+#include "values.h"
+
+void
+ni_init_arithmetic(NError* error);
+
+/* Runs one of the arithmetic or comparison opcodes on the given operands.
+ * This is the slow path of those opcodes: the evaluator handles fixnums
+ * that do not overflow inline, and calls this for everything else. */
+NValue
+n_arithmetic(NOpcode opcode, NValue left, NValue right, NError *error);
+
+#endif /* N_E_ARITHMETIC_H */
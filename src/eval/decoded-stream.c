@@ -0,0 +1,254 @@
+#include "../common/common.h"
+#include "../common/opcodes.h"
+#include "../common/instruction-decoders.h"
+
+#include "decoded-stream.h"
+
+static
+NErrorType* BAD_ALLOCATION = NULL;
+
+static void
+decode_instruction(NDecodedInstruction *instr, unsigned char *code,
+                   uint32_t pc, uint32_t code_size);
+
+static int
+create_call_sites(NDecodedStream *self);
+
+
+void
+ni_init_decoded_streams(NError* error) {
+#define EC ON_ERROR(error, return)
+	BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);    EC;
+#undef EC
+}
+
+
+NDecodedStream*
+n_decode_stream(unsigned char *code, uint32_t code_size, NError *error) {
+    uint32_t pc;
+    NDecodedStream *self = malloc(sizeof(NDecodedStream));
+    if (self == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate decoded "
+                    "stream.");
+        return NULL;
+    }
+
+    /* One extra instruction, always invalid, is placed after the end of the
+     * code. Jumps that would leave the code land on it instead. */
+    self->instructions =
+        malloc(sizeof(NDecodedInstruction) * (code_size + 1));
+    if (self->instructions == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate decoded "
+                    "stream.");
+        free(self);
+        return NULL;
+    }
+    self->size = code_size;
+    self->linked_table = NULL;
+    self->call_sites = NULL;
+    self->num_call_sites = 0;
+
+    /* Decoding every offset, rather than following the instructions from
+     * the start, makes any program counter valid, even if the code mixes
+     * instructions with data or has jumps to the middle of instructions. */
+    for (pc = 0; pc < code_size; pc++) {
+        decode_instruction(self->instructions + pc, code, pc, code_size);
+    }
+    self->instructions[code_size].handler = NULL;
+    self->instructions[code_size].opcode = N_DECODED_INVALID;
+
+    if (!create_call_sites(self)) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate decoded "
+                    "stream.");
+        n_destroy_decoded_stream(self);
+        return NULL;
+    }
+    return self;
+}
+
+
+void
+n_destroy_decoded_stream(NDecodedStream* self) {
+    if (self != NULL) {
+        free(self->instructions);
+        free(self->call_sites);
+        free(self);
+    }
+}
+
+
+static int
+is_truncated(uint32_t pc, uint32_t size, uint32_t code_size) {
+    return size > code_size - pc;
+}
+
+
+static int32_t
+jump_target(uint32_t pc, int16_t offset, uint32_t code_size) {
+    int32_t target = (int32_t) pc + offset;
+    if (target < 0 || (uint32_t) target >= code_size) {
+        return (int32_t) code_size;
+    }
+    return target;
+}
+
+
+static int
+is_call(NDecodedInstruction *instr) {
+    return instr->opcode == N_OP_CALL || instr->opcode == N_OP_TAIL_CALL;
+}
+
+
+/* Gives each call and tail-call instruction its own, empty, call site. The
+ * offset of the next instruction, decoded into the call's wide operand,
+ * moves to the call site and is replaced by the site's index. */
+static int
+create_call_sites(NDecodedStream *self) {
+    uint32_t pc, num_call_sites = 0;
+    for (pc = 0; pc < self->size; pc++) {
+        num_call_sites += is_call(self->instructions + pc);
+    }
+    if (num_call_sites == 0) {
+        return 1;
+    }
+
+    self->call_sites = malloc(sizeof(NCallSite) * num_call_sites);
+    if (self->call_sites == NULL) {
+        return 0;
+    }
+    self->num_call_sites = num_call_sites;
+
+    num_call_sites = 0;
+    for (pc = 0; pc < self->size; pc++) {
+        NDecodedInstruction *instr = self->instructions + pc;
+        if (is_call(instr)) {
+            NCallSite *site = self->call_sites + num_call_sites;
+            site->next_pc = instr->wide;
+            site->num_entries = 0;
+            instr->wide = num_call_sites++;
+        }
+    }
+    return 1;
+}
+
+
+/* Jump targets outside of the code point to the invalid instruction after
+ * its end. The operand layout of each decoded opcode is:
+ *
+ *   load-i16:    u8s[0] = dest,   wide = value
+ *   jump:                         wide = target
+ *   jump-unless: u8s[0] = cond,   wide = target
+ *   call:        u8s[0] = dest,   u8s[1] = target, u8s[2] = n_args,
+ *                wide = index of the call site, which holds the offset
+ *                of the next instruction
+ *   tail-call:                    u8s[1] = target, u8s[2] = n_args,
+ *                wide = as in call
+ *   return:      u8s[0] = source
+ *   global-ref:  u8s[0] = dest,   wide = source
+ *   global-set:  u8s[0] = source, wide = dest
+ *   arithmetic:  u8s[0] = dest,   u8s[1] = left,   u8s[2] = right
+ *   jump-if-lt, jump-if-le, jump-if-eq:
+ *                u8s[0] = left,   u8s[1] = right,  wide = target
+ *   jump-if-fixnum-zero:
+ *                u8s[0] = cond,   wide = target
+ */
+static void
+decode_instruction(NDecodedInstruction *instr, unsigned char *code,
+                   uint32_t pc, uint32_t code_size) {
+    unsigned char *stream = code + pc;
+    uint8_t opcode = stream[0];
+    uint32_t size = n_get_opcode_size((NOpcode) opcode);
+
+    instr->handler = NULL;
+    instr->opcode = N_DECODED_INVALID;
+    instr->u8s[0] = instr->u8s[1] = instr->u8s[2] = 0;
+    instr->wide = 0;
+
+    if (size == 0 || is_truncated(pc, size, code_size)) {
+        return;
+    }
+
+    switch (opcode) {
+        case N_OP_NOP:
+        case N_OP_HALT:
+            break;
+        case N_OP_LOAD_I16: {
+            int16_t value;
+            n_decode_op_load_i16(stream, instr->u8s, &value);
+            instr->wide = value;
+            break;
+        }
+        case N_OP_JUMP: {
+            int16_t offset;
+            n_decode_op_jump(stream, &offset);
+            instr->wide = jump_target(pc, offset, code_size);
+            break;
+        }
+        case N_OP_JUMP_UNLESS: {
+            int16_t offset;
+            n_decode_op_jump_unless(stream, instr->u8s, &offset);
+            instr->wide = jump_target(pc, offset, code_size);
+            break;
+        }
+        case N_OP_CALL: {
+            n_decode_op_call(stream, instr->u8s, instr->u8s+1, instr->u8s+2);
+            size += instr->u8s[2];
+            if (is_truncated(pc, size, code_size)) {
+                return;
+            }
+            instr->wide = pc + size;
+            break;
+        }
+        case N_OP_TAIL_CALL: {
+            n_decode_op_tail_call(stream, instr->u8s+1, instr->u8s+2);
+            size += instr->u8s[2];
+            if (is_truncated(pc, size, code_size)) {
+                return;
+            }
+            instr->wide = pc + size;
+            break;
+        }
+        case N_OP_RETURN:
+            n_decode_op_return(stream, instr->u8s);
+            break;
+        case N_OP_GLOBAL_REF: {
+            uint16_t source;
+            n_decode_op_global_ref(stream, instr->u8s, &source);
+            instr->wide = source;
+            break;
+        }
+        case N_OP_GLOBAL_SET: {
+            uint16_t dest;
+            n_decode_op_global_set(stream, &dest, instr->u8s);
+            instr->wide = dest;
+            break;
+        }
+        case N_OP_ADD:
+        case N_OP_SUB:
+        case N_OP_MUL:
+        case N_OP_LT:
+        case N_OP_LE:
+        case N_OP_EQ:
+            n_decode_op_arithmetic(stream, instr->u8s, instr->u8s+1,
+                                   instr->u8s+2);
+            break;
+        case N_OP_JUMP_IF_LT:
+        case N_OP_JUMP_IF_LE:
+        case N_OP_JUMP_IF_EQ: {
+            int16_t offset;
+            n_decode_op_compare_and_jump(stream, instr->u8s, instr->u8s+1,
+                                         &offset);
+            instr->wide = jump_target(pc, offset, code_size);
+            break;
+        }
+        case N_OP_JUMP_IF_FIXNUM_ZERO: {
+            int16_t offset;
+            n_decode_op_jump_if_fixnum_zero(stream, instr->u8s, &offset);
+            instr->wide = jump_target(pc, offset, code_size);
+            break;
+        }
+        default:
+            return;
+    }
+    instr->opcode = opcode;
+}
@@ -0,0 +1,77 @@
+#ifndef N_E_DECODED_STREAM_H
+#define N_E_DECODED_STREAM_H
+
+#include "../common/compatibility/stdint.h"
+#include "../common/errors.h"
+
+#include "primitives.h"
+
+typedef struct NDecodedInstruction NDecodedInstruction;
+typedef struct NDecodedStream NDecodedStream;
+typedef struct NCallSite NCallSite;
+typedef struct NCallCacheEntry NCallCacheEntry;
+
+/* A fixed-width, pre-decoded version of a single instruction. Operands are
+ * already widened and jump targets are absolute offsets into the code.
+ *
+ * The handler is owned by the evaluator, which fills it in with the address
+ * of the code that executes the instruction the first time it runs the
+ * stream. */
+struct NDecodedInstruction {
+    const void *handler;
+    uint8_t opcode;
+    uint8_t u8s[3];
+    int32_t wide;
+};
+
+
+/* The decoded form of a module's code. It holds one decoded instruction for
+ * each byte offset of the original code, so the same program counter can be
+ * used to index both of them. Offsets that do not start a valid instruction
+ * are decoded with opcode N_DECODED_INVALID, as is the extra instruction
+ * that follows the last one. */
+struct NDecodedStream {
+    NDecodedInstruction *instructions;
+    uint32_t size;
+    const void *linked_table;
+
+    NCallSite *call_sites;
+    uint32_t num_call_sites;
+};
+
+#define N_DECODED_INVALID 0xFF
+
+
+/* What the evaluator needs to know to call a given callee. The function is
+ * set for primitives and NULL for procedures, which use the other fields
+ * instead. */
+struct NCallCacheEntry {
+    NValue callee;
+    NPrimitiveFunc function;
+    uint32_t entry;
+    uint8_t num_locals;
+};
+
+#define N_CALL_CACHE_SIZE 4
+
+/* The inline cache of a single call instruction. Entries are added by the
+ * evaluator for each new callee seen at the site, and never replaced, so a
+ * site that sees more than N_CALL_CACHE_SIZE callees simply stops caching
+ * the new ones. */
+struct NCallSite {
+    uint32_t next_pc;
+    uint8_t num_entries;
+    NCallCacheEntry entries[N_CALL_CACHE_SIZE];
+};
+
+
+void
+ni_init_decoded_streams(NError* error);
+
+NDecodedStream*
+n_decode_stream(unsigned char *code, uint32_t code_size, NError *error);
+
+void
+n_destroy_decoded_stream(NDecodedStream* self);
+
+#endif /* N_E_DECODED_STREAM_H */
@@ -1,5 +1,6 @@
 #include "../common/common.h"
 #include "../common/errors.h"
+#include "../common/threads.h"
 
 #include "eval.h"
 
@@ -8,12 +9,33 @@
 #include "singletons.h"
 #include "primitives.h"
 #include "procedures.h"
+#include "arithmetic.h"
 #include "modules.h"
+#include "heap.h"
+#include "isolate.h"
+#include "decoded-stream.h"
+#include "fusion.h"
+#include "jit.h"
 #include "loader.h"
 #include "evaluator.h"
+#include "scheduler.h"
+#include "worker-pool.h"
+
+static
+NOnce EVAL_ONCE = N_ONCE_INIT;
+
+static void
+init_eval(NError* error);
+
 
 void
 n_init_eval(NError* error) {
+    n_call_once(&EVAL_ONCE, init_eval, error);
+}
+
+
+static void
+init_eval(NError* error) {
 #define EC ON_ERROR(error, return)
     n_init_common(error);                                            EC;
 
@@ -22,8 +44,16 @@ n_init_eval(NError* error) {
     ni_init_singletons(error);                                       EC;
     ni_init_primitives(error);                                       EC;
     ni_init_procedures(error);                                       EC;
+    ni_init_arithmetic(error);                                       EC;
     ni_init_modules(error);                                          EC;
+    ni_init_heap(error);                                             EC;
+    ni_init_isolates(error);                                         EC;
+    ni_init_decoded_streams(error);                                  EC;
+    ni_init_fusion(error);                                           EC;
+    ni_init_jit(error);                                              EC;
     ni_init_loader(error);                                           EC;
     ni_init_evaluator(error);                                        EC;
+    ni_init_scheduler(error);                                        EC;
+    ni_init_worker_pool(error);                                      EC;
 #undef EC
 }
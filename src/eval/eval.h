@@ -3,6 +3,10 @@
 
 #include "../common/errors.h"
 
+/* Initializes the evaluator and everything it depends on, once, see
+ * n_init_common. Threads that don't call it themselves must be started
+ * after it returned. Types and error types can then be looked up from any
+ * thread without locking. */
 void
 n_init_eval(NError* error);
 
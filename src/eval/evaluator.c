@@ -1,14 +1,44 @@
+#include <string.h>
+
 #include "values.h"
 #include "primitives.h"
 #include "procedures.h"
 #include "singletons.h"
 #include "evaluator.h"
+#include "fusion.h"
+#include "arithmetic.h"
+#include "jit.h"
+#include "heap.h"
+#include "isolate.h"
+#include "loader.h"
 
 
 #include "../common/common.h"
 #include "../common/opcodes.h"
 #include "../common/instruction-decoders.h"
 
+/* Dispatch strategy used by n_evaluator_run. It can be forced at build time
+ * by defining one of N_DISPATCH_STEP (call n_evaluator_step once per
+ * instruction), N_DISPATCH_SWITCH (a single loop around a switch) or
+ * N_DISPATCH_THREADED (a single loop using computed gotos, GCC and Clang
+ * only). When none is defined, the fastest one available is picked. */
+#if !defined(N_DISPATCH_STEP) && !defined(N_DISPATCH_SWITCH) \
+ && !defined(N_DISPATCH_THREADED)
+#  if defined(__GNUC__)
+#    define N_DISPATCH_THREADED
+#  else
+#    define N_DISPATCH_SWITCH
+#  endif
+#endif
+
+
+/* Unbounded runs refill their fuel with this much whenever it runs out. */
+#define N_UNBOUNDED_FUEL ((uint32_t) -1)
+
+/* Register operands are bytes, so the top frame may address this many
+ * locals whatever its procedure declares. The stack is always kept that
+ * much larger than the frames on it. */
+#define N_FRAME_REGISTERS 256
 
 static
 NErrorType INDEX_OO_BOUNDS =  { "nuvm.IndexOutOfBounds" };
@@ -16,9 +46,18 @@ NErrorType INDEX_OO_BOUNDS =  { "nuvm.IndexOutOfBounds" };
 static
 NErrorType UNKNOWN_OPCODE  =  { "nuvm.UnknownOpcode" };
 
+static
+NErrorType STACK_OVERFLOW  =  { "nuvm.StackOverflow" };
+
 static
 NErrorType *ILLEGAL_ARGUMENT = NULL;
 
+static
+NErrorType *BAD_ALLOCATION = NULL;
+
+static int
+reserve_stack(NEvaluator *self, int size, NError *error);
+
 static NValue
 get_local(NEvaluator *self, uint8_t index);
 
@@ -34,26 +73,87 @@ op_load_i16(NEvaluator *self, unsigned char *stream, NError *error);
 static int
 op_call(NEvaluator *self, unsigned char *stream, NError *error);
 
+static int
+op_tail_call(NEvaluator *self, unsigned char *stream, NError *error);
+
 static int
 op_return(NEvaluator *self, unsigned char *stream, NError *error);
 
+static int
+op_arithmetic(NEvaluator *self, unsigned char *stream, NError *error);
+
+static int
+op_compare_and_jump(NEvaluator *self, unsigned char *stream, NError *error);
+
+static int
+op_jump_if_fixnum_zero(NEvaluator *self, unsigned char *stream);
+
+static NOpcode
+jump_comparison(uint8_t opcode);
+
+static int
+pop_frame(NEvaluator *self, NValue return_value);
+
 static int
 op_global_ref(NEvaluator *self, unsigned char *stream, NError *error);
 
 static int
 op_global_set(NEvaluator *self, unsigned char *stream, NError *error);
 
+#ifdef N_DISPATCH_STEP
+static int
+spends_fuel(uint8_t opcode, int from, int to);
+#else
+static uint32_t
+run_loop(NEvaluator *self, uint32_t fuel, int bounded, NError *error);
+#endif
+
 void
 ni_init_evaluator(NError* error) {
 #define EC ON_ERROR(error, return)
 	n_register_error_type(&INDEX_OO_BOUNDS, error);                  EC;
 	n_register_error_type(&UNKNOWN_OPCODE, error);                   EC;
+	n_register_error_type(&STACK_OVERFLOW, error);                   EC;
 
 	ILLEGAL_ARGUMENT = n_error_type("nuvm.IllegalArgument", error);  EC;
+	BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);      EC;
 #undef EC
 }
 
 
+/* The stack is only allocated when the evaluator is first prepared. */
+void
+n_construct_evaluator(NEvaluator* self) {
+    self->current_module = NULL;
+    self->globals = NULL;
+    self->own_globals = NULL;
+    self->pc = -1;
+    self->sp = 0;
+    self->fp = 0;
+    self->halted = 1;
+
+    self->stack = NULL;
+    self->stack_size = 0;
+    memset(self->arguments, 0, sizeof(self->arguments));
+
+    self->isolate = NULL;
+    self->next_evaluator = NULL;
+}
+
+
+void
+n_destruct_evaluator(NEvaluator* self) {
+    if (self->isolate != NULL) {
+        ni_isolate_detach_evaluator(self->isolate, self);
+    }
+    free(self->own_globals);
+    self->own_globals = NULL;
+    free(self->stack);
+    self->stack = NULL;
+    self->stack_size = 0;
+}
+
+
 void n_evaluator_step(NEvaluator *self, NError *error) {
     unsigned char *stream = self->current_module->code + self->pc;
 
@@ -83,6 +183,11 @@ void n_evaluator_step(NEvaluator *self, NError *error) {
              * current pc, jumping to the entry point of a user procedure. */
             self->pc = op_call(self, stream, error);
             break;
+        case N_OP_TAIL_CALL:
+            /* Note the assignment to pc here. Refer to the CALL instruction
+             * for a rationale. */
+            self->pc = op_tail_call(self, stream, error);
+            break;
         case N_OP_RETURN:
             /* Note the assignment to pc here. Refer to the CALL instruction
              * for a rationale. */
@@ -94,6 +199,22 @@ void n_evaluator_step(NEvaluator *self, NError *error) {
         case N_OP_GLOBAL_SET:
             self->pc += op_global_set(self, stream, error);
             break;
+        case N_OP_ADD:
+        case N_OP_SUB:
+        case N_OP_MUL:
+        case N_OP_LT:
+        case N_OP_LE:
+        case N_OP_EQ:
+            self->pc += op_arithmetic(self, stream, error);
+            break;
+        case N_OP_JUMP_IF_LT:
+        case N_OP_JUMP_IF_LE:
+        case N_OP_JUMP_IF_EQ:
+            self->pc += op_compare_and_jump(self, stream, error);
+            break;
+        case N_OP_JUMP_IF_FIXNUM_ZERO:
+            self->pc += op_jump_if_fixnum_zero(self, stream);
+            break;
         default: {
             self->halted = 1;
             n_set_error(error, &UNKNOWN_OPCODE, "Found an unknown opcode.");
@@ -104,19 +225,61 @@ void n_evaluator_step(NEvaluator *self, NError *error) {
 
 
 void n_evaluator_run(NEvaluator *self, NError *error) {
+#ifdef N_DISPATCH_STEP
     while (! self->halted ) {
         n_evaluator_step(self, error);
         if (!n_is_ok(error)) {
+            if (n_is_blocked(error)) {
+                break;
+            }
             self->halted = 1;
         }
     }
+#else
+    if (!self->halted) {
+        run_loop(self, N_UNBOUNDED_FUEL, 0, error);
+    }
+#endif
+}
+
+
+uint32_t
+n_evaluator_run_for(NEvaluator *self, uint32_t max_fuel, NError *error) {
+#ifdef N_DISPATCH_STEP
+    uint32_t fuel = max_fuel;
+    while (!self->halted && fuel > 0) {
+        int pc = self->pc;
+        uint8_t opcode = self->current_module->code[pc];
+        n_evaluator_step(self, error);
+        if (!n_is_ok(error)) {
+            if (n_is_blocked(error)) {
+                break;
+            }
+            self->halted = 1;
+        }
+        else if (spends_fuel(opcode, pc, self->pc)) {
+            fuel--;
+        }
+    }
+    return fuel;
+#else
+    if (self->halted || max_fuel == 0) {
+        return max_fuel;
+    }
+    return run_loop(self, max_fuel, 1, error);
+#endif
 }
 
 
 NValue
 n_evaluator_get_global(NEvaluator *self, int index, NError *error) {
     if (index < self->current_module->num_globals) {
-        return self->current_module->globals[index];
+        NValue global = self->globals[index];
+        if (n_is_lazy_global(global)) {
+            global = ni_materialize_global(self->current_module,
+                                           (uint16_t) index, error);
+        }
+        return global;
     }
     else {
         n_set_error(error, &INDEX_OO_BOUNDS, "The given index is larger "
@@ -146,6 +309,12 @@ n_prepare_evaluator(NEvaluator *self, NModule *module, NError *error) {
     NProcedure* entry_proc;
 
     entry_val = module->globals[module->entry_point];
+    if (n_is_lazy_global(entry_val)) {
+        entry_val = ni_materialize_global(module, module->entry_point, error);
+        if (!n_is_ok(error)) {
+            return;
+        }
+    }
 
     if (!n_is_procedure(entry_val)) {
         n_set_error(error, ILLEGAL_ARGUMENT, "Value on the entry point of "
@@ -155,7 +324,27 @@ n_prepare_evaluator(NEvaluator *self, NModule *module, NError *error) {
 
     entry_proc = (NProcedure*) n_unwrap_object(entry_val);
 
+    if (!reserve_stack(self, 3 + entry_proc->num_locals, error)) {
+        return;
+    }
+
     self->current_module = module;
+    free(self->own_globals);
+    self->own_globals = NULL;
+    self->globals = module->globals;
+
+    /* Values left on the stack and in the arguments may belong to the heap
+     * of another isolate, which the new one must not trace. */
+    if (self->isolate != module->isolate) {
+        memset(self->stack, 0, sizeof(NValue) * self->stack_size);
+        memset(self->arguments, 0, sizeof(self->arguments));
+        if (self->isolate != NULL) {
+            ni_isolate_detach_evaluator(self->isolate, self);
+        }
+        if (module->isolate != NULL) {
+            ni_isolate_attach_evaluator(module->isolate, self);
+        }
+    }
 
     self->pc = entry_proc->entry;
 
@@ -172,17 +361,124 @@ n_prepare_evaluator(NEvaluator *self, NModule *module, NError *error) {
     self->halted = 0;
 }
 
-#ifdef N_TEST
 void
-nt_construct_evaluator(NEvaluator* self) {
-    self->pc = -1;
-    self->stack_size = N_STACK_SIZE;
-    self->halted = 1;
+n_evaluator_own_globals(NEvaluator *self, NError *error) {
+    NModule *module = self->current_module;
+    NValue *copy;
+    if (self->own_globals != NULL) {
+        return;
+    }
+    /* A copy must not hold lazy globals, they are only ever created in
+     * the module. */
+    ni_materialize_globals(module, error);
+    if (!n_is_ok(error)) {
+        return;
+    }
 
-    self->sp = 0;
-    self->fp = 0;
+    copy = malloc(sizeof(NValue) * (module->num_globals > 0
+                                    ? module->num_globals : 1));
+    if (copy == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate the globals "
+                    "of an evaluator.");
+        return;
+    }
+    memcpy(copy, module->globals, sizeof(NValue) * module->num_globals);
+    self->own_globals = copy;
+    self->globals = copy;
 }
-#endif /* N_TEST */
+
+
+/* Only the locals of each frame hold values, the three slots before them
+ * hold the saved frame pointer, return register and return address. The
+ * unused part of the stack is cleared, so that frames pushed later never
+ * find values of objects freed or moved by this collection in their
+ * locals. The arguments are traced because a primitive that allocates
+ * still reads them afterwards. */
+void
+ni_trace_evaluator(NEvaluator *self, NHeap *heap) {
+    int fp = self->fp;
+    int end = self->sp;
+    int i;
+    for (i = 0; i < N_ARGUMENTS_SIZE; i++) {
+        n_trace_value(heap, &self->arguments[i]);
+    }
+    if (self->stack == NULL) {
+        return;
+    }
+
+    while (fp >= 0) {
+        for (i = fp + 3; i < end; i++) {
+            n_trace_value(heap, &self->stack[i]);
+        }
+        end = fp;
+        fp = self->stack[fp];
+    }
+    memset(self->stack + self->sp, 0,
+           sizeof(NValue) * (self->stack_size - self->sp));
+
+    if (self->own_globals != NULL) {
+        for (i = 0; i < self->current_module->num_globals; i++) {
+            n_trace_value(heap, &self->own_globals[i]);
+        }
+    }
+}
+
+
+/* Runs nothing, but leaves the decoded stream linked to the run loop, and
+ * every global created, since the module may be frozen and shared next. */
+void
+n_evaluator_prepare_code(NEvaluator *self, NError *error) {
+    ni_materialize_globals(self->current_module, error);
+    if (!n_is_ok(error)) {
+        return;
+    }
+#ifndef N_DISPATCH_STEP
+    run_loop(self, 0, 1, error);
+#endif
+}
+
+
+/* Makes sure the stack can hold the given number of values, and the
+ * registers of the top frame past them, growing it if needed. Returns
+ * false, with the error set, if it can't. Any pointer into the stack is
+ * invalidated when it grows. */
+static int
+reserve_stack(NEvaluator *self, int size, NError *error) {
+    NValue *new_stack;
+    int new_size;
+
+    size += N_FRAME_REGISTERS;
+    if (size <= self->stack_size) {
+        return 1;
+    }
+    if (size > N_STACK_MAX_SIZE) {
+        n_set_error(error, &STACK_OVERFLOW, "The evaluator ran out of "
+                    "stack space.");
+        return 0;
+    }
+
+    new_size = self->stack_size > 0 ? self->stack_size : N_STACK_INITIAL_SIZE;
+    while (new_size < size) {
+        new_size *= 2;
+    }
+    if (new_size > N_STACK_MAX_SIZE) {
+        new_size = N_STACK_MAX_SIZE;
+    }
+
+    new_stack = realloc(self->stack, sizeof(NValue) * new_size);
+    if (new_stack == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to grow evaluator "
+                    "stack.");
+        return 0;
+    }
+    /* The collector expects every value on the stack to be valid. */
+    memset(new_stack + self->stack_size, 0,
+           sizeof(NValue) * (new_size - self->stack_size));
+    self->stack = new_stack;
+    self->stack_size = new_size;
+    return 1;
+}
+
 
 static NValue*
 get_locals_addr(NEvaluator *self) {
@@ -213,6 +509,11 @@ op_call(NEvaluator *self, unsigned char *stream, NError *error) {
     NValue result;
 
     if (n_is_primitive(callable)) {
+        if (n_args > N_ARGUMENTS_SIZE) {
+            n_set_error(error, ILLEGAL_ARGUMENT, "Too many arguments on "
+                        "call instruction to a primitive.");
+            return self->pc;
+        }
         for (i = 0; i < n_args; i++) {
             uint8_t arg_index = stream[size + i];
             self->arguments[i] = get_local(self, arg_index);
@@ -220,7 +521,7 @@ op_call(NEvaluator *self, unsigned char *stream, NError *error) {
 
         result = n_call_primitive(callable, n_args, self->arguments, error);
         if (!n_is_ok(error)) {
-            return 0;
+            return self->pc;
         }
 
         set_local(self, dest, result);
@@ -230,7 +531,13 @@ op_call(NEvaluator *self, unsigned char *stream, NError *error) {
         /* Set up the new frame and jump to the procedure's entry point. */
         NProcedure* proc = (NProcedure*) n_unwrap_object(callable);
         int previous_fp = self->fp;
-        NValue* old_locals = get_locals_addr(self);
+        NValue* old_locals;
+
+        if (!reserve_stack(self, self->sp + 3 + proc->num_locals + n_args,
+                           error)) {
+            return self->pc;
+        }
+        old_locals = get_locals_addr(self);
         self->fp = self->sp;
         self->stack[self->fp] = previous_fp;
         self->stack[self->fp +1] = dest;
@@ -252,6 +559,58 @@ op_call(NEvaluator *self, unsigned char *stream, NError *error) {
 }
 
 
+/* Calls the target in place of the current procedure. A procedure gets the
+ * current frame, which keeps the caller's saved frame pointer, return
+ * register and return address: the frame is always on top of the stack, so
+ * it is simply resized to fit the callee. A primitive is called as usual
+ * and its result is returned from the current frame. The arguments are
+ * copied out of the frame before it is overwritten. */
+static int
+op_tail_call(NEvaluator *self, unsigned char *stream, NError *error) {
+    int i;
+    uint8_t target, n_args;
+    int size = n_decode_op_tail_call(stream, &target, &n_args);
+    NValue callable = get_local(self, target);
+
+    if (n_args > N_ARGUMENTS_SIZE) {
+        n_set_error(error, ILLEGAL_ARGUMENT, "Too many arguments on "
+                    "tail-call instruction.");
+        return self->pc;
+    }
+
+    for (i = 0; i < n_args; i++) {
+        uint8_t arg_index = stream[size + i];
+        self->arguments[i] = get_local(self, arg_index);
+    }
+
+    if (n_is_primitive(callable)) {
+        NValue result =
+            n_call_primitive(callable, n_args, self->arguments, error);
+        if (!n_is_ok(error)) {
+            return self->pc;
+        }
+        return pop_frame(self, result);
+    }
+    else if (n_is_procedure(callable)) {
+        NProcedure* proc = (NProcedure*) n_unwrap_object(callable);
+        if (!reserve_stack(self, self->fp + 3 + proc->num_locals + n_args,
+                           error)) {
+            return self->pc;
+        }
+        self->sp = self->fp + 3 + proc->num_locals + n_args;
+        for (i = 0; i < n_args; i++) {
+            set_local(self, proc->num_locals + i, self->arguments[i]);
+        }
+        return proc->entry;
+    }
+    else {
+        n_set_error(error, ILLEGAL_ARGUMENT, "Target to tail-call "
+                    "instruction must be a callable object.");
+        return self->pc;
+    }
+}
+
+
 static int
 op_jump_unless(NEvaluator *self, unsigned char *stream, NError *error) {
     uint8_t r_condition;
@@ -275,6 +634,16 @@ op_jump_unless(NEvaluator *self, unsigned char *stream, NError *error) {
 
 static int
 op_return(NEvaluator *self, unsigned char *stream, NError *error) {
+    uint8_t src;
+    n_decode_op_return(stream, &src);
+    return pop_frame(self, get_local(self, src));
+}
+
+
+/* Leaves the current frame, storing the value in the caller's return
+ * register, and returns the address to resume at. */
+static int
+pop_frame(NEvaluator *self, NValue return_value) {
     if (self->stack[self->fp] == -1) {
         /* We're on a dummy frame. Halt the machine. */
         self->halted = 1;
@@ -284,12 +653,6 @@ op_return(NEvaluator *self, unsigned char *stream, NError *error) {
         int stored_pc = self->stack[self->fp +2];
         int dest      = self->stack[self->fp +1];
         int stored_fp = self->stack[self->fp];
-        uint8_t src;
-        NValue return_value;
-
-        n_decode_op_return(stream, &src);
-
-        return_value = get_local(self, src);
 
         self->sp = self->fp;
         self->fp = stored_fp;
@@ -297,7 +660,6 @@ op_return(NEvaluator *self, unsigned char *stream, NError *error) {
 
         return stored_pc;
     }
-
 }
 
 
@@ -306,8 +668,15 @@ op_global_ref(NEvaluator *self, unsigned char *stream, NError *error) {
     uint8_t dest;
     uint16_t source;
     int size = n_decode_op_global_ref(stream, &dest, &source);
+    NValue global = self->globals[source];
 
-    set_local(self, dest, self->current_module->globals[source]);
+    if (n_is_lazy_global(global)) {
+        global = ni_materialize_global(self->current_module, source, error);
+        if (!n_is_ok(error)) {
+            return 0;
+        }
+    }
+    set_local(self, dest, global);
     return size;
 }
 
@@ -318,11 +687,93 @@ op_global_set(NEvaluator *self, unsigned char *stream, NError *error) {
     uint8_t source;
     int size = n_decode_op_global_set(stream, &dest, &source);
 
-    self->current_module->globals[dest] = get_local(self, source);
+    self->globals[dest] = get_local(self, source);
+    return size;
+}
+
+
+/* Stepping always takes the slow path. The run loop has the fast path for
+ * fixnums. */
+static int
+op_arithmetic(NEvaluator *self, unsigned char *stream, NError *error) {
+    uint8_t dest, left, right;
+    int size = n_decode_op_arithmetic(stream, &dest, &left, &right);
+    NValue result = n_arithmetic((NOpcode) stream[0], get_local(self, left),
+                                 get_local(self, right), error);
+    if (!n_is_ok(error)) {
+        return 0;
+    }
+
+    set_local(self, dest, result);
+    return size;
+}
+
+
+/* Compares like the matching comparison opcode, but jumps when it holds
+ * instead of storing a Boolean. */
+static int
+op_compare_and_jump(NEvaluator *self, unsigned char *stream, NError *error) {
+    uint8_t left, right;
+    int16_t offset;
+    int size = n_decode_op_compare_and_jump(stream, &left, &right, &offset);
+    NValue result = n_arithmetic(jump_comparison(stream[0]),
+                                 get_local(self, left),
+                                 get_local(self, right), error);
+    if (!n_is_ok(error)) {
+        return 0;
+    }
+
+    return n_eq_values(result, N_TRUE) ? offset : size;
+}
+
+
+/* Any value other than the fixnum zero, fixnum or not, falls through. */
+static int
+op_jump_if_fixnum_zero(NEvaluator *self, unsigned char *stream) {
+    uint8_t r_condition;
+    int16_t offset;
+    int size = n_decode_op_jump_if_fixnum_zero(stream, &r_condition, &offset);
+
+    if (n_eq_values(get_local(self, r_condition), N_FIXNUM_ZERO)) {
+        return offset;
+    }
     return size;
 }
 
 
+#ifdef N_DISPATCH_STEP
+/* Whether a step from the given pc to the other one spends fuel, the same
+ * way the run loop does. */
+static int
+spends_fuel(uint8_t opcode, int from, int to) {
+    switch (opcode) {
+        case N_OP_CALL:
+        case N_OP_TAIL_CALL:
+            return 1;
+        case N_OP_JUMP:
+        case N_OP_JUMP_UNLESS:
+        case N_OP_JUMP_IF_LT:
+        case N_OP_JUMP_IF_LE:
+        case N_OP_JUMP_IF_EQ:
+        case N_OP_JUMP_IF_FIXNUM_ZERO:
+            return to <= from;
+        default:
+            return 0;
+    }
+}
+#endif /* N_DISPATCH_STEP */
+
+
+static NOpcode
+jump_comparison(uint8_t opcode) {
+    switch (opcode) {
+        case N_OP_JUMP_IF_LT: return N_OP_LT;
+        case N_OP_JUMP_IF_LE: return N_OP_LE;
+        default:              return N_OP_EQ;
+    }
+}
+
+
 static int
 op_load_i16(NEvaluator *self, unsigned char *stream, NError *error) {
     uint8_t dest;
@@ -332,3 +783,699 @@ op_load_i16(NEvaluator *self, unsigned char *stream, NError *error) {
     set_local(self, dest, n_wrap_fixnum(value));
     return size;
 }
+
+
+#ifndef N_DISPATCH_STEP
+/* The main interpreter loop. It does the same work as calling
+ * n_evaluator_step until the machine halts, but runs over the decoded form
+ * of the module's code, keeps the registers of the evaluator in locals and
+ * only writes them back when leaving the loop. The handlers below must be
+ * kept in sync with the op_* functions used by n_evaluator_step.
+ *
+ * Fuel is only counted on calls and backward jumps, so straight-line code
+ * pays nothing for it. A bounded loop leaves without halting when its fuel
+ * runs out, an unbounded one refills it and goes on. Both leave without
+ * halting when a primitive blocks.
+ *
+ * Fused opcodes run the body of their first instruction and then go
+ * straight to the handler of the next one, without a dispatch in between.
+ * FOLLOWED marks the handlers they may go to. */
+
+#ifdef N_PROFILE_DISPATCH
+#define PROFILE_DISPATCH() \
+    ni_record_dispatch(n_global_dispatch_profile(), prev2, prev1, ip); \
+    prev2 = prev1; \
+    prev1 = ip;
+#else
+#define PROFILE_DISPATCH()
+#endif /* N_PROFILE_DISPATCH */
+
+#ifdef N_DISPATCH_THREADED
+#define LABEL_ADDR(L)    (__extension__ &&L)
+#define GOTO_ADDR(A)     __extension__ ({ goto *(A); })
+
+#define BEGIN_DISPATCH() DISPATCH();
+#define END_DISPATCH()
+#define OPCODE(OP)       L_##OP:
+#define OPCODE_UNKNOWN() L_UNKNOWN:
+#define FOLLOWED(OP)
+#define DISPATCH()       { PROFILE_DISPATCH() GOTO_ADDR(ip->handler); }
+#else
+#define BEGIN_DISPATCH() dispatch: PROFILE_DISPATCH() switch (ip->opcode) {
+#define END_DISPATCH()   }
+#define OPCODE(OP)       case OP:
+#define OPCODE_UNKNOWN() default:
+#define FOLLOWED(OP)     L_##OP:
+#define DISPATCH()       goto dispatch
+#endif /* N_DISPATCH_THREADED */
+
+#define FOLLOW(OP)       goto L_##OP
+
+#define OUT_OF_FUEL() \
+    if (bounded) { \
+        goto suspend; \
+    } \
+    fuel = N_UNBOUNDED_FUEL;
+
+/* Primitives may allocate, and so run a collection, which walks the stack
+ * from the saved frame. */
+#define SAVE_FRAME() \
+    self->fp = fp; \
+    self->sp = sp;
+
+/* Leaves the loop at the instruction that called a primitive which failed,
+ * without halting when it is only blocked. */
+#define PRIMITIVE_FAILED() \
+    if (n_is_blocked(error)) { \
+        goto suspend; \
+    } \
+    goto fail;
+
+#define SPEND_FUEL() \
+    if (--fuel == 0) { \
+        OUT_OF_FUEL(); \
+    }
+
+/* Jumps to the instruction at the given pc, spending fuel when it is not
+ * ahead of the jump. */
+#define JUMP_TO(PC) { \
+    NDecodedInstruction *from = ip; \
+    ip = base + (PC); \
+    if (ip <= from) { \
+        SPEND_FUEL(); \
+    } \
+}
+
+#define DO_LOAD_I16() \
+    locals[ip->u8s[0]] = n_wrap_fixnum(ip->wide); \
+    ip += 4;
+
+/* Lazy globals are created on their first read, which may allocate. */
+#define DO_GLOBAL_REF() { \
+    NValue global = globals[ip->wide]; \
+    if (n_is_lazy_global(global)) { \
+        SAVE_FRAME(); \
+        global = ni_materialize_global(module, ip->wide, error); \
+        if (!n_is_ok(error)) { \
+            goto fail; \
+        } \
+    } \
+    locals[ip->u8s[0]] = global; \
+    ip += 4; \
+}
+
+#define DO_GLOBAL_SET() \
+    globals[ip->wide] = locals[ip->u8s[0]]; \
+    ip += 4;
+
+/* Arithmetic and comparisons work on the tagged values directly when both
+ * are fixnums. A fixnum is its value shifted one bit to the left, so sums,
+ * differences and order are kept. Anything else, including results that
+ * do not fit in a fixnum, takes the slow path. */
+#define DO_ARITHMETIC(OPCODE, EXPR) { \
+    NValue left = locals[ip->u8s[1]]; \
+    NValue right = locals[ip->u8s[2]]; \
+    if (n_both_fixnums(left, right)) { \
+        NValue result = (EXPR); \
+        if ((result >> 1) >= N_FIXNUM_MIN && (result >> 1) <= N_FIXNUM_MAX) { \
+            locals[ip->u8s[0]] = result; \
+            ip += 4; \
+            DISPATCH(); \
+        } \
+    } \
+    DO_SLOW_ARITHMETIC(OPCODE, left, right); \
+}
+
+/* Products are taken of the untagged values, which always fit in 64 bits,
+ * and checked before they are tagged again. */
+#define DO_MULTIPLICATION() { \
+    NValue left = locals[ip->u8s[1]]; \
+    NValue right = locals[ip->u8s[2]]; \
+    if (n_both_fixnums(left, right)) { \
+        int64_t product = (int64_t) (left >> 1) * (right >> 1); \
+        if (product >= N_FIXNUM_MIN && product <= N_FIXNUM_MAX) { \
+            locals[ip->u8s[0]] = (NValue) product * 2; \
+            ip += 4; \
+            DISPATCH(); \
+        } \
+    } \
+    DO_SLOW_ARITHMETIC(N_OP_MUL, left, right); \
+}
+
+#define DO_COMPARISON(OPCODE, EXPR) { \
+    NValue left = locals[ip->u8s[1]]; \
+    NValue right = locals[ip->u8s[2]]; \
+    if (n_both_fixnums(left, right)) { \
+        locals[ip->u8s[0]] = n_wrap_boolean(EXPR); \
+        ip += 4; \
+        DISPATCH(); \
+    } \
+    DO_SLOW_ARITHMETIC(OPCODE, left, right); \
+}
+
+/* Jumps when the comparison holds. Like the comparisons, it only leaves the
+ * tagged values when they are not both fixnums. */
+#define DO_COMPARE_AND_JUMP(COMPARISON, EXPR) { \
+    NValue left = locals[ip->u8s[0]]; \
+    NValue right = locals[ip->u8s[1]]; \
+    int taken; \
+    if (n_both_fixnums(left, right)) { \
+        taken = (EXPR); \
+    } \
+    else { \
+        NValue result = n_arithmetic(COMPARISON, left, right, error); \
+        if (!n_is_ok(error)) { \
+            goto fail; \
+        } \
+        taken = n_eq_values(result, N_TRUE); \
+    } \
+    if (taken) { \
+        JUMP_TO(ip->wide); \
+    } \
+    else { \
+        ip += 5; \
+    } \
+    DISPATCH(); \
+}
+
+#define DO_SLOW_ARITHMETIC(OPCODE, LEFT, RIGHT) { \
+    NValue result = n_arithmetic(OPCODE, LEFT, RIGHT, error); \
+    if (!n_is_ok(error)) { \
+        goto fail; \
+    } \
+    locals[ip->u8s[0]] = result; \
+    ip += 4; \
+    DISPATCH(); \
+}
+
+/* Grows the stack when it can't hold SIZE values and the registers past
+ * them. The only check on the common path is the comparison. */
+#define RESERVE_STACK(SIZE) \
+    if ((SIZE) + N_FRAME_REGISTERS > self->stack_size) { \
+        if (!reserve_stack(self, (SIZE), error)) { \
+            goto fail; \
+        } \
+        stack = self->stack; \
+        locals = stack + fp + 3; \
+    }
+
+/* Returns from the current frame, halting on the dummy one. */
+#define DO_RETURN(VALUE) { \
+    NValue return_value = (VALUE); \
+    int dest; \
+    if (stack[fp] == -1) { \
+        goto halt; \
+    } \
+    dest = stack[fp +1]; \
+    ip = base + stack[fp +2]; \
+    sp = fp; \
+    fp = stack[fp]; \
+    locals = stack + fp + 3; \
+    locals[dest] = return_value; \
+    ENTER_JIT(); \
+}
+
+#ifdef N_JIT_ENABLED
+/* Goes on in native code when there is some for the instruction at ip.
+ * Native code is entered where control flow lands: procedure entries, the
+ * instructions that follow calls, and jump targets. It spends fuel on its
+ * backward jumps from a copy of the counter, so that the counter itself can
+ * stay in a register. */
+#define ENTER_JIT() \
+    if (jit != NULL && jit->entries[ip - base] != NULL) { \
+        uint32_t native_fuel = fuel; \
+        ip = base + n_run_native_code(jit, ip - base, locals, globals, \
+                                      &native_fuel); \
+        fuel = native_fuel; \
+        if (fuel == 0) { \
+            OUT_OF_FUEL(); \
+        } \
+    }
+
+/* Compiles the procedure in the given call cache entry when it gets hot.
+ * Frozen modules are left as they are. */
+#define COUNT_CALL(TARGET) { \
+    NProcedure *proc = (NProcedure*) n_unwrap_object((TARGET)->callee); \
+    if (!frozen && ++proc->call_count == jit_threshold) { \
+        n_jit_compile(module, proc, error); \
+        if (!n_is_ok(error)) { \
+            goto fail; \
+        } \
+        jit = module->code_cache; \
+    } \
+}
+#else
+#define ENTER_JIT()
+#define COUNT_CALL(TARGET)
+#endif /* N_JIT_ENABLED */
+
+#ifdef N_DISPATCH_THREADED
+/* Index of the handler for the given opcode in the dispatch table. */
+static int
+handler_index(uint8_t opcode) {
+    if (opcode < N_NUM_OPCODES) {
+        return opcode;
+    }
+    else if (opcode >= N_FIRST_FUSED_OPCODE
+             && opcode < N_FIRST_FUSED_OPCODE + N_NUM_FUSED_OPCODES) {
+        return N_NUM_OPCODES + opcode - N_FIRST_FUSED_OPCODE;
+    }
+    return N_NUM_OPCODES + N_NUM_FUSED_OPCODES;
+}
+
+
+static void
+link_stream(NDecodedStream *stream, const void* const *table) {
+    uint32_t i;
+    for (i = 0; i <= stream->size; i++) {
+        NDecodedInstruction *instr = stream->instructions + i;
+        instr->handler = table[handler_index(instr->opcode)];
+    }
+    stream->linked_table = table;
+}
+#endif /* N_DISPATCH_THREADED */
+
+
+/* Looks the callable up in the inline cache of the call site, adding it to
+ * the cache on a miss. The type checks on the callable only happen on a
+ * miss. Once the cache is full, or when the module is frozen, the entry
+ * for a new callable is built in the given scratch entry instead. Returns
+ * NULL if the value is not callable. */
+static NCallCacheEntry*
+find_call_target(NCallSite *site, NValue callable, NCallCacheEntry *scratch,
+                 uint32_t code_size, int frozen) {
+    NCallCacheEntry *entry;
+    int i;
+    for (i = 0; i < site->num_entries; i++) {
+        if (n_eq_values(site->entries[i].callee, callable)) {
+            return site->entries + i;
+        }
+    }
+
+    entry = site->num_entries < N_CALL_CACHE_SIZE && !frozen
+          ? site->entries + site->num_entries
+          : scratch;
+
+    if (n_is_primitive(callable)) {
+        entry->function = ((NPrimitive*) n_unwrap_object(callable))->func;
+        entry->entry = 0;
+        entry->num_locals = 0;
+    }
+    else if (n_is_procedure(callable)) {
+        NProcedure* proc = (NProcedure*) n_unwrap_object(callable);
+        entry->function = NULL;
+        entry->entry = proc->entry < code_size ? proc->entry : code_size;
+        entry->num_locals = proc->num_locals;
+    }
+    else {
+        return NULL;
+    }
+    entry->callee = callable;
+
+    if (entry != scratch) {
+        site->num_entries++;
+    }
+    return entry;
+}
+
+
+static uint32_t
+run_loop(NEvaluator *self, uint32_t fuel, int bounded, NError *error) {
+#ifdef N_DISPATCH_THREADED
+    /* Must follow the numeric order of the opcodes in NOpcode and then in
+     * NFusedOpcode, with the handler for unknown opcodes as the last
+     * entry. */
+    static const void* const
+    DISPATCH_TABLE[N_NUM_OPCODES + N_NUM_FUSED_OPCODES + 1] = {
+        LABEL_ADDR(L_N_OP_NOP),
+        LABEL_ADDR(L_N_OP_HALT),
+        LABEL_ADDR(L_N_OP_LOAD_I16),
+        LABEL_ADDR(L_N_OP_JUMP_UNLESS),
+        LABEL_ADDR(L_N_OP_JUMP),
+        LABEL_ADDR(L_N_OP_CALL),
+        LABEL_ADDR(L_N_OP_RETURN),
+        LABEL_ADDR(L_N_OP_GLOBAL_REF),
+        LABEL_ADDR(L_N_OP_GLOBAL_SET),
+        LABEL_ADDR(L_N_OP_TAIL_CALL),
+        LABEL_ADDR(L_N_OP_ADD),
+        LABEL_ADDR(L_N_OP_SUB),
+        LABEL_ADDR(L_N_OP_MUL),
+        LABEL_ADDR(L_N_OP_LT),
+        LABEL_ADDR(L_N_OP_LE),
+        LABEL_ADDR(L_N_OP_EQ),
+        LABEL_ADDR(L_N_OP_JUMP_IF_LT),
+        LABEL_ADDR(L_N_OP_JUMP_IF_LE),
+        LABEL_ADDR(L_N_OP_JUMP_IF_EQ),
+        LABEL_ADDR(L_N_OP_JUMP_IF_FIXNUM_ZERO),
+        LABEL_ADDR(L_N_FUSED_GLOBAL_REF_GLOBAL_REF_CALL),
+        LABEL_ADDR(L_N_FUSED_LOAD_I16_GLOBAL_REF_CALL),
+        LABEL_ADDR(L_N_FUSED_GLOBAL_REF_LOAD_I16_CALL),
+        LABEL_ADDR(L_N_FUSED_GLOBAL_REF_CALL),
+        LABEL_ADDR(L_N_FUSED_LOAD_I16_CALL),
+        LABEL_ADDR(L_N_FUSED_LOAD_I16_JUMP_UNLESS),
+        LABEL_ADDR(L_N_FUSED_GLOBAL_REF_GLOBAL_REF),
+        LABEL_ADDR(L_N_FUSED_GLOBAL_SET_JUMP),
+        LABEL_ADDR(L_UNKNOWN)
+    };
+#endif
+    NModule *module = self->current_module;
+    NDecodedStream *stream;
+    NDecodedInstruction *base;
+    NDecodedInstruction *ip;
+    unsigned char *code = module->code;
+    NValue *globals = self->globals;
+    int frozen = module->frozen;
+    NValue *stack = self->stack;
+    int fp = self->fp;
+    int sp = self->sp;
+    NValue *locals = stack + fp + 3;
+    NCallCacheEntry uncached;
+#ifdef N_JIT_ENABLED
+    NCodeCache *jit;
+    uint32_t jit_threshold = n_get_jit_threshold();
+#endif
+#ifdef N_PROFILE_DISPATCH
+    NDecodedInstruction *prev1 = NULL;
+    NDecodedInstruction *prev2 = NULL;
+#endif
+
+    if (module->decoded == NULL) {
+        n_predecode_module(module, error);
+        if (!n_is_ok(error)) {
+            self->halted = 1;
+            return fuel;
+        }
+    }
+    stream = module->decoded;
+#ifdef N_DISPATCH_THREADED
+    if (stream->linked_table != DISPATCH_TABLE) {
+        link_stream(stream, DISPATCH_TABLE);
+    }
+#endif
+    if (fuel == 0) {
+        return 0;
+    }
+    base = stream->instructions;
+    ip = base + ((uint32_t) self->pc < stream->size ? (uint32_t) self->pc
+                                                    : stream->size);
+#ifdef N_JIT_ENABLED
+    jit = module->code_cache;
+#endif
+    ENTER_JIT();
+
+    BEGIN_DISPATCH()
+
+    OPCODE(N_OP_NOP) {
+        ip += 1;
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_HALT) {
+        goto halt;
+    }
+
+    OPCODE(N_OP_LOAD_I16) {
+        DO_LOAD_I16();
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_JUMP_UNLESS) FOLLOWED(N_OP_JUMP_UNLESS) {
+        NValue condition = locals[ip->u8s[0]];
+
+        if (n_eq_values(condition, N_TRUE)) {
+            JUMP_TO(ip->wide);
+        }
+        else if (n_eq_values(condition, N_FALSE)) {
+            ip += 4;
+        }
+        else {
+            n_set_error(error, ILLEGAL_ARGUMENT, "Condition to "
+                        "jump-unless must be a valid Boolean value.");
+            goto fail;
+        }
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_JUMP) FOLLOWED(N_OP_JUMP) {
+        JUMP_TO(ip->wide);
+        ENTER_JIT();
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_CALL) FOLLOWED(N_OP_CALL) {
+        int i;
+        uint8_t dest = ip->u8s[0];
+        uint8_t n_args = ip->u8s[2];
+        NCallSite *site = stream->call_sites + ip->wide;
+        unsigned char *args = code + site->next_pc - n_args;
+        NValue callable = locals[ip->u8s[1]];
+        NCallCacheEntry *target =
+            find_call_target(site, callable, &uncached, stream->size,
+                             frozen);
+
+        if (target == NULL) {
+            n_set_error(error, ILLEGAL_ARGUMENT, "Target to call "
+                        "instruction must be a callable object.");
+            goto fail;
+        }
+        else if (target->function != NULL) {
+            NValue result;
+            if (n_args > N_ARGUMENTS_SIZE) {
+                n_set_error(error, ILLEGAL_ARGUMENT, "Too many arguments on "
+                            "call instruction to a primitive.");
+                goto fail;
+            }
+            for (i = 0; i < n_args; i++) {
+                self->arguments[i] = locals[args[i]];
+            }
+
+            SAVE_FRAME();
+            result = target->function(n_args, self->arguments, error);
+            if (!n_is_ok(error)) {
+                PRIMITIVE_FAILED();
+            }
+
+            locals[dest] = result;
+            ip = base + site->next_pc;
+            SPEND_FUEL();
+            ENTER_JIT();
+        }
+        else {
+            NValue* old_locals;
+
+            RESERVE_STACK(sp + 3 + target->num_locals + n_args);
+            old_locals = locals;
+            stack[sp]    = fp;
+            stack[sp +1] = dest;
+            stack[sp +2] = site->next_pc;
+            fp = sp;
+            sp += 3 + target->num_locals + n_args;
+            locals = stack + fp + 3;
+            for (i = 0; i < n_args; i++) {
+                locals[target->num_locals + i] = old_locals[args[i]];
+            }
+            ip = base + target->entry;
+            COUNT_CALL(target);
+            SPEND_FUEL();
+            ENTER_JIT();
+        }
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_TAIL_CALL) {
+        int i;
+        uint8_t n_args = ip->u8s[2];
+        NCallSite *site = stream->call_sites + ip->wide;
+        unsigned char *args = code + site->next_pc - n_args;
+        NValue callable = locals[ip->u8s[1]];
+        NCallCacheEntry *target =
+            find_call_target(site, callable, &uncached, stream->size,
+                             frozen);
+
+        if (n_args > N_ARGUMENTS_SIZE) {
+            n_set_error(error, ILLEGAL_ARGUMENT, "Too many arguments on "
+                        "tail-call instruction.");
+            goto fail;
+        }
+        else if (target == NULL) {
+            n_set_error(error, ILLEGAL_ARGUMENT, "Target to tail-call "
+                        "instruction must be a callable object.");
+            goto fail;
+        }
+
+        for (i = 0; i < n_args; i++) {
+            self->arguments[i] = locals[args[i]];
+        }
+
+        if (target->function != NULL) {
+            NValue result;
+            SAVE_FRAME();
+            result = target->function(n_args, self->arguments, error);
+            if (!n_is_ok(error)) {
+                PRIMITIVE_FAILED();
+            }
+            DO_RETURN(result);
+            SPEND_FUEL();
+        }
+        else {
+            /* Reuse the current frame, keeping what it saved for the
+             * caller. */
+            RESERVE_STACK(fp + 3 + target->num_locals + n_args);
+            sp = fp + 3 + target->num_locals + n_args;
+            for (i = 0; i < n_args; i++) {
+                locals[target->num_locals + i] = self->arguments[i];
+            }
+            ip = base + target->entry;
+            COUNT_CALL(target);
+            SPEND_FUEL();
+            ENTER_JIT();
+        }
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_RETURN) {
+        DO_RETURN(locals[ip->u8s[0]]);
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_GLOBAL_REF) FOLLOWED(N_OP_GLOBAL_REF) {
+        DO_GLOBAL_REF();
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_GLOBAL_SET) {
+        DO_GLOBAL_SET();
+        DISPATCH();
+    }
+
+    OPCODE(N_OP_ADD) {
+        DO_ARITHMETIC(N_OP_ADD, left + right);
+    }
+
+    OPCODE(N_OP_SUB) {
+        DO_ARITHMETIC(N_OP_SUB, left - right);
+    }
+
+    OPCODE(N_OP_MUL) {
+        DO_MULTIPLICATION();
+    }
+
+    OPCODE(N_OP_LT) {
+        DO_COMPARISON(N_OP_LT, left < right);
+    }
+
+    OPCODE(N_OP_LE) {
+        DO_COMPARISON(N_OP_LE, left <= right);
+    }
+
+    OPCODE(N_OP_EQ) {
+        DO_COMPARISON(N_OP_EQ, left == right);
+    }
+
+    OPCODE(N_OP_JUMP_IF_LT) {
+        DO_COMPARE_AND_JUMP(N_OP_LT, left < right);
+    }
+
+    OPCODE(N_OP_JUMP_IF_LE) {
+        DO_COMPARE_AND_JUMP(N_OP_LE, left <= right);
+    }
+
+    OPCODE(N_OP_JUMP_IF_EQ) {
+        DO_COMPARE_AND_JUMP(N_OP_EQ, left == right);
+    }
+
+    OPCODE(N_OP_JUMP_IF_FIXNUM_ZERO) {
+        if (n_eq_values(locals[ip->u8s[0]], N_FIXNUM_ZERO)) {
+            JUMP_TO(ip->wide);
+        }
+        else {
+            ip += 4;
+        }
+        DISPATCH();
+    }
+
+    OPCODE(N_FUSED_GLOBAL_REF_GLOBAL_REF_CALL) {
+        DO_GLOBAL_REF();
+        FOLLOW(N_FUSED_GLOBAL_REF_CALL);
+    }
+
+    OPCODE(N_FUSED_LOAD_I16_GLOBAL_REF_CALL) {
+        DO_LOAD_I16();
+        FOLLOW(N_FUSED_GLOBAL_REF_CALL);
+    }
+
+    OPCODE(N_FUSED_GLOBAL_REF_LOAD_I16_CALL) {
+        DO_GLOBAL_REF();
+        FOLLOW(N_FUSED_LOAD_I16_CALL);
+    }
+
+    OPCODE(N_FUSED_GLOBAL_REF_CALL) FOLLOWED(N_FUSED_GLOBAL_REF_CALL) {
+        DO_GLOBAL_REF();
+        FOLLOW(N_OP_CALL);
+    }
+
+    OPCODE(N_FUSED_LOAD_I16_CALL) FOLLOWED(N_FUSED_LOAD_I16_CALL) {
+        DO_LOAD_I16();
+        FOLLOW(N_OP_CALL);
+    }
+
+    OPCODE(N_FUSED_LOAD_I16_JUMP_UNLESS) {
+        DO_LOAD_I16();
+        FOLLOW(N_OP_JUMP_UNLESS);
+    }
+
+    OPCODE(N_FUSED_GLOBAL_REF_GLOBAL_REF) {
+        DO_GLOBAL_REF();
+        FOLLOW(N_OP_GLOBAL_REF);
+    }
+
+    OPCODE(N_FUSED_GLOBAL_SET_JUMP) {
+        DO_GLOBAL_SET();
+        FOLLOW(N_OP_JUMP);
+    }
+
+    OPCODE_UNKNOWN() {
+        n_set_error(error, &UNKNOWN_OPCODE, "Found an unknown opcode.");
+        goto fail;
+    }
+
+    END_DISPATCH()
+
+fail:
+halt:
+    self->halted = 1;
+suspend:
+    self->pc = ip - base;
+    self->fp = fp;
+    self->sp = sp;
+    return fuel;
+}
+
+#undef LABEL_ADDR
+#undef GOTO_ADDR
+#undef BEGIN_DISPATCH
+#undef END_DISPATCH
+#undef OPCODE
+#undef OPCODE_UNKNOWN
+#undef FOLLOWED
+#undef DISPATCH
+#undef SAVE_FRAME
+#undef FOLLOW
+#undef OUT_OF_FUEL
+#undef SPEND_FUEL
+#undef PRIMITIVE_FAILED
+#undef JUMP_TO
+#undef DO_LOAD_I16
+#undef DO_GLOBAL_REF
+#undef DO_GLOBAL_SET
+#undef DO_RETURN
+#undef RESERVE_STACK
+#undef DO_ARITHMETIC
+#undef DO_MULTIPLICATION
+#undef DO_COMPARISON
+#undef DO_SLOW_ARITHMETIC
+#undef DO_COMPARE_AND_JUMP
+#undef ENTER_JIT
+#undef COUNT_CALL
+#undef PROFILE_DISPATCH
+#endif /* N_DISPATCH_STEP */
@@ -3,7 +3,10 @@
 
 #include <stdlib.h>
 
-#define N_STACK_SIZE 16384
+/* The stack starts with room for N_STACK_INITIAL_SIZE values and doubles in
+ * size whenever a new frame does not fit, up to N_STACK_MAX_SIZE values. */
+#define N_STACK_INITIAL_SIZE 512
+#define N_STACK_MAX_SIZE (1 << 20)
 #define N_ARGUMENTS_SIZE 64
 
 #include "values.h"
@@ -14,6 +17,10 @@ typedef struct NEvaluator NEvaluator;
 
 struct NEvaluator {
     NModule *current_module;
+    /* The globals of the current module, or the evaluator's own copy of
+     * them, see n_evaluator_own_globals. */
+    NValue *globals;
+    NValue *own_globals;
 
     int pc;
     int sp;
@@ -22,20 +29,47 @@ struct NEvaluator {
 
     NValue arguments[N_ARGUMENTS_SIZE];
 
-    NValue stack[N_STACK_SIZE];
+    NValue *stack;
     int stack_size;
+
+    /* The isolate of the current module, which keeps the objects on the
+     * stack alive, and the next evaluator attached to it. */
+    struct NIsolate *isolate;
+    NEvaluator *next_evaluator;
 };
 
 
 void
 ni_init_evaluator(NError* error);
 
+void
+n_construct_evaluator(NEvaluator* self);
+
+void
+n_destruct_evaluator(NEvaluator* self);
+
+/* Traces the values on the stack, in the arguments of the last primitive
+ * call and in the evaluator's own globals. */
+void
+ni_trace_evaluator(NEvaluator *self, struct NHeap *heap);
+
 void
 n_evaluator_step(NEvaluator *self, NError *error);
 
+/* Runs until the machine halts. A primitive that blocks stops it early,
+ * with the error set but without halting, see n_block_primitive. */
 void
 n_evaluator_run(NEvaluator *self, NError *error);
 
+/* Runs like n_evaluator_run, but gives up after spending max_fuel units of
+ * fuel, leaving the evaluator unhalted so that running it again resumes
+ * where it stopped. One unit is spent on every call, tail-call and backward
+ * jump, which every loop and recursion goes through, so the instructions
+ * run between two of them are bounded by the size of the code. Returns the
+ * fuel left, which is zero when it ran out. */
+uint32_t
+n_evaluator_run_for(NEvaluator *self, uint32_t max_fuel, NError *error);
+
 NValue
 n_evaluator_get_global(NEvaluator *self, int index, NError *error);
 
@@ -45,14 +79,23 @@ n_evaluator_get_local(NEvaluator *self, int index, NError *error);
 void
 n_evaluator_set_local(NEvaluator *self, int index, NValue value, NError *error);
 
+/* Also drops any globals of its own the evaluator had. The evaluator is
+ * attached to the isolate of the module, if any, until it is destructed or
+ * prepared for a module of another one. */
 void
 n_prepare_evaluator(NEvaluator *self, NModule *module, NError *error);
 
-#ifdef N_TEST
+/* Gives a prepared evaluator its own copy of the globals of its module, so
+ * that it neither sees nor makes changes to the globals of other
+ * evaluators running the same module. */
 void
-nt_construct_evaluator(NEvaluator* self);
+n_evaluator_own_globals(NEvaluator *self, NError *error);
 
-#endif /* N_TEST */
+/* Decodes the code of the evaluator's module and readies it for
+ * n_evaluator_run, which otherwise does it the first time it runs the
+ * module. Must be done before the module is frozen. */
+void
+n_evaluator_prepare_code(NEvaluator *self, NError *error);
 
 #endif /* N_E_EVALUATOR_H */
 
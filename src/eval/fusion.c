@@ -0,0 +1,276 @@
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/opcodes.h"
+
+#include "fusion.h"
+
+#define PROFILE_VERSION 1
+#define NO_OPCODE N_DECODED_INVALID
+
+typedef struct NFusionPattern NFusionPattern;
+
+struct NFusionPattern {
+    uint8_t fused;
+    uint8_t opcodes[3];
+};
+
+/* Triples come first, so they win over the pairs they start with. The
+ * evaluator runs a fused triple by running the first instruction and then
+ * the fused pair made of the other two, so every triple must end with a
+ * pair from this table. */
+static
+NFusionPattern PATTERNS[N_NUM_FUSED_OPCODES] = {
+    { N_FUSED_GLOBAL_REF_GLOBAL_REF_CALL,
+      { N_OP_GLOBAL_REF, N_OP_GLOBAL_REF, N_OP_CALL } },
+    { N_FUSED_LOAD_I16_GLOBAL_REF_CALL,
+      { N_OP_LOAD_I16, N_OP_GLOBAL_REF, N_OP_CALL } },
+    { N_FUSED_GLOBAL_REF_LOAD_I16_CALL,
+      { N_OP_GLOBAL_REF, N_OP_LOAD_I16, N_OP_CALL } },
+    { N_FUSED_GLOBAL_REF_CALL,
+      { N_OP_GLOBAL_REF, N_OP_CALL, NO_OPCODE } },
+    { N_FUSED_LOAD_I16_CALL,
+      { N_OP_LOAD_I16, N_OP_CALL, NO_OPCODE } },
+    { N_FUSED_LOAD_I16_JUMP_UNLESS,
+      { N_OP_LOAD_I16, N_OP_JUMP_UNLESS, NO_OPCODE } },
+    { N_FUSED_GLOBAL_REF_GLOBAL_REF,
+      { N_OP_GLOBAL_REF, N_OP_GLOBAL_REF, NO_OPCODE } },
+    { N_FUSED_GLOBAL_SET_JUMP,
+      { N_OP_GLOBAL_SET, N_OP_JUMP, NO_OPCODE } }
+};
+
+static
+NErrorType INVALID_PROFILE_FORMAT = { "nuvm.InvalidProfileFormat" };
+
+static
+NFusionSet ACTIVE_FUSIONS = N_ALL_FUSIONS;
+
+static
+NDispatchProfile GLOBAL_PROFILE;
+
+static uint32_t
+get_size(NDecodedInstruction *instr);
+
+static int
+matches(NDecodedStream *stream, uint32_t pc, NFusionPattern *pattern);
+
+static uint32_t
+get_count(NDispatchProfile *profile, NFusionPattern *pattern);
+
+
+void
+ni_init_fusion(NError* error) {
+#define EC ON_ERROR(error, return)
+    n_register_error_type(&INVALID_PROFILE_FORMAT, error);         EC;
+#undef EC
+    n_reset_dispatch_profile(&GLOBAL_PROFILE);
+}
+
+
+/* Rewrites the instructions of the stream that start one of the given
+ * fused sequences. When the evaluator is built to count dispatches, the
+ * stream is left untouched so that the counts are for the original
+ * opcodes. */
+void
+n_fuse_stream(NDecodedStream* stream, NFusionSet fusions) {
+#ifndef N_PROFILE_DISPATCH
+    uint32_t pc;
+    for (pc = 0; pc < stream->size; pc++) {
+        int i;
+        for (i = 0; i < N_NUM_FUSED_OPCODES; i++) {
+            NFusionPattern *pattern = PATTERNS + i;
+            if ((fusions & n_fusion_bit(pattern->fused))
+                    && matches(stream, pc, pattern)) {
+                stream->instructions[pc].opcode = pattern->fused;
+                break;
+            }
+        }
+    }
+    stream->linked_table = NULL;
+#endif /* N_PROFILE_DISPATCH */
+}
+
+
+NFusionSet
+n_get_active_fusions(void) {
+    return ACTIVE_FUSIONS;
+}
+
+
+void
+n_set_active_fusions(NFusionSet fusions) {
+    ACTIVE_FUSIONS = fusions & N_ALL_FUSIONS;
+}
+
+
+NFusionSet
+n_select_fusions(NDispatchProfile* profile, uint32_t min_count) {
+    NFusionSet result = N_NO_FUSIONS;
+    int i;
+    for (i = 0; i < N_NUM_FUSED_OPCODES; i++) {
+        NFusionPattern *pattern = PATTERNS + i;
+        if (get_count(profile, pattern) >= min_count) {
+            result |= n_fusion_bit(pattern->fused);
+        }
+    }
+    return result;
+}
+
+
+void
+n_reset_dispatch_profile(NDispatchProfile* profile) {
+    memset(profile, 0, sizeof(NDispatchProfile));
+}
+
+
+NDispatchProfile*
+n_global_dispatch_profile(void) {
+    return &GLOBAL_PROFILE;
+}
+
+
+/* The profile is written as a version byte, the number of opcodes the
+ * counts refer to, the number of records that follow and one record for
+ * each sequence that ran at least once. A record is made of three opcodes
+ * and a 32-bit count, with the last opcode set to 0xFF for pairs. */
+void
+n_write_dispatch_profile(NByteWriter* writer, NDispatchProfile* profile,
+                         NError* error) {
+#define EC ON_ERROR(error, return)
+    uint32_t num_records = 0;
+    int a, b, c;
+
+    for (a = 0; a < N_NUM_OPCODES; a++) {
+        for (b = 0; b < N_NUM_OPCODES; b++) {
+            num_records += profile->pairs[a][b] > 0;
+            for (c = 0; c < N_NUM_OPCODES; c++) {
+                num_records += profile->triples[a][b][c] > 0;
+            }
+        }
+    }
+
+    n_write_byte(writer, PROFILE_VERSION, error);                  EC;
+    n_write_byte(writer, N_NUM_OPCODES, error);                    EC;
+    n_write_uint32(writer, num_records, error);                    EC;
+
+    for (a = 0; a < N_NUM_OPCODES; a++) {
+        for (b = 0; b < N_NUM_OPCODES; b++) {
+            if (profile->pairs[a][b] > 0) {
+                n_write_byte(writer, a, error);                    EC;
+                n_write_byte(writer, b, error);                    EC;
+                n_write_byte(writer, NO_OPCODE, error);            EC;
+                n_write_uint32(writer, profile->pairs[a][b], error); EC;
+            }
+            for (c = 0; c < N_NUM_OPCODES; c++) {
+                uint32_t count = profile->triples[a][b][c];
+                if (count > 0) {
+                    n_write_byte(writer, a, error);                EC;
+                    n_write_byte(writer, b, error);                EC;
+                    n_write_byte(writer, c, error);                EC;
+                    n_write_uint32(writer, count, error);          EC;
+                }
+            }
+        }
+    }
+#undef EC
+}
+
+
+void
+n_read_dispatch_profile(NByteReader* reader, NDispatchProfile* profile,
+                        NError* error) {
+#define EC ON_ERROR(error, return)
+    uint8_t version, num_opcodes;
+    uint32_t num_records, i;
+
+    n_reset_dispatch_profile(profile);
+
+    version = n_read_byte(reader, error);                          EC;
+    num_opcodes = n_read_byte(reader, error);                      EC;
+    if (version != PROFILE_VERSION || num_opcodes != N_NUM_OPCODES) {
+        n_set_error(error, &INVALID_PROFILE_FORMAT, "Dispatch profile was "
+                    "written for a different version of the evaluator.");
+        return;
+    }
+
+    num_records = n_read_uint32(reader, error);                    EC;
+    for (i = 0; i < num_records; i++) {
+        uint8_t a, b, c;
+        uint32_t count;
+        a = n_read_byte(reader, error);                            EC;
+        b = n_read_byte(reader, error);                            EC;
+        c = n_read_byte(reader, error);                            EC;
+        count = n_read_uint32(reader, error);                      EC;
+
+        if (a >= N_NUM_OPCODES || b >= N_NUM_OPCODES
+                || (c >= N_NUM_OPCODES && c != NO_OPCODE)) {
+            n_set_error(error, &INVALID_PROFILE_FORMAT, "Dispatch profile "
+                        "refers to an unknown opcode.");
+            return;
+        }
+        if (c == NO_OPCODE) {
+            profile->pairs[a][b] = count;
+        }
+        else {
+            profile->triples[a][b][c] = count;
+        }
+    }
+#undef EC
+}
+
+
+/* Counts the instruction about to run against the two that ran before it.
+ * Only sequences where each instruction follows the previous one in the
+ * code are counted, since those are the only ones that can be fused. */
+void
+ni_record_dispatch(NDispatchProfile* profile, NDecodedInstruction* second,
+                   NDecodedInstruction* first, NDecodedInstruction* current) {
+    uint8_t op = current->opcode;
+    if (first == NULL || op >= N_NUM_OPCODES
+            || first + get_size(first) != current) {
+        return;
+    }
+    profile->pairs[first->opcode][op]++;
+
+    if (second != NULL && second + get_size(second) == first) {
+        profile->triples[second->opcode][first->opcode][op]++;
+    }
+}
+
+
+static uint32_t
+get_size(NDecodedInstruction *instr) {
+    uint32_t size = n_get_opcode_size((NOpcode) instr->opcode);
+    if (instr->opcode == N_OP_CALL || instr->opcode == N_OP_TAIL_CALL) {
+        size += instr->u8s[2];
+    }
+    return size;
+}
+
+
+static int
+matches(NDecodedStream *stream, uint32_t pc, NFusionPattern *pattern) {
+    int i;
+    for (i = 0; i < 3 && pattern->opcodes[i] != NO_OPCODE; i++) {
+        NDecodedInstruction *instr;
+        if (pc >= stream->size) {
+            return 0;
+        }
+        instr = stream->instructions + pc;
+        if (instr->opcode != pattern->opcodes[i]) {
+            return 0;
+        }
+        pc += get_size(instr);
+    }
+    return 1;
+}
+
+
+static uint32_t
+get_count(NDispatchProfile *profile, NFusionPattern *pattern) {
+    uint8_t *ops = pattern->opcodes;
+    if (ops[2] == NO_OPCODE) {
+        return profile->pairs[ops[0]][ops[1]];
+    }
+    return profile->triples[ops[0]][ops[1]][ops[2]];
+}
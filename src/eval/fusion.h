@@ -0,0 +1,87 @@
+#ifndef N_E_FUSION_H
+#define N_E_FUSION_H
+
+#include "../common/compatibility/stdint.h"
+#include "../common/errors.h"
+#include "../common/opcodes.h"
+#include "../common/byte-readers.h"
+#include "../common/byte-writers.h"
+
+#include "decoded-stream.h"
+
+/* Superinstructions only exist in decoded streams. A fused opcode replaces
+ * the first instruction of a sequence and runs the whole sequence with a
+ * single dispatch. The operands of the first instruction stay where they
+ * were, and the other instructions of the sequence keep their own decoded
+ * form, so jumps into the middle of a sequence still work. */
+enum NFusedOpcode {
+    N_FUSED_GLOBAL_REF_GLOBAL_REF_CALL = 0x80,
+    N_FUSED_LOAD_I16_GLOBAL_REF_CALL   = 0x81,
+    N_FUSED_GLOBAL_REF_LOAD_I16_CALL   = 0x82,
+    N_FUSED_GLOBAL_REF_CALL            = 0x83,
+    N_FUSED_LOAD_I16_CALL              = 0x84,
+    N_FUSED_LOAD_I16_JUMP_UNLESS       = 0x85,
+    N_FUSED_GLOBAL_REF_GLOBAL_REF      = 0x86,
+    N_FUSED_GLOBAL_SET_JUMP            = 0x87
+};
+
+typedef enum NFusedOpcode NFusedOpcode;
+
+#define N_FIRST_FUSED_OPCODE N_FUSED_GLOBAL_REF_GLOBAL_REF_CALL
+#define N_NUM_FUSED_OPCODES  8
+
+/* A set of enabled fused opcodes. Bit i stands for the fused opcode
+ * N_FIRST_FUSED_OPCODE + i. */
+typedef uint32_t NFusionSet;
+
+#define N_NO_FUSIONS  ((NFusionSet) 0)
+#define N_ALL_FUSIONS ((NFusionSet) ((1UL << N_NUM_FUSED_OPCODES) - 1))
+
+#define n_fusion_bit(FUSED) \
+    ((NFusionSet) (1UL << ((FUSED) - N_FIRST_FUSED_OPCODE)))
+
+
+typedef struct NDispatchProfile NDispatchProfile;
+
+/* Counts of how many times each sequence of two and three opcodes ran,
+ * where each instruction was the one following the previous in the code. */
+struct NDispatchProfile {
+    uint32_t pairs[N_NUM_OPCODES][N_NUM_OPCODES];
+    uint32_t triples[N_NUM_OPCODES][N_NUM_OPCODES][N_NUM_OPCODES];
+};
+
+
+void
+ni_init_fusion(NError* error);
+
+void
+n_fuse_stream(NDecodedStream* stream, NFusionSet fusions);
+
+NFusionSet
+n_get_active_fusions(void);
+
+void
+n_set_active_fusions(NFusionSet fusions);
+
+NFusionSet
+n_select_fusions(NDispatchProfile* profile, uint32_t min_count);
+
+void
+n_reset_dispatch_profile(NDispatchProfile* profile);
+
+NDispatchProfile*
+n_global_dispatch_profile(void);
+
+void
+n_write_dispatch_profile(NByteWriter* writer, NDispatchProfile* profile,
+                         NError* error);
+
+void
+n_read_dispatch_profile(NByteReader* reader, NDispatchProfile* profile,
+                        NError* error);
+
+void
+ni_record_dispatch(NDispatchProfile* profile, NDecodedInstruction* second,
+                   NDecodedInstruction* first, NDecodedInstruction* current);
+
+#endif /* N_E_FUSION_H */
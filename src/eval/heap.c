@@ -0,0 +1,914 @@
+/* Needed for clock_gettime when building as C89. */
+#define _DEFAULT_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../common/common.h"
+
+#include "heap.h"
+#include "type-registry.h"
+
+/* The strictest alignment any value may need. */
+typedef union {
+    long l;
+    double d;
+    void *p;
+} NAligned;
+
+#define ALIGN(SIZE) \
+    (((SIZE) + sizeof(NAligned) - 1) / sizeof(NAligned) * sizeof(NAligned))
+
+/* The link every object is allocated with, right before its header. It
+ * chains the objects of the old generation, the cells of the free lists,
+ * and young objects to the copy they were moved to. The rest of what the
+ * heap knows about an object is in the gc_bits and size_class of its
+ * header. */
+struct NCell {
+    NCell *next;
+};
+
+/* Colors of old objects during a major collection. Gray objects are
+ * marked but the values they refer to may not be. */
+#define WHITE 0
+#define GRAY  1
+#define BLACK 2
+#define COLOR_MASK 0x3
+
+/* Old objects stored into since the last minor collection. */
+#define REMEMBERED 0x4
+/* Objects in the nursery, and those of them that were moved, or pinned
+ * when forwarded to themselves. */
+#define YOUNG      0x8
+#define FORWARDED  0x10
+
+#define COLOR(OBJECT) ((OBJECT)->gc_bits & COLOR_MASK)
+#define SET_COLOR(OBJECT, COLOR) \
+    ((OBJECT)->gc_bits = ((OBJECT)->gc_bits & ~COLOR_MASK) | (COLOR))
+
+/* Size classes of objects that are not in a free list. Large objects keep
+ * their size before their cell. */
+#define LARGE     0xFE
+#define UNMANAGED 0xFF
+
+#define HEADER_SIZE ALIGN(sizeof(NCell))
+#define CELL_OF(OBJECT) ((NCell*) ((char*) (OBJECT) - HEADER_SIZE))
+#define OBJECT_OF(CELL) ((NObject*) ((char*) (CELL) + HEADER_SIZE))
+
+#define LARGE_HEADER_SIZE ALIGN(sizeof(size_t))
+#define LARGE_SIZE(CELL) (*(size_t*) ((char*) (CELL) - LARGE_HEADER_SIZE))
+
+#define TRACE_OF(OBJECT) (ni_type_by_id((OBJECT)->type_id)->trace)
+
+/* The header of a chunk, its cells follow it. */
+struct NHeapChunk {
+    NHeapChunk *next;
+};
+
+#define CHUNK_HEADER_SIZE ALIGN(sizeof(NHeapChunk))
+
+#define INITIAL_STACK_SIZE 64
+#define INITIAL_ROOTS_SIZE 8
+
+/* Work given to the steps that must run to completion. */
+#define ALL_WORK ((size_t) -1)
+
+static const
+uint32_t CLASS_SIZES[N_NUM_SIZE_CLASSES] = {
+    16, 32, 48, 64, 96, 128, 192, N_LARGEST_SIZE_CLASS
+};
+
+static
+NErrorType* BAD_ALLOCATION = NULL;
+
+static NObject*
+allocate_young(NHeap* self, size_t size);
+
+static NObject*
+allocate_old(NHeap* self, size_t size);
+
+static int
+find_size_class(size_t size);
+
+static size_t
+object_size(NObject* object);
+
+static void
+free_large_object(NCell* cell);
+
+static int
+refill_free_list(NHeap* self, int size_class);
+
+static int
+push_object(NObject*** stack, size_t* top, size_t* size, NObject* object);
+
+static int
+collect_young(NHeap* self);
+
+static void
+collect_old_when_due(NHeap* self);
+
+static void
+start_marking(NHeap* self);
+
+static void
+run_step(NHeap* self);
+
+static void
+finish_collection(NHeap* self);
+
+static int
+trace_gray_objects(NHeap* self, size_t work);
+
+static int
+sweep(NHeap* self, size_t work);
+
+static void
+trace_roots(NHeap* self);
+
+static void
+trace_pushed_objects(NHeap* self);
+
+static void
+trace_old_objects(NHeap* self, int all);
+
+static void
+trace_pinned_objects(NHeap* self);
+
+static void
+unpin_young_objects(NHeap* self);
+
+static double
+now_micros(void);
+
+static void
+record_pause(NHeap* self, double start);
+
+
+void
+ni_init_heap(NError* error) {
+#define EC ON_ERROR(error, return)
+    BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);      EC;
+#undef EC
+}
+
+
+void
+n_construct_heap(NHeap* self, NRootTracer trace_roots, void* roots_data) {
+    int i;
+    self->nursery = NULL;
+    self->nursery_used = 0;
+
+    for (i = 0; i < N_NUM_SIZE_CLASSES; i++) {
+        self->free_lists[i] = NULL;
+    }
+    self->chunks = NULL;
+    self->objects = NULL;
+    self->unswept = NULL;
+    self->allocated = 0;
+    self->threshold = N_GC_MIN_THRESHOLD;
+
+    self->minor_collections = 0;
+    self->collections = 0;
+
+    self->pause_target = 0;
+    self->phase = N_GC_IDLE;
+    for (i = 0; i < N_PAUSE_BUCKETS; i++) {
+        self->pauses[i] = 0;
+    }
+    self->longest_pause = 0;
+
+    self->trace_roots = trace_roots;
+    self->roots_data = roots_data;
+    self->roots = NULL;
+    self->num_roots = 0;
+    self->roots_size = 0;
+
+    self->remembered = NULL;
+    self->num_remembered = 0;
+    self->remembered_size = 0;
+    self->remembered_overflowed = 0;
+
+    self->gray = NULL;
+    self->num_gray = 0;
+    self->gray_size = 0;
+    self->gray_overflowed = 0;
+
+    self->in_minor_collection = 0;
+    self->promotion_failed = 0;
+    self->mark_stack = NULL;
+    self->mark_stack_size = 0;
+    self->mark_stack_top = 0;
+    self->mark_stack_overflowed = 0;
+}
+
+
+void
+n_destruct_heap(NHeap* self) {
+    NCell *lists[2];
+    NHeapChunk *chunk = self->chunks;
+    int i;
+
+    lists[0] = self->objects;
+    lists[1] = self->unswept;
+    for (i = 0; i < 2; i++) {
+        NCell *cell = lists[i];
+        while (cell != NULL) {
+            NCell *next = cell->next;
+            if (OBJECT_OF(cell)->size_class == LARGE) {
+                free_large_object(cell);
+            }
+            cell = next;
+        }
+    }
+    while (chunk != NULL) {
+        NHeapChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(self->nursery);
+    free(self->roots);
+    free(self->remembered);
+    free(self->gray);
+    free(self->mark_stack);
+    n_construct_heap(self, self->trace_roots, self->roots_data);
+}
+
+
+NObject*
+n_allocate_object(NHeap* self, size_t size, NType* type, NError* error) {
+    NObject *object = NULL;
+    uint16_t type_id = ni_type_id(type, error);
+    if (type_id == 0) {
+        return NULL;
+    }
+
+    if (self == NULL) {
+        NCell *cell = malloc(HEADER_SIZE + size);
+        if (cell != NULL) {
+            cell->next = NULL;
+            object = OBJECT_OF(cell);
+            object->gc_bits = WHITE;
+            object->size_class = UNMANAGED;
+        }
+    }
+    else if (size <= N_LARGEST_SIZE_CLASS) {
+        object = allocate_young(self, size);
+        if (object == NULL) {
+            double start = now_micros();
+            if (collect_young(self)) {
+                collect_old_when_due(self);
+                object = allocate_young(self, size);
+            }
+            record_pause(self, start);
+        }
+    }
+    else {
+        if (self->phase != N_GC_IDLE || self->allocated >= self->threshold) {
+            double start = now_micros();
+            if (self->phase != N_GC_IDLE || collect_young(self)) {
+                collect_old_when_due(self);
+            }
+            record_pause(self, start);
+        }
+        object = allocate_old(self, size);
+        if (object != NULL) {
+            /* Its fields are about to be filled, maybe with young
+             * objects. */
+            object->type_id = type_id;
+            n_heap_write_barrier(self, object);
+        }
+    }
+
+    if (object == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate object.");
+        return NULL;
+    }
+    object->type_id = type_id;
+    object->hash = 0;
+    return object;
+}
+
+
+NObject*
+n_allocate_arena_object(NArena* arena, size_t size, NType* type,
+                        NError* error) {
+    NObject *object;
+    NCell *cell;
+    uint16_t type_id = ni_type_id(type, error);
+    if (type_id == 0) {
+        return NULL;
+    }
+
+    cell = n_arena_allocate(arena, HEADER_SIZE + size);
+    if (cell == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate object.");
+        return NULL;
+    }
+    cell->next = NULL;
+
+    object = OBJECT_OF(cell);
+    object->type_id = type_id;
+    object->gc_bits = WHITE;
+    object->size_class = UNMANAGED;
+    object->hash = 0;
+    return object;
+}
+
+
+/* A major collection that was already in progress when it was called only
+ * marked what was reachable back then, so a new one is run after it. */
+void
+n_heap_collect(NHeap* self) {
+    double start = now_micros();
+    if (collect_young(self)) {
+        if (self->phase != N_GC_IDLE) {
+            finish_collection(self);
+        }
+        start_marking(self);
+        finish_collection(self);
+    }
+    record_pause(self, start);
+}
+
+
+int
+n_heap_collect_young(NHeap* self) {
+    double start = now_micros();
+    int collected = collect_young(self);
+    record_pause(self, start);
+    return collected;
+}
+
+
+void
+n_heap_start_collection(NHeap* self) {
+    double start;
+    if (self->phase != N_GC_IDLE) {
+        return;
+    }
+    start = now_micros();
+    if (collect_young(self)) {
+        start_marking(self);
+    }
+    record_pause(self, start);
+}
+
+
+int
+n_heap_step(NHeap* self) {
+    double start;
+    if (self->phase == N_GC_IDLE) {
+        return 0;
+    }
+    start = now_micros();
+    run_step(self);
+    record_pause(self, start);
+    return self->phase != N_GC_IDLE;
+}
+
+
+/* Young objects are copied during minor collections, and left alone during
+ * major ones: the nursery is empty when marking begins, so whatever they
+ * refer to in the old generation was reachable back then. A young object
+ * that can't be copied is left in the nursery, forwarded to itself, and
+ * still traced. */
+void
+n_trace_value(NHeap* self, NValue* location) {
+    NObject *object;
+    if (n_is_immediate(*location)) {
+        return;
+    }
+
+    object = n_unwrap_object(*location);
+    if (object->gc_bits & YOUNG) {
+        NCell *cell = CELL_OF(object);
+        if (!self->in_minor_collection) {
+            return;
+        }
+        if (!(object->gc_bits & FORWARDED)) {
+            NObject *copy = allocate_old(self, object_size(object));
+            object->gc_bits |= FORWARDED;
+            if (copy != NULL) {
+                uint8_t gc_bits = copy->gc_bits;
+                uint8_t size_class = copy->size_class;
+                memcpy(copy, object, object_size(object));
+                copy->gc_bits = gc_bits;
+                copy->size_class = size_class;
+                cell->next = CELL_OF(copy);
+            }
+            else {
+                cell->next = cell;
+                self->promotion_failed = 1;
+            }
+            if (TRACE_OF(object) != NULL
+                && !push_object(&self->mark_stack, &self->mark_stack_top,
+                                &self->mark_stack_size,
+                                OBJECT_OF(cell->next))) {
+                self->mark_stack_overflowed = 1;
+            }
+        }
+        *location = n_wrap_object(OBJECT_OF(cell->next));
+        return;
+    }
+
+    if (self->in_minor_collection || COLOR(object) != WHITE
+        || object->size_class == UNMANAGED) {
+        return;
+    }
+
+    if (TRACE_OF(object) == NULL) {
+        SET_COLOR(object, BLACK);
+        return;
+    }
+    SET_COLOR(object, GRAY);
+    if (!push_object(&self->gray, &self->num_gray, &self->gray_size,
+                     object)) {
+        self->gray_overflowed = 1;
+    }
+}
+
+
+/* While marking, the values the object refers to are traced before any of
+ * them is replaced, since they may be reachable from nowhere else
+ * afterwards. */
+void
+n_heap_write_barrier(NHeap* self, NObject* object) {
+    if ((object->gc_bits & YOUNG) || object->size_class == UNMANAGED) {
+        return;
+    }
+
+    if (self->phase == N_GC_MARKING && COLOR(object) != BLACK) {
+        SET_COLOR(object, BLACK);
+        if (TRACE_OF(object) != NULL) {
+            TRACE_OF(object)(object, self);
+        }
+    }
+
+    if (!(object->gc_bits & REMEMBERED)) {
+        object->gc_bits |= REMEMBERED;
+        if (!push_object(&self->remembered, &self->num_remembered,
+                         &self->remembered_size, object)) {
+            self->remembered_overflowed = 1;
+        }
+    }
+}
+
+
+void
+n_heap_add_root(NHeap* self, NValue* root, NError* error) {
+    if (self->num_roots == self->roots_size) {
+        int new_size = self->roots_size > 0 ? self->roots_size * 2
+                                            : INITIAL_ROOTS_SIZE;
+        NValue **new_roots = realloc(self->roots, sizeof(NValue*) * new_size);
+        if (new_roots == NULL) {
+            n_set_error(error, BAD_ALLOCATION, "Unable to add a root to "
+                        "the heap.");
+            return;
+        }
+        self->roots = new_roots;
+        self->roots_size = new_size;
+    }
+    self->roots[self->num_roots++] = root;
+}
+
+
+void
+n_heap_remove_root(NHeap* self, NValue* root) {
+    int i;
+    for (i = 0; i < self->num_roots; i++) {
+        if (self->roots[i] == root) {
+            self->roots[i] = self->roots[--self->num_roots];
+            return;
+        }
+    }
+}
+
+
+/* Young objects take the whole size of their class, so that they fit in
+ * a cell of it once they are moved. */
+static NObject*
+allocate_young(NHeap* self, size_t size) {
+    int size_class = find_size_class(size);
+    NCell *cell;
+    NObject *object;
+    size = CLASS_SIZES[size_class];
+    if (self->nursery == NULL) {
+        self->nursery = malloc(N_NURSERY_SIZE);
+        if (self->nursery == NULL) {
+            return NULL;
+        }
+    }
+    if (N_NURSERY_SIZE - self->nursery_used < HEADER_SIZE + size) {
+        return NULL;
+    }
+
+    cell = (NCell*) (self->nursery + self->nursery_used);
+    self->nursery_used += HEADER_SIZE + size;
+    cell->next = NULL;
+    object = OBJECT_OF(cell);
+    object->gc_bits = YOUNG;
+    object->size_class = size_class;
+    return object;
+}
+
+
+/* Objects allocated while marking are black, they were not reachable when
+ * it began. */
+static NObject*
+allocate_old(NHeap* self, size_t size) {
+    NCell *cell;
+    NObject *object;
+    int size_class = find_size_class(size);
+
+    if (size_class < 0) {
+        char *memory = malloc(LARGE_HEADER_SIZE + HEADER_SIZE + size);
+        if (memory == NULL) {
+            return NULL;
+        }
+        cell = (NCell*) (memory + LARGE_HEADER_SIZE);
+        LARGE_SIZE(cell) = size;
+        size_class = LARGE;
+    }
+    else {
+        if (self->free_lists[size_class] == NULL
+            && !refill_free_list(self, size_class)) {
+            return NULL;
+        }
+        cell = self->free_lists[size_class];
+        self->free_lists[size_class] = cell->next;
+    }
+
+    cell->next = self->objects;
+    self->objects = cell;
+    object = OBJECT_OF(cell);
+    object->gc_bits = self->phase == N_GC_MARKING ? BLACK : WHITE;
+    object->size_class = size_class;
+    self->allocated += object_size(object);
+    return object;
+}
+
+
+static int
+find_size_class(size_t size) {
+    int i;
+    for (i = 0; i < N_NUM_SIZE_CLASSES; i++) {
+        if (size <= CLASS_SIZES[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* Only for objects that belong to a heap. */
+static size_t
+object_size(NObject* object) {
+    if (object->size_class == LARGE) {
+        return LARGE_SIZE(CELL_OF(object));
+    }
+    return CLASS_SIZES[object->size_class];
+}
+
+
+static void
+free_large_object(NCell* cell) {
+    free((char*) cell - LARGE_HEADER_SIZE);
+}
+
+
+/* Splits a new chunk in cells of the size class. */
+static int
+refill_free_list(NHeap* self, int size_class) {
+    size_t cell_size = HEADER_SIZE + CLASS_SIZES[size_class];
+    size_t num_cells = (N_HEAP_CHUNK_SIZE - CHUNK_HEADER_SIZE) / cell_size;
+    NHeapChunk *chunk = malloc(N_HEAP_CHUNK_SIZE);
+    char *cells;
+    size_t i;
+    if (chunk == NULL) {
+        return 0;
+    }
+    chunk->next = self->chunks;
+    self->chunks = chunk;
+
+    cells = (char*) chunk + CHUNK_HEADER_SIZE;
+    for (i = 0; i < num_cells; i++) {
+        NCell *cell = (NCell*) (cells + i * cell_size);
+        cell->next = self->free_lists[size_class];
+        self->free_lists[size_class] = cell;
+    }
+    return 1;
+}
+
+
+/* Pushes the object on one of the growable stacks of the heap. Returns
+ * false if the stack can't grow. */
+static int
+push_object(NObject*** stack, size_t* top, size_t* size, NObject* object) {
+    if (*top == *size) {
+        size_t new_size = *size > 0 ? *size * 2 : INITIAL_STACK_SIZE;
+        NObject **new_stack = realloc(*stack, sizeof(NObject*) * new_size);
+        if (new_stack == NULL) {
+            return 0;
+        }
+        *stack = new_stack;
+        *size = new_size;
+    }
+    (*stack)[(*top)++] = object;
+    return 1;
+}
+
+
+/* Copies the young objects reachable from the roots and from the
+ * remembered objects to the old generation. The copies are traced in turn,
+ * so that the young objects they refer to are copied too. Returns false
+ * if some could not be copied, in which case the nursery stays full. */
+static int
+collect_young(NHeap* self) {
+    NCell *cell;
+    size_t i;
+
+    self->in_minor_collection = 1;
+    self->promotion_failed = 0;
+    trace_roots(self);
+
+    if (self->remembered_overflowed) {
+        trace_old_objects(self, 1);
+    }
+    else {
+        for (i = 0; i < self->num_remembered; i++) {
+            NObject *object = self->remembered[i];
+            if (TRACE_OF(object) != NULL) {
+                TRACE_OF(object)(object, self);
+            }
+        }
+    }
+    trace_pushed_objects(self);
+
+    self->in_minor_collection = 0;
+    self->minor_collections++;
+    if (self->promotion_failed) {
+        /* Old objects may now refer to the objects left in the nursery, so
+         * all of them are traced the next time. */
+        unpin_young_objects(self);
+        self->remembered_overflowed = 1;
+        return 0;
+    }
+
+    for (i = 0; i < self->num_remembered; i++) {
+        self->remembered[i]->gc_bits &= ~REMEMBERED;
+    }
+    if (self->remembered_overflowed) {
+        for (cell = self->objects; cell != NULL; cell = cell->next) {
+            OBJECT_OF(cell)->gc_bits &= ~REMEMBERED;
+        }
+        for (cell = self->unswept; cell != NULL; cell = cell->next) {
+            OBJECT_OF(cell)->gc_bits &= ~REMEMBERED;
+        }
+    }
+    self->num_remembered = 0;
+    self->remembered_overflowed = 0;
+    self->nursery_used = 0;
+    return 1;
+}
+
+
+/* Runs after a minor collection emptied the nursery, or before an object
+ * is allocated in the old generation while a major collection is in
+ * progress. A major collection that falls too far behind the allocations
+ * is finished at once. */
+static void
+collect_old_when_due(NHeap* self) {
+    if (self->phase != N_GC_IDLE) {
+        if (self->allocated / 2 >= self->threshold) {
+            finish_collection(self);
+        }
+        else {
+            run_step(self);
+        }
+    }
+    else if (self->allocated >= self->threshold) {
+        start_marking(self);
+        if (self->pause_target == 0) {
+            finish_collection(self);
+        }
+    }
+}
+
+
+/* Must run right after a minor collection. */
+static void
+start_marking(NHeap* self) {
+    self->phase = N_GC_MARKING;
+    trace_roots(self);
+}
+
+
+/* Does rounds of N_GC_STEP_WORK objects until the pause target is
+ * reached. */
+static void
+run_step(NHeap* self) {
+    double start = now_micros();
+    do {
+        if (self->phase == N_GC_MARKING) {
+            if (!trace_gray_objects(self, N_GC_STEP_WORK)) {
+                self->phase = N_GC_SWEEPING;
+                self->unswept = self->objects;
+                self->objects = NULL;
+            }
+        }
+        else if (!sweep(self, N_GC_STEP_WORK)) {
+            finish_collection(self);
+        }
+    } while (self->phase != N_GC_IDLE
+             && now_micros() - start < self->pause_target);
+}
+
+
+static void
+finish_collection(NHeap* self) {
+    if (self->phase == N_GC_MARKING) {
+        trace_gray_objects(self, ALL_WORK);
+        self->phase = N_GC_SWEEPING;
+        self->unswept = self->objects;
+        self->objects = NULL;
+    }
+    sweep(self, ALL_WORK);
+
+    self->threshold = self->allocated
+                    + (self->allocated > N_GC_MIN_THRESHOLD
+                       ? self->allocated : N_GC_MIN_THRESHOLD);
+    self->phase = N_GC_IDLE;
+    self->collections++;
+}
+
+
+/* Traces up to the given number of gray objects. Returns false once there
+ * are none left. */
+static int
+trace_gray_objects(NHeap* self, size_t work) {
+    while (work > 0) {
+        NObject *object;
+        if (self->num_gray == 0) {
+            if (!self->gray_overflowed) {
+                return 0;
+            }
+            self->gray_overflowed = 0;
+            trace_old_objects(self, 0);
+            continue;
+        }
+
+        object = self->gray[--self->num_gray];
+        if (COLOR(object) == GRAY) {
+            SET_COLOR(object, BLACK);
+            TRACE_OF(object)(object, self);
+        }
+        work--;
+    }
+    return self->num_gray > 0 || self->gray_overflowed;
+}
+
+
+/* Sweeps up to the given number of cells. Returns false once there are
+ * none left. */
+static int
+sweep(NHeap* self, size_t work) {
+    while (self->unswept != NULL && work > 0) {
+        NCell *cell = self->unswept;
+        NObject *object = OBJECT_OF(cell);
+        self->unswept = cell->next;
+        work--;
+
+        if (COLOR(object) != WHITE) {
+            SET_COLOR(object, WHITE);
+            cell->next = self->objects;
+            self->objects = cell;
+            continue;
+        }
+
+        self->allocated -= object_size(object);
+        if (object->size_class == LARGE) {
+            free_large_object(cell);
+        }
+        else {
+            cell->next = self->free_lists[object->size_class];
+            self->free_lists[object->size_class] = cell;
+        }
+    }
+    return self->unswept != NULL;
+}
+
+
+static void
+trace_roots(NHeap* self) {
+    int i;
+    if (self->trace_roots != NULL) {
+        self->trace_roots(self, self->roots_data);
+    }
+    for (i = 0; i < self->num_roots; i++) {
+        n_trace_value(self, self->roots[i]);
+    }
+}
+
+
+/* Objects that could not be pushed are found again by going through all
+ * the old ones, and the ones left in the nursery. */
+static void
+trace_pushed_objects(NHeap* self) {
+    do {
+        while (self->mark_stack_top > 0) {
+            NObject *object = self->mark_stack[--self->mark_stack_top];
+            TRACE_OF(object)(object, self);
+        }
+        if (self->mark_stack_overflowed) {
+            self->mark_stack_overflowed = 0;
+            trace_old_objects(self, 1);
+            trace_pinned_objects(self);
+        }
+    } while (self->mark_stack_top > 0 || self->mark_stack_overflowed);
+}
+
+
+/* Traces every old object if all is set, or else only the gray ones.
+ * Objects still to be swept are dead unless marked, and may refer to
+ * objects already freed. */
+static void
+trace_old_objects(NHeap* self, int all) {
+    NCell *cell;
+    for (cell = self->objects; cell != NULL; cell = cell->next) {
+        NObject *object = OBJECT_OF(cell);
+        if ((all || COLOR(object) == GRAY) && TRACE_OF(object) != NULL) {
+            if (!all) {
+                SET_COLOR(object, BLACK);
+            }
+            TRACE_OF(object)(object, self);
+        }
+    }
+    for (cell = self->unswept; cell != NULL; cell = cell->next) {
+        NObject *object = OBJECT_OF(cell);
+        if (COLOR(object) != WHITE && TRACE_OF(object) != NULL) {
+            TRACE_OF(object)(object, self);
+        }
+    }
+}
+
+
+static void
+trace_pinned_objects(NHeap* self) {
+    size_t offset = 0;
+    while (offset < self->nursery_used) {
+        NCell *cell = (NCell*) (self->nursery + offset);
+        NObject *object = OBJECT_OF(cell);
+        if ((object->gc_bits & FORWARDED) && cell->next == cell
+            && TRACE_OF(object) != NULL) {
+            TRACE_OF(object)(object, self);
+        }
+        offset += HEADER_SIZE + CLASS_SIZES[object->size_class];
+    }
+}
+
+
+/* Lets the next minor collection try to copy the objects a failed one
+ * left in the nursery. */
+static void
+unpin_young_objects(NHeap* self) {
+    size_t offset = 0;
+    while (offset < self->nursery_used) {
+        NCell *cell = (NCell*) (self->nursery + offset);
+        NObject *object = OBJECT_OF(cell);
+        if ((object->gc_bits & FORWARDED) && cell->next == cell) {
+            object->gc_bits &= ~FORWARDED;
+        }
+        offset += HEADER_SIZE + CLASS_SIZES[object->size_class];
+    }
+}
+
+
+/* Pauses are wall clock time, which the processor clock is not once other
+ * threads run, so it is only the fallback. */
+static double
+now_micros(void) {
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == 0) {
+        return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+    }
+#endif
+    return (double) clock() * 1000000.0 / CLOCKS_PER_SEC;
+}
+
+
+static void
+record_pause(NHeap* self, double start) {
+    double elapsed = now_micros() - start;
+    uint32_t micros = elapsed < 4e9 ? (uint32_t) elapsed : 4000000000u;
+    int bucket = 0;
+    while (bucket < N_PAUSE_BUCKETS - 1 && micros >= (1UL << bucket)) {
+        bucket++;
+    }
+    self->pauses[bucket]++;
+    if (micros > self->longest_pause) {
+        self->longest_pause = micros;
+    }
+}
@@ -0,0 +1,199 @@
+#ifndef N_E_HEAP_H
+#define N_E_HEAP_H
+
+#include <stddef.h>
+
+#include "../common/compatibility/stdint.h"
+#include "../common/arena.h"
+#include "../common/errors.h"
+
+#include "values.h"
+
+/* Objects of up to N_LARGEST_SIZE_CLASS bytes are allocated in the nursery
+ * and, when they survive it, from chunks of N_HEAP_CHUNK_SIZE bytes split
+ * in cells of the same size. Bigger objects are allocated on their own,
+ * straight in the old generation. */
+#define N_NUM_SIZE_CLASSES 8
+#define N_LARGEST_SIZE_CLASS 256
+
+#ifndef N_HEAP_CHUNK_SIZE
+#define N_HEAP_CHUNK_SIZE (16 * 1024)
+#endif
+
+#ifndef N_NURSERY_SIZE
+#define N_NURSERY_SIZE (256 * 1024)
+#endif
+
+/* Major collections are not run before this many bytes are in the old
+ * generation. */
+#ifndef N_GC_MIN_THRESHOLD
+#define N_GC_MIN_THRESHOLD (256 * 1024)
+#endif
+
+/* Incremental marking traces this many objects between checks of the
+ * pause target. */
+#ifndef N_GC_STEP_WORK
+#define N_GC_STEP_WORK 256
+#endif
+
+/* Pauses are counted in buckets of powers of two microseconds, the first
+ * one holding the pauses under a microsecond, the last one those longer
+ * than the others can hold. */
+#define N_PAUSE_BUCKETS 20
+
+typedef struct NHeap NHeap;
+typedef struct NCell NCell;
+typedef struct NHeapChunk NHeapChunk;
+
+typedef enum {
+    N_GC_IDLE,
+    N_GC_MARKING,
+    N_GC_SWEEPING
+} NGcPhase;
+
+/* Traces the roots of a heap, with n_trace_value. */
+typedef void (*NRootTracer)(NHeap* heap, void* data);
+
+/* A heap of objects with two generations. New objects are bumped out of
+ * the nursery, and a minor collection copies the ones that are still
+ * reachable to the old generation once it is full. The old generation is
+ * reclaimed by a mark-sweep collector, when the bytes allocated in it
+ * since the last major collection reach the bytes that survived that one,
+ * and at least N_GC_MIN_THRESHOLD.
+ *
+ * Both collectors are precise: they trace the locations given by the
+ * roots, the locations added by the host with n_heap_add_root and, for
+ * objects whose type has a trace function, the locations of the values
+ * they refer to. Since objects move, values of objects must not be kept
+ * anywhere else across an allocation.
+ *
+ * Storing a value in the field of an object must be preceded by a call to
+ * n_heap_write_barrier. Minor collections don't go through the old
+ * generation, so the barrier remembers old objects that may refer to young
+ * ones.
+ *
+ * With a pause target, in microseconds, major collections are
+ * incremental: the roots are traced in a first pause, and the marking and
+ * sweeping of the old generation are then split in steps that each try to
+ * stay within the target. Steps are run by later allocations and by the
+ * schedulers of the evaluators using the heap, see n_heap_step. The
+ * barrier keeps what was reachable when marking began, so the roots don't
+ * have to be traced again, and objects that move to the old generation
+ * during marking are already marked. Without a pause target, the default,
+ * major collections run in a single pause.
+ *
+ * Every pause of the collectors is timed with a monotonic clock, where
+ * there is one, and counted in pauses. */
+struct NHeap {
+    unsigned char *nursery;
+    size_t nursery_used;
+
+    NCell *free_lists[N_NUM_SIZE_CLASSES];
+    NHeapChunk *chunks;
+    /* Every object of the old generation, live or not, but those still to
+     * be swept. */
+    NCell *objects;
+    NCell *unswept;
+    /* Bytes in the old generation. */
+    size_t allocated;
+    size_t threshold;
+
+    uint32_t minor_collections;
+    uint32_t collections;
+
+    uint32_t pause_target;
+    NGcPhase phase;
+    uint32_t pauses[N_PAUSE_BUCKETS];
+    uint32_t longest_pause;
+
+    NRootTracer trace_roots;
+    void *roots_data;
+    NValue **roots;
+    int num_roots;
+    int roots_size;
+
+    /* Old objects stored into since the last minor collection. */
+    NObject **remembered;
+    size_t num_remembered;
+    size_t remembered_size;
+    int remembered_overflowed;
+
+    /* Old objects marked by the major collector, but not traced yet. */
+    NObject **gray;
+    size_t num_gray;
+    size_t gray_size;
+    int gray_overflowed;
+
+    int in_minor_collection;
+    int promotion_failed;
+    NObject **mark_stack;
+    size_t mark_stack_size;
+    size_t mark_stack_top;
+    int mark_stack_overflowed;
+};
+
+
+void
+ni_init_heap(NError* error);
+
+void
+n_construct_heap(NHeap* self, NRootTracer trace_roots, void* roots_data);
+
+/* Frees every object of the heap. */
+void
+n_destruct_heap(NHeap* self);
+
+/* Allocates an object of the given size and type, which can be bigger than
+ * an NObject to make room for its fields. A collection may run first, so
+ * every object still in use must be reachable from the roots. Without a
+ * heap the object is allocated on its own with malloc, and is never
+ * collected nor moved. Such objects must not refer to objects of a heap. */
+NObject*
+n_allocate_object(NHeap* self, size_t size, NType* type, NError* error);
+
+/* Allocates an object that is never collected nor moved, like those
+ * allocated without a heap, but freed along with the arena. */
+NObject*
+n_allocate_arena_object(NArena* arena, size_t size, NType* type,
+                        NError* error);
+
+/* Runs a minor collection and then a major one, finishing the one in
+ * progress if any. */
+void
+n_heap_collect(NHeap* self);
+
+/* Starts an incremental major collection, after a minor one, unless one
+ * is in progress already. */
+void
+n_heap_start_collection(NHeap* self);
+
+/* Runs a step of the major collection in progress, if any. Returns false
+ * once there is none left. */
+int
+n_heap_step(NHeap* self);
+
+/* Empties the nursery. Returns false if not every object in it could be
+ * copied to the old generation, in which case the nursery stays full. */
+int
+n_heap_collect_young(NHeap* self);
+
+/* Keeps the object the location refers to alive during a collection, and
+ * updates the location when the object was moved. Objects that don't
+ * belong to the heap being collected must have been allocated without
+ * one. */
+void
+n_trace_value(NHeap* self, NValue* location);
+
+/* Tells the heap a value is about to be stored in a field of the
+ * object. */
+void
+n_heap_write_barrier(NHeap* self, NObject* object);
+
+/* Keeps the value in the given location alive until it is removed. */
+void
+n_heap_add_root(NHeap* self, NValue* root, NError* error);
+
+void
+n_heap_remove_root(NHeap* self, NValue* root);
+
+#endif /* N_E_HEAP_H */
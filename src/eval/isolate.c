@@ -0,0 +1,171 @@
+#include <stdlib.h>
+
+#include "../common/common.h"
+
+#include "isolate.h"
+
+static
+NErrorType ISOLATE_BUSY = { "nuvm.IsolateBusy" };
+
+static
+NErrorType* BAD_ALLOCATION = NULL;
+
+static void
+trace_roots(NHeap* heap, void* data);
+
+
+void
+ni_init_isolates(NError* error) {
+#define EC ON_ERROR(error, return)
+    n_register_error_type(&ISOLATE_BUSY, error);                     EC;
+
+    BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);      EC;
+#undef EC
+}
+
+
+NIsolate*
+n_create_isolate(NError* error) {
+    NIsolate *self = malloc(sizeof(NIsolate));
+    if (self == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate isolate.");
+        return NULL;
+    }
+
+    self->types = n_create_type_registry(error);
+    if (!n_is_ok(error)) {
+        free(self);
+        return NULL;
+    }
+
+    n_construct_arena(&self->arena, N_HEAP_BLOCK_SIZE);
+    n_construct_heap(&self->heap, trace_roots, self);
+    self->modules = NULL;
+    self->evaluators = NULL;
+    n_construct_mutex(&self->pin_lock);
+    self->owner = n_current_thread();
+    self->entered = 0;
+    return self;
+}
+
+
+void
+n_destroy_isolate(NIsolate* self) {
+    NModule *module;
+    NEvaluator *evaluator;
+    if (self == NULL) {
+        return;
+    }
+
+    evaluator = self->evaluators;
+    while (evaluator != NULL) {
+        NEvaluator *next = evaluator->next_evaluator;
+        evaluator->isolate = NULL;
+        evaluator->next_evaluator = NULL;
+        evaluator = next;
+    }
+
+    /* The modules themselves live in the arena, only what they keep
+     * outside of it has to be released. */
+    module = self->modules;
+    while (module != NULL) {
+        n_destroy_module(module);
+        module = module->next_module;
+    }
+
+    n_destruct_heap(&self->heap);
+
+    n_destruct_arena(&self->arena);
+    n_destroy_type_registry(self->types);
+    n_destruct_mutex(&self->pin_lock);
+    free(self);
+}
+
+
+void*
+n_isolate_allocate(NIsolate* self, size_t size, NError* error) {
+    void *memory = n_arena_allocate(&self->arena, size);
+    if (memory == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to grow the arena of an "
+                    "isolate.");
+    }
+    return memory;
+}
+
+
+void
+n_enter_isolate(NIsolate* self, NError* error) {
+    NThreadId current = n_current_thread();
+
+    n_lock(&self->pin_lock);
+    if (self->entered > 0 && !n_same_thread(self->owner, current)) {
+        n_set_error(error, &ISOLATE_BUSY, "The isolate is pinned to "
+                    "another thread.");
+    }
+    else {
+        self->owner = current;
+        self->entered++;
+    }
+    n_unlock(&self->pin_lock);
+}
+
+
+void
+n_exit_isolate(NIsolate* self) {
+    n_lock(&self->pin_lock);
+    if (self->entered > 0) {
+        self->entered--;
+    }
+    n_unlock(&self->pin_lock);
+}
+
+
+void
+n_isolate_register_type(NIsolate* self, NType* type, NError* error) {
+    n_registry_register_type(self->types, type, error);
+}
+
+
+NType*
+n_isolate_find_type(NIsolate* self, const char* name, NError* error) {
+    return n_registry_find_type(self->types, name, error);
+}
+
+
+void
+ni_isolate_attach_evaluator(NIsolate* self, NEvaluator* evaluator) {
+    evaluator->isolate = self;
+    evaluator->next_evaluator = self->evaluators;
+    self->evaluators = evaluator;
+}
+
+
+void
+ni_isolate_detach_evaluator(NIsolate* self, NEvaluator* evaluator) {
+    NEvaluator **link = &self->evaluators;
+    while (*link != NULL) {
+        if (*link == evaluator) {
+            *link = evaluator->next_evaluator;
+            break;
+        }
+        link = &(*link)->next_evaluator;
+    }
+    evaluator->isolate = NULL;
+    evaluator->next_evaluator = NULL;
+}
+
+
+static void
+trace_roots(NHeap* heap, void* data) {
+    NIsolate *self = data;
+    NModule *module;
+    NEvaluator *evaluator;
+    for (module = self->modules; module != NULL;
+         module = module->next_module) {
+        ni_trace_module(module, heap);
+    }
+    for (evaluator = self->evaluators; evaluator != NULL;
+         evaluator = evaluator->next_evaluator) {
+        ni_trace_evaluator(evaluator, heap);
+    }
+}
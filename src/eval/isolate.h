@@ -0,0 +1,91 @@
+#ifndef N_E_ISOLATE_H
+#define N_E_ISOLATE_H
+
+#include <stddef.h>
+
+#include "../common/arena.h"
+#include "../common/errors.h"
+#include "../common/threads.h"
+
+#include "type-registry.h"
+#include "modules.h"
+#include "heap.h"
+#include "evaluator.h"
+
+/* The blocks of the arena of an isolate are at least this big, see
+ * NArena. */
+#ifndef N_HEAP_BLOCK_SIZE
+#define N_HEAP_BLOCK_SIZE (64 * 1024)
+#endif
+
+typedef struct NIsolate NIsolate;
+
+/* Holds the state of a tenant of the VM: the modules created in it, the
+ * objects allocated for them and the types it registers. Nothing in an
+ * isolate is shared with other isolates, and nothing in it is locked, so
+ * each one can be used from its own thread without contention. What is
+ * still shared is read-only once n_init_eval returned: the built-in types,
+ * the error types and the singletons, which are immediate constants.
+ *
+ * Modules are kept in an arena, which is only freed when the isolate is
+ * destroyed. Objects are kept in a heap,
+ * whose roots are the globals of the modules, the evaluators attached to
+ * the isolate and the roots added by the host. Objects must not be shared
+ * between isolates. */
+struct NIsolate {
+    /* Holds what n_isolate_allocate hands out, including the modules
+     * created in the isolate, but not their decoded streams. The heap
+     * counts the bytes of objects on its own. */
+    NArena arena;
+    NHeap heap;
+    NTypeRegistry *types;
+    NModule *modules;
+    NEvaluator *evaluators;
+
+    NMutex pin_lock;
+    NThreadId owner;
+    int entered;
+};
+
+
+void
+ni_init_isolates(NError* error);
+
+NIsolate*
+n_create_isolate(NError* error);
+
+/* Destroys the modules of the isolate and frees its arena and its heap.
+ * Nothing allocated in it may be used afterwards, but the evaluators
+ * attached to it can still be prepared for other modules. */
+void
+n_destroy_isolate(NIsolate* self);
+
+/* Returns memory aligned for any value, which lives as long as the
+ * isolate does. Objects are allocated with n_allocate_object instead. */
+void*
+n_isolate_allocate(NIsolate* self, size_t size, NError* error);
+
+/* Pins the isolate to the calling thread until it exits it as many times
+ * as it entered it. Fails with nuvm.IsolateBusy while another thread has
+ * it pinned. Only the thread an isolate is pinned to may use it. */
+void
+n_enter_isolate(NIsolate* self, NError* error);
+
+void
+n_exit_isolate(NIsolate* self);
+
+/* Types registered in an isolate are only found through it, see
+ * n_create_type_registry. */
+void
+n_isolate_register_type(NIsolate* self, NType* type, NError* error);
+
+NType*
+n_isolate_find_type(NIsolate* self, const char* name, NError* error);
+
+void
+ni_isolate_attach_evaluator(NIsolate* self, NEvaluator* evaluator);
+
+void
+ni_isolate_detach_evaluator(NIsolate* self, NEvaluator* evaluator);
+
+#endif /* N_E_ISOLATE_H */
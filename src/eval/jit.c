@@ -0,0 +1,639 @@
+/* Needed for MAP_ANONYMOUS when building as C89. */
+#define _DEFAULT_SOURCE
+
+#include <string.h>
+
+#include "../common/common.h"
+#include "../common/opcodes.h"
+
+#include "jit.h"
+#include "modules.h"
+#include "singletons.h"
+
+#ifdef N_JIT_ENABLED
+#include <sys/mman.h>
+
+#include "../common/instruction-decoders.h"
+#endif
+
+static
+NErrorType* BAD_ALLOCATION = NULL;
+
+static
+uint32_t THRESHOLD = N_JIT_DEFAULT_THRESHOLD;
+
+
+void
+ni_init_jit(NError* error) {
+#define EC ON_ERROR(error, return)
+    BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);    EC;
+#undef EC
+}
+
+
+uint32_t
+n_get_jit_threshold(void) {
+    return THRESHOLD;
+}
+
+
+void
+n_set_jit_threshold(uint32_t threshold) {
+    THRESHOLD = threshold;
+}
+
+
+void
+n_destroy_code_cache(NCodeCache* self) {
+    if (self != NULL) {
+#ifdef N_JIT_ENABLED
+        if (self->memory != NULL) {
+            munmap(self->memory, N_CODE_CACHE_SIZE);
+        }
+#endif
+        free(self->entries);
+        free(self);
+    }
+}
+
+
+#ifndef N_JIT_ENABLED
+int
+n_jit_compile(NModule* module, NProcedure* proc, NError* error) {
+    return 0;
+}
+
+
+uint32_t
+n_run_native_code(NCodeCache* cache, uint32_t pc, NValue* locals,
+                  NValue* globals, uint32_t* fuel) {
+    return pc;
+}
+#else
+
+typedef uint32_t (*NNativeCode)(NValue*, NValue*, const unsigned char*,
+                                uint32_t*);
+
+typedef struct NEmitter NEmitter;
+typedef struct NFixup NFixup;
+
+/* A rel32 operand at the given offset of the cache, to be patched with the
+ * address of the native code for pc, or with an exit to the interpreter at
+ * pc when there is no native code for it or only_exit is set. Backward
+ * jumps spend fuel on the way. */
+struct NFixup {
+    uint32_t at;
+    uint32_t pc;
+    int only_exit;
+    int backward;
+};
+
+struct NEmitter {
+    NCodeCache *cache;
+    uint32_t pos;
+    uint32_t pc;
+    int overflow;
+    NFixup *fixups;
+    uint32_t num_fixups;
+};
+
+/* The code cache starts with the code that enters and leaves native code.
+ * The entry code saves the registers used by the templates, loads them
+ * with the locals, globals and fuel counter and jumps to the native code
+ * for the first instruction. Exits put the pc to go on from in eax and
+ * jump to the leaving code, which restores the registers and returns it.
+ *
+ * Templates keep the locals in rbx, the globals in r12 and the address of
+ * the fuel counter in r13, and use rax, rcx, rdx and rsi as scratch
+ * registers. */
+static const unsigned char ENTER_CODE[] = {
+    0x53,                               /* push rbx */
+    0x41, 0x54,                         /* push r12 */
+    0x41, 0x55,                         /* push r13 */
+    0x48, 0x89, 0xFB,                   /* mov rbx, rdi */
+    0x49, 0x89, 0xF4,                   /* mov r12, rsi */
+    0x49, 0x89, 0xCD,                   /* mov r13, rcx */
+    0xFF, 0xE2                          /* jmp rdx */
+};
+
+static const unsigned char LEAVE_CODE[] = {
+    0x41, 0x5D,                         /* pop r13 */
+    0x41, 0x5C,                         /* pop r12 */
+    0x5B,                               /* pop rbx */
+    0xC3                                /* ret */
+};
+
+#define LEAVE_OFFSET sizeof(ENTER_CODE)
+#define CODE_START   (sizeof(ENTER_CODE) + sizeof(LEAVE_CODE))
+
+static NCodeCache*
+create_code_cache(uint32_t code_size, NError* error);
+
+static void
+emit_instruction(NEmitter* self, unsigned char* code, uint32_t pc);
+
+static void
+emit_bytes(NEmitter* self, const unsigned char* bytes, uint32_t size);
+
+static void
+emit_u8(NEmitter* self, uint8_t value);
+
+static void
+emit_u32(NEmitter* self, uint32_t value);
+
+static void
+emit_local(NEmitter* self, uint8_t opcode, uint8_t modrm, uint8_t index);
+
+static void
+emit_jump_to(NEmitter* self, uint8_t opcode, uint32_t pc, int only_exit);
+
+static uint32_t
+jump_target(NEmitter* self, uint32_t pc, int16_t offset);
+
+static void
+emit_fixnum_check(NEmitter* self, uint32_t pc);
+
+static void
+emit_range_check(NEmitter* self, uint32_t pc);
+
+static void
+emit_exit(NEmitter* self, uint32_t pc);
+
+static void
+resolve_fixups(NEmitter* self, uint32_t begin, uint32_t end);
+
+static uint32_t
+emit_fuel_stub(NEmitter* self, uint32_t pc, uint32_t target);
+
+static void
+patch_rel32(NEmitter* self, uint32_t at, uint32_t target);
+
+
+int
+n_jit_compile(NModule* module, NProcedure* proc, NError* error) {
+    NCodeCache *cache = module->code_cache;
+    NEmitter emitter;
+    uint32_t pc, start, end;
+
+    if (proc->entry >= module->code_size) {
+        return 0;
+    }
+    if (cache == NULL) {
+        cache = module->code_cache =
+            create_code_cache(module->code_size, error);
+        if (cache == NULL) {
+            return 0;
+        }
+    }
+    if (cache->entries[proc->entry] != NULL) {
+        return 1;
+    }
+    if (cache->full) {
+        return 0;
+    }
+
+    start = proc->entry;
+    end = start + proc->size;
+    if (end > module->code_size) {
+        end = module->code_size;
+    }
+
+    /* No instruction adds more than two fixups per byte of its code. */
+    emitter.cache = cache;
+    emitter.pos = cache->used;
+    emitter.overflow = 0;
+    emitter.num_fixups = 0;
+    emitter.fixups = malloc(sizeof(NFixup) * 2 * (end - start));
+    if (emitter.fixups == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate the fixups "
+                    "of a compiled procedure.");
+        return 0;
+    }
+
+    if (mprotect(cache->memory, N_CODE_CACHE_SIZE,
+                 PROT_READ | PROT_WRITE) != 0) {
+        cache->full = 1;
+        free(emitter.fixups);
+        return 0;
+    }
+
+    /* Procedures are compiled from their raw code rather than from the
+     * decoded stream, so fused opcodes never show up here. Anything after
+     * the first instruction that can't be decoded is left to the
+     * interpreter. */
+    pc = start;
+    while (pc < end) {
+        uint8_t opcode = module->code[pc];
+        uint32_t size = n_get_opcode_size((NOpcode) opcode);
+        if (size > 0 && pc + size <= module->code_size
+                && (opcode == N_OP_CALL || opcode == N_OP_TAIL_CALL)) {
+            size += module->code[pc + 3 - (opcode == N_OP_TAIL_CALL)];
+        }
+        if (size == 0 || pc + size > module->code_size) {
+            break;
+        }
+        emit_instruction(&emitter, module->code, pc);
+        pc += size;
+    }
+    /* Falling off the end of the compiled code goes back to the
+     * interpreter. */
+    emit_exit(&emitter, pc);
+    resolve_fixups(&emitter, start, end);
+
+    if (emitter.overflow) {
+        for (pc = start; pc < end; pc++) {
+            cache->entries[pc] = NULL;
+        }
+        cache->full = 1;
+    }
+    else {
+        cache->used = emitter.pos;
+    }
+
+    /* None of the native code can run when the cache can't be made
+     * executable again, so the whole module is left to the interpreter. */
+    if (mprotect(cache->memory, N_CODE_CACHE_SIZE,
+                 PROT_READ | PROT_EXEC) != 0) {
+        memset(cache->entries, 0,
+               sizeof(unsigned char*) * (cache->code_size + 1));
+        cache->full = 1;
+    }
+    free(emitter.fixups);
+    return cache->entries[proc->entry] != NULL;
+}
+
+
+uint32_t
+n_run_native_code(NCodeCache* cache, uint32_t pc, NValue* locals,
+                  NValue* globals, uint32_t* fuel) {
+    /* ISO C has no conversion from object to function pointers. */
+    NNativeCode native;
+    unsigned char *enter = cache->memory;
+    memcpy(&native, &enter, sizeof(native));
+    return native(locals, globals, cache->entries[pc], fuel);
+}
+
+
+static NCodeCache*
+create_code_cache(uint32_t code_size, NError* error) {
+    NCodeCache *self = malloc(sizeof(NCodeCache));
+    if (self == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate code cache.");
+        return NULL;
+    }
+    self->memory = NULL;
+    self->used = CODE_START;
+    self->full = 0;
+    self->code_size = code_size;
+
+    self->entries = calloc(code_size + 1, sizeof(unsigned char*));
+    if (self->entries == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate code cache.");
+        n_destroy_code_cache(self);
+        return NULL;
+    }
+
+    self->memory = mmap(NULL, N_CODE_CACHE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (self->memory == MAP_FAILED) {
+        self->memory = NULL;
+        n_set_error(error, BAD_ALLOCATION, "Unable to map code cache.");
+        n_destroy_code_cache(self);
+        return NULL;
+    }
+    memcpy(self->memory, ENTER_CODE, sizeof(ENTER_CODE));
+    memcpy(self->memory + LEAVE_OFFSET, LEAVE_CODE, sizeof(LEAVE_CODE));
+    /* A cache that can't be made executable is kept, but never filled. */
+    if (mprotect(self->memory, N_CODE_CACHE_SIZE,
+                 PROT_READ | PROT_EXEC) != 0) {
+        self->full = 1;
+    }
+    return self;
+}
+
+
+/* Emits the template for a single instruction, which falls through to the
+ * one emitted right after it. Instructions that always need the
+ * interpreter are emitted as a plain exit, and are not given an entry, so
+ * the interpreter never enters native code at them. */
+static void
+emit_instruction(NEmitter* self, unsigned char* code, uint32_t pc) {
+    unsigned char *stream = code + pc;
+    uint8_t opcode = stream[0];
+
+    self->cache->entries[pc] = self->cache->memory + self->pos;
+    self->pc = pc;
+
+    switch (opcode) {
+        case N_OP_NOP:
+            break;
+        case N_OP_LOAD_I16: {
+            uint8_t dest;
+            int16_t value;
+            n_decode_op_load_i16(stream, &dest, &value);
+            /* mov qword [rbx + dest], value */
+            emit_local(self, 0xC7, 0x83, dest);
+            emit_u32(self, (uint32_t) n_wrap_fixnum(value));
+            break;
+        }
+        case N_OP_JUMP: {
+            int16_t offset;
+            n_decode_op_jump(stream, &offset);
+            emit_jump_to(self, 0xE9, jump_target(self, pc, offset), 0);
+            break;
+        }
+        case N_OP_JUMP_UNLESS: {
+            uint8_t cond;
+            int16_t offset;
+            n_decode_op_jump_unless(stream, &cond, &offset);
+            emit_local(self, 0x8B, 0x83, cond);       /* mov rax, cond */
+            emit_u8(self, 0x48);                      /* cmp rax, N_TRUE */
+            emit_u8(self, 0x3D);
+            emit_u32(self, (uint32_t) N_TRUE);
+            /* je target */
+            emit_jump_to(self, 0x84, jump_target(self, pc, offset), 0);
+            emit_u8(self, 0x48);                      /* cmp rax, N_FALSE */
+            emit_u8(self, 0x3D);
+            emit_u32(self, (uint32_t) N_FALSE);
+            emit_jump_to(self, 0x85, pc, 1);          /* jne exit */
+            break;
+        }
+        case N_OP_GLOBAL_REF: {
+            uint8_t dest;
+            uint16_t source;
+            static const unsigned char LOAD[] = { 0x49, 0x8B, 0x84, 0x24 };
+            static const unsigned char KIND[] = {
+                0x89, 0xC1,                     /* mov ecx, eax */
+                0x83, 0xE1, N_KIND_MASK,        /* and ecx, N_KIND_MASK */
+                0x83, 0xF9, N_LAZY_KIND         /* cmp ecx, N_LAZY_KIND */
+            };
+            n_decode_op_global_ref(stream, &dest, &source);
+            emit_bytes(self, LOAD, sizeof(LOAD));     /* mov rax, global */
+            emit_u32(self, source * sizeof(NValue));
+            /* Lazy globals are left to the interpreter to create. */
+            emit_bytes(self, KIND, sizeof(KIND));
+            emit_jump_to(self, 0x84, pc, 1);          /* je exit */
+            emit_local(self, 0x89, 0x83, dest);       /* mov dest, rax */
+            break;
+        }
+        case N_OP_GLOBAL_SET: {
+            uint16_t dest;
+            uint8_t source;
+            static const unsigned char STORE[] = { 0x49, 0x89, 0x84, 0x24 };
+            n_decode_op_global_set(stream, &dest, &source);
+            emit_local(self, 0x8B, 0x83, source);     /* mov rax, source */
+            emit_bytes(self, STORE, sizeof(STORE));   /* mov global, rax */
+            emit_u32(self, dest * sizeof(NValue));
+            break;
+        }
+        case N_OP_ADD:
+        case N_OP_SUB:
+        case N_OP_MUL: {
+            static const unsigned char ADD[] = { 0x48, 0x01, 0xC8 };
+            static const unsigned char SUB[] = { 0x48, 0x29, 0xC8 };
+            static const unsigned char MUL[] = {
+                0x48, 0xD1, 0xF8,               /* sar rax, 1 */
+                0x48, 0x0F, 0xAF, 0xC1          /* imul rax, rcx */
+            };
+            uint8_t dest, left, right;
+            n_decode_op_arithmetic(stream, &dest, &left, &right);
+            emit_local(self, 0x8B, 0x83, left);       /* mov rax, left */
+            emit_local(self, 0x8B, 0x8B, right);      /* mov rcx, right */
+            emit_fixnum_check(self, pc);
+            if (opcode == N_OP_ADD) {
+                emit_bytes(self, ADD, sizeof(ADD));
+            }
+            else if (opcode == N_OP_SUB) {
+                emit_bytes(self, SUB, sizeof(SUB));
+            }
+            else {
+                emit_bytes(self, MUL, sizeof(MUL));
+                emit_jump_to(self, 0x80, pc, 1);      /* jo exit */
+            }
+            emit_range_check(self, pc);
+            emit_local(self, 0x89, 0x83, dest);       /* mov dest, rax */
+            break;
+        }
+        case N_OP_LT:
+        case N_OP_LE:
+        case N_OP_EQ: {
+            static const unsigned char CMP[] = { 0x48, 0x39, 0xC8 };
+            static const unsigned char TO_BOOLEAN[] = {
+                0x0F, 0xB6, 0xC0,               /* movzx eax, al */
+                0xC1, 0xE0, N_PAYLOAD_SHIFT,    /* shl eax, shift */
+                0x83, 0xC0, N_BOOLEAN_KIND      /* add eax, kind */
+            };
+            uint8_t dest, left, right;
+            n_decode_op_arithmetic(stream, &dest, &left, &right);
+            emit_local(self, 0x8B, 0x83, left);       /* mov rax, left */
+            emit_local(self, 0x8B, 0x8B, right);      /* mov rcx, right */
+            emit_fixnum_check(self, pc);
+            emit_bytes(self, CMP, sizeof(CMP));       /* cmp rax, rcx */
+            emit_u8(self, 0x0F);                      /* setcc al */
+            emit_u8(self, opcode == N_OP_LT ? 0x9C
+                        : opcode == N_OP_LE ? 0x9E : 0x94);
+            emit_u8(self, 0xC0);
+            emit_bytes(self, TO_BOOLEAN, sizeof(TO_BOOLEAN));
+            emit_local(self, 0x89, 0x83, dest);       /* mov dest, rax */
+            break;
+        }
+        case N_OP_JUMP_IF_LT:
+        case N_OP_JUMP_IF_LE:
+        case N_OP_JUMP_IF_EQ: {
+            static const unsigned char CMP[] = { 0x48, 0x39, 0xC8 };
+            uint8_t left, right;
+            int16_t offset;
+            n_decode_op_compare_and_jump(stream, &left, &right, &offset);
+            emit_local(self, 0x8B, 0x83, left);       /* mov rax, left */
+            emit_local(self, 0x8B, 0x8B, right);      /* mov rcx, right */
+            emit_fixnum_check(self, pc);
+            emit_bytes(self, CMP, sizeof(CMP));       /* cmp rax, rcx */
+            emit_jump_to(self, opcode == N_OP_JUMP_IF_LT ? 0x8C
+                             : opcode == N_OP_JUMP_IF_LE ? 0x8E : 0x84,
+                         jump_target(self, pc, offset), 0);   /* jcc target */
+            break;
+        }
+        case N_OP_JUMP_IF_FIXNUM_ZERO: {
+            uint8_t cond;
+            int16_t offset;
+            n_decode_op_jump_if_fixnum_zero(stream, &cond, &offset);
+            emit_local(self, 0x83, 0xBB, cond);       /* cmp cond, 0 */
+            emit_u8(self, 0);
+            /* je target */
+            emit_jump_to(self, 0x84, jump_target(self, pc, offset), 0);
+            break;
+        }
+        default:
+            self->cache->entries[pc] = NULL;
+            emit_exit(self, pc);
+            break;
+    }
+}
+
+
+static void
+emit_bytes(NEmitter* self, const unsigned char* bytes, uint32_t size) {
+    if (self->overflow || self->pos + size > N_CODE_CACHE_SIZE) {
+        self->overflow = 1;
+        return;
+    }
+    memcpy(self->cache->memory + self->pos, bytes, size);
+    self->pos += size;
+}
+
+
+static void
+emit_u8(NEmitter* self, uint8_t value) {
+    emit_bytes(self, &value, 1);
+}
+
+
+static void
+emit_u32(NEmitter* self, uint32_t value) {
+    unsigned char bytes[4];
+    bytes[0] = value & 0xFF;
+    bytes[1] = (value >> 8) & 0xFF;
+    bytes[2] = (value >> 16) & 0xFF;
+    bytes[3] = (value >> 24) & 0xFF;
+    emit_bytes(self, bytes, 4);
+}
+
+
+/* Emits a REX.W instruction with the given opcode and ModRM byte that
+ * addresses the local with the given index through rbx. */
+static void
+emit_local(NEmitter* self, uint8_t opcode, uint8_t modrm, uint8_t index) {
+    emit_u8(self, 0x48);
+    emit_u8(self, opcode);
+    emit_u8(self, modrm);
+    emit_u32(self, index * sizeof(NValue));
+}
+
+
+/* Emits a jmp, when opcode is 0xE9, or the two byte jcc with the given
+ * second byte, to the native code for pc. */
+static void
+emit_jump_to(NEmitter* self, uint8_t opcode, uint32_t pc, int only_exit) {
+    NFixup *fixup = self->fixups + self->num_fixups;
+    if (opcode != 0xE9) {
+        emit_u8(self, 0x0F);
+    }
+    emit_u8(self, opcode);
+    fixup->at = self->pos;
+    fixup->pc = pc;
+    fixup->only_exit = only_exit;
+    fixup->backward = !only_exit && pc <= self->pc;
+    self->num_fixups++;
+    emit_u32(self, 0);
+}
+
+
+/* Targets out of the code are clamped to its end, where the interpreter
+ * reports them, like the decoded stream does. */
+static uint32_t
+jump_target(NEmitter* self, uint32_t pc, int16_t offset) {
+    int32_t target = (int32_t) pc + offset;
+    if (target < 0 || (uint32_t) target >= self->cache->code_size) {
+        return self->cache->code_size;
+    }
+    return (uint32_t) target;
+}
+
+
+/* Leaves native code at pc unless both rax and rcx hold fixnums. */
+static void
+emit_fixnum_check(NEmitter* self, uint32_t pc) {
+    static const unsigned char CHECK[] = {
+        0x48, 0x89, 0xC2,                   /* mov rdx, rax */
+        0x48, 0x09, 0xCA,                   /* or rdx, rcx */
+        0xF6, 0xC2, 0x01                    /* test dl, 1 */
+    };
+    emit_bytes(self, CHECK, sizeof(CHECK));
+    emit_jump_to(self, 0x85, pc, 1);        /* jnz exit */
+}
+
+
+/* Leaves native code at pc unless the tagged value in rax holds a fixnum
+ * in range. */
+static void
+emit_range_check(NEmitter* self, uint32_t pc) {
+    static const unsigned char CHECK[] = {
+        0x48, 0x89, 0xC2,                   /* mov rdx, rax */
+        0x48, 0xD1, 0xFA,                   /* sar rdx, 1 */
+        0x48, 0x63, 0xF2,                   /* movsxd rsi, edx */
+        0x48, 0x39, 0xD6                    /* cmp rsi, rdx */
+    };
+    emit_bytes(self, CHECK, sizeof(CHECK));
+    emit_jump_to(self, 0x85, pc, 1);        /* jne exit */
+}
+
+
+static void
+emit_exit(NEmitter* self, uint32_t pc) {
+    emit_u8(self, 0xB8);                    /* mov eax, pc */
+    emit_u32(self, pc);
+    emit_u8(self, 0xE9);                    /* jmp leave */
+    emit_u32(self, 0);
+    if (!self->overflow) {
+        patch_rel32(self, self->pos - 4, LEAVE_OFFSET);
+    }
+}
+
+
+/* Jumps to instructions of the procedure that were compiled go straight to
+ * their native code, or through a fuel stub when they go backward. All
+ * others get an exit to the interpreter. */
+static void
+resolve_fixups(NEmitter* self, uint32_t begin, uint32_t end) {
+    NCodeCache *cache = self->cache;
+    uint32_t i;
+    for (i = 0; i < self->num_fixups && !self->overflow; i++) {
+        NFixup *fixup = self->fixups + i;
+        uint32_t target = self->pos;
+        if (!fixup->only_exit && fixup->pc >= begin && fixup->pc < end
+                && cache->entries[fixup->pc] != NULL) {
+            target = cache->entries[fixup->pc] - cache->memory;
+            if (fixup->backward) {
+                target = emit_fuel_stub(self, fixup->pc, target);
+            }
+        }
+        else {
+            emit_exit(self, fixup->pc);
+        }
+        if (!self->overflow) {
+            patch_rel32(self, fixup->at, target);
+        }
+    }
+}
+
+
+/* Emits code that spends a unit of fuel and jumps to the given offset of
+ * the cache, or leaves native code at pc when the fuel runs out. Returns
+ * the offset of the stub. */
+static uint32_t
+emit_fuel_stub(NEmitter* self, uint32_t pc, uint32_t target) {
+    static const unsigned char SPEND[] = {
+        0x41, 0x83, 0x6D, 0x00, 0x01,       /* sub dword [r13], 1 */
+        0x0F, 0x85                          /* jnz target */
+    };
+    uint32_t stub = self->pos;
+    emit_bytes(self, SPEND, sizeof(SPEND));
+    emit_u32(self, 0);
+    if (!self->overflow) {
+        patch_rel32(self, self->pos - 4, target);
+    }
+    emit_exit(self, pc);
+    return stub;
+}
+
+
+static void
+patch_rel32(NEmitter* self, uint32_t at, uint32_t target) {
+    uint32_t rel = target - (at + 4);
+    unsigned char *bytes = self->cache->memory + at;
+    bytes[0] = rel & 0xFF;
+    bytes[1] = (rel >> 8) & 0xFF;
+    bytes[2] = (rel >> 16) & 0xFF;
+    bytes[3] = (rel >> 24) & 0xFF;
+}
+#endif /* N_JIT_ENABLED */
@@ -0,0 +1,82 @@
+#ifndef N_E_JIT_H
+#define N_E_JIT_H
+
+#include "../common/compatibility/stdint.h"
+#include "../common/errors.h"
+
+#include "values.h"
+#include "procedures.h"
+
+/* A baseline compiler for hot procedures. Each instruction is compiled by
+ * copying a fixed template of x86-64 machine code and patching its
+ * operands in, with no register allocation or optimization across
+ * instructions.
+ *
+ * Native code works on the same frames as the interpreter, reading and
+ * writing the locals and globals in place. Calls, tail-calls, returns and
+ * every slow path leave the native code with the pc of the instruction to
+ * run next, and the interpreter takes it from there. So the frames pushed
+ * by either of them are the ones op_call and op_return expect.
+ *
+ * The compiler is only built in when N_JIT is defined, and only on x86-64
+ * Linux. It is entered from the loop of n_evaluator_run, so N_DISPATCH_STEP
+ * leaves it out too. Everywhere else n_jit_compile never compiles anything,
+ * and the evaluator interprets all of the code. */
+#if defined(N_JIT) && !defined(N_DISPATCH_STEP) \
+ && defined(__x86_64__) && defined(__linux__)
+#  define N_JIT_ENABLED
+#endif
+
+/* Procedures are compiled when they have been called this many times by
+ * n_evaluator_run. */
+#define N_JIT_DEFAULT_THRESHOLD 1000
+
+/* The code cache of a module never grows, procedures that don't fit in it
+ * are left to the interpreter. */
+#define N_CODE_CACHE_SIZE (256 * 1024)
+
+typedef struct NCodeCache NCodeCache;
+
+/* Executable memory holding the native code compiled for a module, which
+ * owns it. Entries has one element for each byte offset of the module's
+ * code, plus one, set to the native code for the instruction at that
+ * offset, or NULL when it hasn't been compiled. Nothing more is compiled
+ * once the cache is full, or its protection couldn't be changed. */
+struct NCodeCache {
+    unsigned char *memory;
+    uint32_t used;
+    int full;
+    const unsigned char **entries;
+    uint32_t code_size;
+};
+
+
+void
+ni_init_jit(NError* error);
+
+uint32_t
+n_get_jit_threshold(void);
+
+void
+n_set_jit_threshold(uint32_t threshold);
+
+/* Compiles the given procedure into the code cache of its module, creating
+ * it if needed. Returns whether the entry of the procedure has native code
+ * afterwards. Running out of room in the code cache is not an error, the
+ * procedure is just not compiled. */
+int
+n_jit_compile(NModule* module, NProcedure* proc, NError* error);
+
+/* Runs the native code for the instruction at pc, which must have an entry
+ * in the cache, until it needs the interpreter. Backward jumps spend a unit
+ * of the given fuel each, and leave native code at their target when it
+ * runs out. Returns the pc of the instruction the interpreter must run
+ * next. */
+uint32_t
+n_run_native_code(NCodeCache* cache, uint32_t pc, NValue* locals,
+                  NValue* globals, uint32_t* fuel);
+
+void
+n_destroy_code_cache(NCodeCache* self);
+
+#endif /* N_E_JIT_H */
@@ -1,3 +1,5 @@
+#include <string.h>
+
 #include "../common/common.h"
 #include "../common/errors.h"
 #include "../common/byte-readers.h"
@@ -11,9 +13,29 @@ NErrorType* INVALID_MODULE_FORMAT = NULL;
 static
 NErrorType* UNEXPECTED_EOF = NULL;
 
+static
+NErrorType* ILLEGAL_ARGUMENT = NULL;
+
 static NValue
 read_global(NByteReader* reader, NModule* module, NError* error);
 
+static int
+check_image_global(const unsigned char* record, uint32_t code_size,
+                   NError* error);
+
+static NValue
+image_global(const unsigned char* record, NModule* module, NError* error);
+
+static void
+write_image_global(NByteWriter* writer, NModule* module, uint16_t index,
+                   NError* error);
+
+static uint16_t
+image_u16(const unsigned char* bytes);
+
+static uint32_t
+image_u32(const unsigned char* bytes);
+
 void
 ni_init_loader(NError* error) {
 #define EC ON_ERROR(error, return)
@@ -21,29 +43,55 @@ ni_init_loader(NError* error) {
         n_error_type("nuvm.InvalidModuleFormat", error);           EC;
 
     UNEXPECTED_EOF = n_error_type("nuvm.UnexpectedEoF", error);    EC;
+
+    ILLEGAL_ARGUMENT = n_error_type("nuvm.IllegalArgument", error); EC;
 #undef EC
 }
 
 
 NModule*
 n_read_module(NByteReader* reader, NError* error) {
+    return n_read_module_in(NULL, reader, error);
+}
+
+
+/* The code of a module read from a file is left in the mapping of the
+ * file, which the module then keeps. */
+NModule*
+n_read_module_in(NIsolate* isolate, NByteReader* reader, NError* error) {
 #define EC ON_ERROR_GOTO(error, clean_up)
     uint16_t num_globals;
     uint32_t code_size;
     uint16_t i;
     int bytes_read;
     NModule* module = NULL;
+    NMapping* mapping = n_byte_reader_mapping(reader);
 
     num_globals = n_read_uint16(reader, error);                EC;
     code_size = n_read_uint32(reader, error);                  EC;
 
-    module = n_create_module(num_globals, code_size, error);   EC;
+    module = n_create_module_in(isolate, num_globals,
+                                mapping != NULL ? 0 : code_size,
+                                error);                        EC;
 
     for (i = 0; i < num_globals; i++) {
         NValue global = read_global(reader, module, error);    EC;
         module->globals[i] = global;
     }
 
+    if (mapping != NULL) {
+        if (code_size > 0x7FFFFFFF) {
+            n_set_error(error, UNEXPECTED_EOF, "Not enough bytes in the "
+                        "stream to load the code for the module.");
+            goto clean_up;
+        }
+        module->code = n_map_bytes(reader, code_size, error);  EC;
+        module->code_size = code_size;
+        n_retain_mapping(mapping);
+        module->mapping = mapping;
+        return module;
+    }
+
     bytes_read =
         n_read_bytes(reader, module->code, code_size, error);  EC;
 
@@ -63,6 +111,228 @@ clean_up:
 }
 
 
+NModule*
+n_load_module_image(const void* image, size_t size, NMapping* mapping,
+                    int flags, NError* error) {
+    return n_load_module_image_in(NULL, image, size, mapping, flags, error);
+}
+
+
+/* The header, the section table and every global record are checked
+ * before the module is created, so lazy modules reject the same images.
+ * Every global is then created from its record, except for the
+ * procedures of lazy modules. */
+NModule*
+n_load_module_image_in(NIsolate* isolate, const void* image, size_t size,
+                       NMapping* mapping, int flags, NError* error) {
+#define EC ON_ERROR_GOTO(error, clean_up)
+    const unsigned char *bytes = image;
+    const unsigned char *globals = NULL;
+    const unsigned char *code = NULL;
+    uint32_t num_globals = 0;
+    uint32_t code_size = 0;
+    uint16_t num_sections;
+    uint32_t i;
+    NModule *module = NULL;
+
+    if (size < N_IMAGE_HEADER_SIZE
+        || memcmp(bytes, N_IMAGE_MAGIC, 4) != 0
+        || image_u16(bytes + 4) != N_IMAGE_VERSION) {
+        n_set_error(error, INVALID_MODULE_FORMAT, "Not a module image of a "
+                    "known version.");
+        return NULL;
+    }
+    num_sections = image_u16(bytes + 6);
+    if ((size - N_IMAGE_HEADER_SIZE) / N_IMAGE_SECTION_SIZE < num_sections) {
+        n_set_error(error, INVALID_MODULE_FORMAT, "The section table of "
+                    "the module image is truncated.");
+        return NULL;
+    }
+
+    for (i = 0; i < num_sections; i++) {
+        const unsigned char *section =
+            bytes + N_IMAGE_HEADER_SIZE + i * N_IMAGE_SECTION_SIZE;
+        uint32_t offset = image_u32(section + 4);
+        uint32_t section_size = image_u32(section + 8);
+        uint32_t count = image_u32(section + 12);
+
+        if (offset % N_IMAGE_ALIGNMENT != 0 || offset > size
+            || section_size > size - offset) {
+            n_set_error(error, INVALID_MODULE_FORMAT, "A section of the "
+                        "module image is misaligned or out of it.");
+            return NULL;
+        }
+        switch (image_u32(section)) {
+            case N_SECTION_GLOBALS:
+                if (count > 0xFFFF
+                    || section_size / N_IMAGE_GLOBAL_SIZE < count) {
+                    n_set_error(error, INVALID_MODULE_FORMAT, "The globals "
+                                "section is too small for its count.");
+                    return NULL;
+                }
+                globals = bytes + offset;
+                num_globals = count;
+                break;
+            case N_SECTION_CODE:
+                code = bytes + offset;
+                code_size = section_size;
+                break;
+        }
+    }
+
+    if (image_u32(bytes + 8) >= num_globals) {
+        n_set_error(error, INVALID_MODULE_FORMAT, "The entry point of the "
+                    "module image is not one of its globals.");
+        return NULL;
+    }
+    for (i = 0; i < num_globals; i++) {
+        if (!check_image_global(globals + i * N_IMAGE_GLOBAL_SIZE,
+                                code_size, error)) {
+            return NULL;
+        }
+    }
+
+    module = n_create_module_in(isolate, num_globals,
+                                mapping != NULL ? 0 : code_size,
+                                error);                        EC;
+    module->entry_point = image_u32(bytes + 8);
+    if ((flags & N_LOAD_LAZY_GLOBALS) && mapping != NULL) {
+        module->lazy_globals = globals;
+    }
+
+    for (i = 0; i < num_globals; i++) {
+        const unsigned char *record = globals + i * N_IMAGE_GLOBAL_SIZE;
+        NValue global;
+        if (module->lazy_globals != NULL && record[0] == 0x01) {
+            global = N_LAZY_GLOBAL;
+        }
+        else {
+            global = image_global(record, module, error);      EC;
+        }
+        module->globals[i] = global;
+    }
+
+    if (mapping != NULL) {
+        if (code != NULL) {
+            module->code = (unsigned char*) code;
+        }
+        module->code_size = code_size;
+        n_retain_mapping(mapping);
+        module->mapping = mapping;
+    }
+    else if (code_size > 0) {
+        memcpy(module->code, code, code_size);
+    }
+    return module;
+clean_up:
+    if (module != NULL) {
+        n_destroy_module(module);
+    }
+    return NULL;
+#undef EC
+}
+
+
+NModule*
+n_load_module_file(const char* path, int flags, NError* error) {
+    return n_load_module_file_in(NULL, path, flags, error);
+}
+
+
+NModule*
+n_load_module_file_in(NIsolate* isolate, const char* path, int flags,
+                      NError* error) {
+    NModule *module;
+    NMapping *mapping;
+    NByteReader *reader = n_new_byte_reader_from_file(path, error);
+    if (reader == NULL) {
+        return NULL;
+    }
+
+    mapping = n_byte_reader_mapping(reader);
+    if (mapping->size >= 4
+        && memcmp(mapping->data, N_IMAGE_MAGIC, 4) == 0) {
+        module = n_load_module_image_in(isolate, mapping->data,
+                                        mapping->size, mapping, flags,
+                                        error);
+    }
+    else {
+        module = n_read_module_in(isolate, reader, error);
+    }
+    n_destroy_byte_reader(reader, error);
+    return module;
+}
+
+
+NValue
+ni_materialize_global(NModule* module, uint16_t index, NError* error) {
+    NValue global = image_global(module->lazy_globals
+                                 + index * N_IMAGE_GLOBAL_SIZE,
+                                 module, error);
+    if (!n_is_ok(error)) {
+        return N_LAZY_GLOBAL;
+    }
+    module->globals[index] = global;
+    return global;
+}
+
+
+void
+ni_materialize_globals(NModule* module, NError* error) {
+    uint16_t i;
+    if (module->lazy_globals == NULL) {
+        return;
+    }
+    for (i = 0; i < module->num_globals; i++) {
+        if (n_is_lazy_global(module->globals[i])) {
+            ni_materialize_global(module, i, error);
+            if (!n_is_ok(error)) {
+                return;
+            }
+        }
+    }
+    module->lazy_globals = NULL;
+}
+
+
+/* The globals go right after the section table, which keeps them and the
+ * code after them aligned. */
+void
+n_write_module_image(NByteWriter* writer, NModule* module, NError* error) {
+#define EC ON_ERROR(error, return)
+    uint32_t globals_offset = N_IMAGE_HEADER_SIZE + 2 * N_IMAGE_SECTION_SIZE;
+    uint32_t globals_size = module->num_globals * N_IMAGE_GLOBAL_SIZE;
+    uint32_t code_offset = globals_offset + globals_size;
+    uint32_t i;
+
+    for (i = 0; i < 4; i++) {
+        n_write_byte(writer, N_IMAGE_MAGIC[i], error);                  EC;
+    }
+    n_write_uint16(writer, N_IMAGE_VERSION, error);                     EC;
+    n_write_uint16(writer, 2, error);                                   EC;
+    n_write_uint32(writer, module->entry_point, error);                 EC;
+    n_write_uint32(writer, 0, error);                                   EC;
+
+    n_write_uint32(writer, N_SECTION_GLOBALS, error);                   EC;
+    n_write_uint32(writer, globals_offset, error);                      EC;
+    n_write_uint32(writer, globals_size, error);                        EC;
+    n_write_uint32(writer, module->num_globals, error);                 EC;
+
+    n_write_uint32(writer, N_SECTION_CODE, error);                      EC;
+    n_write_uint32(writer, code_offset, error);                         EC;
+    n_write_uint32(writer, module->code_size, error);                   EC;
+    n_write_uint32(writer, 0, error);                                   EC;
+
+    for (i = 0; i < module->num_globals; i++) {
+        write_image_global(writer, module, i, error);                   EC;
+    }
+    for (i = 0; i < module->code_size; i++) {
+        n_write_byte(writer, module->code[i], error);                   EC;
+    }
+#undef EC
+}
+
+
 
 
 static NValue
@@ -109,6 +379,106 @@ read_global(NByteReader* reader, NModule* module, NError* error) {
 
 
 
+/* Checks what n_create_procedure would, and that the procedure starts
+ * inside the code. */
+static int
+check_image_global(const unsigned char* record, uint32_t code_size,
+                   NError* error) {
+    switch (record[0]) {
+        case 0x00:
+            return 1;
+        case 0x01:
+            if (image_u16(record + 8) == 0 || record[2] < record[1]
+                || image_u32(record + 4) >= code_size) {
+                n_set_error(error, INVALID_MODULE_FORMAT, "A procedure of "
+                            "the module image is malformed.");
+                return 0;
+            }
+            return 1;
+        default:
+            n_set_error(error, INVALID_MODULE_FORMAT,
+                    "Unrecognized global descriptor id.");
+            return 0;
+    }
+}
+
+
+static NValue
+image_global(const unsigned char* record, NModule* module, NError* error) {
+    switch (record[0]) {
+        case 0x00:
+            return n_wrap_fixnum((NFixnum) image_u32(record + 4));
+        case 0x01:
+            return n_create_procedure(module, image_u32(record + 4),
+                                      record[1], record[2],
+                                      image_u16(record + 8), error);
+        default:
+            n_set_error(error, INVALID_MODULE_FORMAT,
+                    "Unrecognized global descriptor id.");
+    }
+    return 0;
+}
+
+
+static void
+write_image_global(NByteWriter* writer, NModule* module, uint16_t index,
+                   NError* error) {
+#define EC ON_ERROR(error, return)
+    NValue global = module->globals[index];
+    int i;
+    if (n_is_lazy_global(global)) {
+        const unsigned char *record =
+            module->lazy_globals + index * N_IMAGE_GLOBAL_SIZE;
+        for (i = 0; i < N_IMAGE_GLOBAL_SIZE; i++) {
+            n_write_byte(writer, record[i], error);                     EC;
+        }
+        return;
+    }
+    if (n_is_fixnum(global)) {
+        n_write_uint32(writer, 0x00, error);                            EC;
+        n_write_int32(writer, n_unwrap_fixnum(global), error);          EC;
+        n_write_uint32(writer, 0, error);                               EC;
+        n_write_uint32(writer, 0, error);                               EC;
+        return;
+    }
+    if (n_is_procedure(global)) {
+        NProcedure *proc = (NProcedure*) n_unwrap_object(global);
+        if (proc->module == module) {
+            n_write_byte(writer, 0x01, error);                          EC;
+            n_write_byte(writer, proc->num_locals, error);              EC;
+            n_write_byte(writer, proc->max_locals, error);              EC;
+            n_write_byte(writer, 0, error);                             EC;
+            n_write_uint32(writer, proc->entry, error);                 EC;
+            n_write_uint16(writer, proc->size, error);                  EC;
+            for (i = 0; i < 6; i++) {
+                n_write_byte(writer, 0, error);                         EC;
+            }
+            return;
+        }
+    }
+    n_set_error(error, ILLEGAL_ARGUMENT, "Only fixnums and procedures of "
+                "the module can be written in its image.");
+#undef EC
+}
+
+
+static uint16_t
+image_u16(const unsigned char* bytes) {
+    return (uint16_t) (bytes[0] | (bytes[1] << 8));
+}
+
+
+static uint32_t
+image_u32(const unsigned char* bytes) {
+    return ((uint32_t) bytes[3] << 24)
+         + ((uint32_t) bytes[2] << 16)
+         + ((uint32_t) bytes[1] << 8)
+         + bytes[0];
+}
+
+
+
+
 #ifdef N_TEST
 
 NValue
@@ -4,14 +4,94 @@
 #include <stdlib.h>
 
 #include "../common/byte-readers.h"
+#include "../common/byte-writers.h"
 #include "modules.h"
+#include "isolate.h"
+
+/* Module images are laid out so that they can be used where they are,
+ * straight from a mapped file. Every number is little endian.
+ *
+ *   header, 16 bytes:  "NUVM", u16 version, u16 number of sections,
+ *                      u32 entry point, u32 reserved
+ *   sections, 16 bytes each: u32 kind, u32 offset, u32 size, u32 count
+ *
+ * Sections start at offsets that are multiples of N_IMAGE_ALIGNMENT. The
+ * globals section holds count records of N_IMAGE_GLOBAL_SIZE bytes:
+ *
+ *   fixnum:     u8 0x00, 3 reserved bytes, i32 value, 8 reserved bytes
+ *   procedure:  u8 0x01, u8 min locals, u8 max locals, a reserved byte,
+ *               u32 entry, u16 size, 6 reserved bytes
+ *
+ * The code section holds the code of the module. String pool and debug
+ * info sections are skipped by this version of the loader, as is any
+ * section of an unknown kind. */
+#define N_IMAGE_MAGIC "NUVM"
+#define N_IMAGE_VERSION 1
+#define N_IMAGE_HEADER_SIZE 16
+#define N_IMAGE_SECTION_SIZE 16
+#define N_IMAGE_GLOBAL_SIZE 16
+#define N_IMAGE_ALIGNMENT 16
+
+/* Leaves the procedures of an image mapped from a file to be created when
+ * first read, see ni_materialize_global. */
+#define N_LOAD_LAZY_GLOBALS 0x1
+
+#define N_SECTION_GLOBALS 1
+#define N_SECTION_CODE    2
+#define N_SECTION_STRINGS 3
+#define N_SECTION_DEBUG   4
 
 void
 ni_init_loader(NError* error);
 
+/* Readers of files, see n_new_byte_reader_from_file, lend the code of the
+ * module where it is: the module then keeps the file mapped until it is
+ * destroyed, instead of copying the code. */
 NModule*
 n_read_module(NByteReader* reader, NError* error);
 
+/* Reads the module into an isolate, see n_create_module_in. A module that
+ * fails to load still takes up room in the isolate until it is
+ * destroyed. */
+NModule*
+n_read_module_in(NIsolate* isolate, NByteReader* reader, NError* error);
+
+/* Loads a module image. Its code is used in place when the image lies in
+ * a mapping, which the module then retains, and copied otherwise. Flags
+ * are N_LOAD_LAZY_GLOBALS or 0, lazy globals also need a mapping. */
+NModule*
+n_load_module_image(const void* image, size_t size, NMapping* mapping,
+                    int flags, NError* error);
+
+NModule*
+n_load_module_image_in(NIsolate* isolate, const void* image, size_t size,
+                       NMapping* mapping, int flags, NError* error);
+
+/* Maps the file and loads the module in it, whether an image or in the
+ * format of n_read_module, which ignores the flags. */
+NModule*
+n_load_module_file(const char* path, int flags, NError* error);
+
+NModule*
+n_load_module_file_in(NIsolate* isolate, const char* path, int flags,
+                      NError* error);
+
+/* Creates the lazy global at the index from its record, and stores it in
+ * the globals of the module. Like any allocation, it may run a
+ * collection. */
+NValue
+ni_materialize_global(NModule* module, uint16_t index, NError* error);
+
+/* Creates every lazy global of the module, before it is shared by several
+ * threads or copied. */
+void
+ni_materialize_globals(NModule* module, NError* error);
+
+/* Writes the module as an image. Its globals must be fixnums or
+ * procedures of the module. */
+void
+n_write_module_image(NByteWriter* writer, NModule* module, NError* error);
+
 
 
 
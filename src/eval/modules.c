@@ -1,6 +1,14 @@
+#include <string.h>
+
 #include "../common/common.h"
+#include "../common/byte-readers.h"
 
 #include "modules.h"
+#include "isolate.h"
+#include "heap.h"
+#include "fusion.h"
+#include "jit.h"
+#include "procedures.h"
 
 static
 NErrorType* BAD_ALLOCATION = NULL;
@@ -15,47 +23,122 @@ ni_init_modules(NError* error) {
 
 NModule*
 n_create_module(uint16_t num_globals, uint32_t code_size, NError *error) {
-    NModule *self = malloc(sizeof(NModule));
-    if (self == NULL) {
-        n_set_error(error, BAD_ALLOCATION, "Unable to allocate module");
-        goto clean_up;
-    }
-    self->code = NULL;
-    self->globals = NULL;
+    return n_create_module_in(NULL, num_globals, code_size, error);
+}
 
-    self->code = malloc(sizeof(unsigned char) * code_size);
-    if (self->code == NULL) {
-        n_set_error(error, BAD_ALLOCATION, "Unable to allocate module");
-        goto clean_up;
-    }
 
-    self->globals = malloc(sizeof(NValue) * num_globals);
-    if (self->globals == NULL) {
+/* The globals come right after the module, and the code after them,
+ * unless it needs a block of its own. */
+NModule*
+n_create_module_in(NIsolate* isolate, uint16_t num_globals,
+                   uint32_t code_size, NError *error) {
+    NArena own_arena;
+    NArena *arena = isolate != NULL ? &isolate->arena : &own_arena;
+    NModule *self;
+    NValue *globals;
+    unsigned char *code;
+
+    n_construct_arena(&own_arena, N_MODULE_BLOCK_SIZE);
+    self = n_arena_allocate(arena, sizeof(NModule));
+    globals = n_arena_allocate(arena, sizeof(NValue) * num_globals);
+    code = n_arena_allocate(arena, sizeof(unsigned char) * code_size);
+    if (self == NULL || globals == NULL || code == NULL) {
         n_set_error(error, BAD_ALLOCATION, "Unable to allocate module");
-        goto clean_up;
+        n_destruct_arena(&own_arena);
+        return NULL;
     }
 
+    self->code = code;
+    self->globals = globals;
+    self->decoded = NULL;
+    self->code_cache = NULL;
+    self->frozen = 0;
+    self->isolate = isolate;
+    self->next_module = NULL;
+    self->mapping = NULL;
+    self->lazy_globals = NULL;
+    /* Only the module knows its arena from now on. */
+    self->arena = own_arena;
+
+    /* Globals are roots of the collector before anything is stored in
+     * them. */
+    memset(self->globals, 0, sizeof(NValue) * num_globals);
     self->code_size = code_size;
     self->num_globals = num_globals;
     self->entry_point = 0;
-    return self;
 
-clean_up:
-    n_destroy_module(self);
-    return NULL;
+    if (isolate != NULL) {
+        self->next_module = isolate->modules;
+        isolate->modules = self;
+    }
+    return self;
 }
 
 
 void
 n_destroy_module(NModule* self) {
     if (self != NULL) {
-        if (self->code != NULL) {
-            free(self->code);
+        n_destroy_decoded_stream(self->decoded);
+        self->decoded = NULL;
+        n_destroy_code_cache(self->code_cache);
+        self->code_cache = NULL;
+        n_release_mapping(self->mapping);
+        self->mapping = NULL;
+
+        if (self->isolate == NULL) {
+            /* The arena holds the module too. */
+            NArena arena = self->arena;
+            n_destruct_arena(&arena);
         }
-        if (self->globals != NULL) {
-            free(self->globals);
+    }
+}
+
+
+/* The callees cached by call sites are kept alive too, so that a call site
+ * never mistakes a new object for a collected one at the same address. */
+void
+ni_trace_module(NModule* self, NHeap* heap) {
+    uint32_t i;
+    int j;
+    for (i = 0; i < self->num_globals; i++) {
+        n_trace_value(heap, &self->globals[i]);
+    }
+    if (self->decoded != NULL) {
+        for (i = 0; i < self->decoded->num_call_sites; i++) {
+            NCallSite *site = self->decoded->call_sites + i;
+            for (j = 0; j < site->num_entries; j++) {
+                n_trace_value(heap, &site->entries[j].callee);
+            }
         }
+    }
+}
 
-        free(self);
+
+void
+n_predecode_module(NModule* self, NError *error) {
+    NDecodedStream *decoded =
+        n_decode_stream(self->code, self->code_size, error);
+    if (!n_is_ok(error)) {
+        return;
+    }
+
+    n_fuse_stream(decoded, n_get_active_fusions());
+
+    n_destroy_decoded_stream(self->decoded);
+    self->decoded = decoded;
+
+    /* Procedures in the globals may be compiled again once they get hot
+     * again. */
+    if (self->code_cache != NULL) {
+        uint16_t i;
+        for (i = 0; i < self->num_globals; i++) {
+            if (n_is_procedure(self->globals[i])) {
+                NProcedure *proc =
+                    (NProcedure*) n_unwrap_object(self->globals[i]);
+                proc->call_count = 0;
+            }
+        }
     }
+    n_destroy_code_cache(self->code_cache);
+    self->code_cache = NULL;
 }
@@ -3,9 +3,17 @@
 
 #include <stdlib.h>
 
+#include "../common/arena.h"
 #include "../common/errors.h"
 
 #include "values.h"
+#include "decoded-stream.h"
+
+/* The blocks of the arena of a module are at least this big, see
+ * NArena. */
+#ifndef N_MODULE_BLOCK_SIZE
+#define N_MODULE_BLOCK_SIZE (16 * 1024)
+#endif
 
 typedef struct NModule NModule;
 
@@ -16,18 +24,69 @@ struct NModule {
     NValue *globals;
     uint16_t num_globals;
     uint32_t entry_point;
+    NDecodedStream *decoded;
+    /* Native code compiled for hot procedures, see jit.h. */
+    struct NCodeCache *code_cache;
+    /* Set while evaluators on several threads may run the module. The run
+     * loop then only reads its decoded stream, leaving the call caches and
+     * the call counts of procedures as they are. */
+    int frozen;
+    /* The isolate the module was created in, if any, and the next module
+     * created in it. */
+    struct NIsolate *isolate;
+    NModule *next_module;
+    /* Holds the module itself, its globals, its code and the procedures
+     * created for it, unless it belongs to an isolate. */
+    NArena arena;
+    /* The file the code lives in instead, if it was loaded from one, see
+     * n_read_module. */
+    struct NMapping *mapping;
+    /* The records of the globals in the image the module was loaded from,
+     * when some of them are left to be created on first use, see
+     * ni_materialize_global. */
+    const unsigned char *lazy_globals;
 };
 
+/* Globals that hold this are created from the image of their module the
+ * first time they are read. */
+#define N_LAZY_GLOBAL n_make_constant(N_LAZY_KIND, 0)
+#define n_is_lazy_global(VALUE) (((VALUE) & N_KIND_MASK) == N_LAZY_KIND)
+
 
 void
 ni_init_modules(NError* error);
 
 
+/* The module is allocated in an arena of its own, along with its globals
+ * and code, so that the procedures created for it follow them. */
 NModule*
 n_create_module(uint16_t num_globals, uint32_t code_size, NError *error);
 
+/* Creates the module in the heap of an isolate, which the objects created
+ * for it are then allocated in too. It lives until the isolate is
+ * destroyed. */
+NModule*
+n_create_module_in(struct NIsolate* isolate, uint16_t num_globals,
+                   uint32_t code_size, NError *error);
+
+/* Frees the arena of the module, and the procedures created for it with
+ * it. Modules of an isolate keep their code and globals until the isolate
+ * is destroyed, only what lives outside of its arena is released. */
 void
 n_destroy_module(NModule* self);
 
+/* Traces the values in the globals of the module. */
+void
+ni_trace_module(NModule* self, struct NHeap* heap);
+
+/* Builds the decoded form of the module's code, used by n_evaluator_run.
+ * The evaluator does this on its own the first time it runs a module, but
+ * loaders can call it right after reading a module to pay the cost up
+ * front. The superinstructions enabled by n_set_active_fusions are applied
+ * to the result. It must be called again if the code is changed
+ * afterwards, which also drops any native code compiled for it. */
+void
+n_predecode_module(NModule* self, NError *error);
+
 
 #endif /* N_E_MODULE_H */
@@ -1,6 +1,8 @@
 #include "primitives.h"
 #include "type-registry.h"
 #include "values.h"
+#include "isolate.h"
+#include "heap.h"
 
 static
 NType _primitive_type;
@@ -9,32 +11,41 @@ static
 NErrorType* ILLEGAL_ARGUMENT = NULL;
 
 static
-NErrorType* BAD_ALLOCATION = NULL;
+NErrorType BLOCKED = { "nuvm.Blocked" };
 
 void
 ni_init_primitives(NError* error) {
 #define EC ON_ERROR(error, return)
 	n_construct_type(&_primitive_type, "nuvm.PrimitiveProcedure");
 	n_register_type(&_primitive_type, error);                        EC;
+	n_register_error_type(&BLOCKED, error);                          EC;
 
 	ILLEGAL_ARGUMENT = n_error_type("nuvm.IllegalArgument", error);  EC;
-	BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);      EC;
 #undef EC
 }
 
 NValue
 n_create_primitive(NPrimitiveFunc function, NError *error) {
+    return n_create_primitive_in(NULL, function, error);
+}
+
+
+NValue
+n_create_primitive_in(NIsolate* isolate, NPrimitiveFunc function,
+                      NError *error) {
     NPrimitive *primitive;
     if (function == NULL) {
         n_set_error(error, ILLEGAL_ARGUMENT, "Can't creat a NULL primitive.");
+        return 0;
     }
 
-    primitive = malloc(sizeof(NPrimitive));
+    primitive = (NPrimitive*) n_allocate_object(
+        isolate != NULL ? &isolate->heap : NULL, sizeof(NPrimitive),
+        &_primitive_type, error);
     if (primitive == NULL) {
-        n_set_error(error, BAD_ALLOCATION, "Unable to allocate primitive.");
+        return 0;
     }
 
-    primitive->object_header.type = &_primitive_type;
     primitive->func = function;
     return n_wrap_object((NObject*) primitive);
 }
@@ -42,7 +53,8 @@ n_create_primitive(NPrimitiveFunc function, NError *error) {
 int
 n_is_primitive(NValue value) {
     if (!n_is_immediate(value)) {
-        return ((NObject*) n_unwrap_object(value))->type == &_primitive_type;
+        return ((NObject*) n_unwrap_object(value))->type_id
+            == _primitive_type.id;
     }
     return 0;
 }
@@ -53,3 +65,13 @@ n_call_primitive(NValue primitive, int n_args, NValue *args, NError *error) {
 
     return func(n_args, args, error);
 }
+
+void
+n_block_primitive(NError *error) {
+    n_set_error(error, &BLOCKED, "The primitive is blocked.");
+}
+
+int
+n_is_blocked(NError *error) {
+    return error->type == &BLOCKED;
+}
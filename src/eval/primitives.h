@@ -8,6 +8,8 @@
 typedef struct NPrimitive NPrimitive;
 typedef NValue (*NPrimitiveFunc)(int, NValue*, NError*);
 
+struct NIsolate;
+
 struct NPrimitive {
     NObject object_header;
     NPrimitiveFunc func;
@@ -19,11 +21,26 @@ ni_init_primitives(NError* error);
 NValue
 n_create_primitive(NPrimitiveFunc function, NError *error);
 
+/* Creates the primitive in the heap of an isolate, see n_allocate_object. */
+NValue
+n_create_primitive_in(struct NIsolate* isolate, NPrimitiveFunc function,
+                      NError *error);
+
 int
 n_is_primitive(NValue);
 
 NValue
 n_call_primitive(NValue primitive, int n_args, NValue *args, NError *error);
 
+/* Primitives that can't complete yet, for instance because they wait on
+ * the host, fail with this error instead of returning. The evaluator then
+ * stops without halting, at the instruction that called the primitive, so
+ * that the call is made again the next time it runs. */
+void
+n_block_primitive(NError *error);
+
+int
+n_is_blocked(NError *error);
+
 #endif /* N_E_PRIMITIVES_H */
 
@@ -1,9 +1,8 @@
 #include "procedures.h"
 #include "values.h"
 #include "type-registry.h"
-
-static
-NErrorType* BAD_ALLOCATION = NULL;
+#include "isolate.h"
+#include "heap.h"
 
 static
 NErrorType* ILLEGAL_ARGUMENT = NULL;
@@ -18,7 +17,6 @@ ni_init_procedures(NError* error) {
 	n_construct_type(&_procedure_type, "nuvm.UserProcedure");
 	n_register_type(&_procedure_type, error);                        EC;
 
-	BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);      EC;
 	ILLEGAL_ARGUMENT = n_error_type("nuvm.IllegalArgument", error);  EC;
 #undef EC
 }
@@ -41,17 +39,25 @@ n_create_procedure(NModule* module, uint32_t entry, uint8_t num_locals,
         return 0;
     }
 
-    proc_ptr = malloc(sizeof(NProcedure));
+    if (module != NULL && module->isolate == NULL) {
+        proc_ptr = (NProcedure*) n_allocate_arena_object(
+            &module->arena, sizeof(NProcedure), &_procedure_type, error);
+    }
+    else {
+        proc_ptr = (NProcedure*) n_allocate_object(
+            module != NULL ? &module->isolate->heap : NULL,
+            sizeof(NProcedure), &_procedure_type, error);
+    }
     if (proc_ptr == NULL) {
-        n_set_error(error, BAD_ALLOCATION, "Unable to allocate procedure.");
         return 0;
     }
 
-    proc_ptr->object_header.type = &_procedure_type;
+    proc_ptr->module = module;
     proc_ptr->entry = entry;
     proc_ptr->num_locals = num_locals;
     proc_ptr->max_locals = max_locals;
     proc_ptr->size = size;
+    proc_ptr->call_count = 0;
     return n_wrap_object((NObject*)proc_ptr);
 }
 
@@ -59,7 +65,8 @@ n_create_procedure(NModule* module, uint32_t entry, uint8_t num_locals,
 int
 n_is_procedure(NValue value) {
     if (!n_is_immediate(value)) {
-        return ((NObject*) n_unwrap_object(value))->type == &_procedure_type;
+        return ((NObject*) n_unwrap_object(value))->type_id
+            == _procedure_type.id;
     }
     return 0;
 }
@@ -14,11 +14,16 @@ struct NProcedure {
     uint8_t num_locals;
     uint8_t max_locals;
     uint16_t size;
+    /* Times n_evaluator_run called it, used to find hot procedures. */
+    uint32_t call_count;
 };
 
 void
 ni_init_procedures(NError* error);
 
+/* Procedures of modules created in an isolate are allocated in its heap,
+ * and collected once nothing refers to them. Those of other modules are
+ * allocated in the arena of the module, and freed with it. */
 NValue
 n_create_procedure(NModule* module, uint32_t entry, uint8_t num_locals,
                    uint8_t max_locals, uint16_t size, NError *error);
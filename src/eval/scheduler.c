@@ -0,0 +1,145 @@
+#include "isolate.h"
+#include "primitives.h"
+#include "scheduler.h"
+
+static
+NErrorType* BAD_ALLOCATION = NULL;
+
+static void
+push_ready(NScheduler* self, NTask* task);
+
+static NTask*
+pop_ready(NScheduler* self);
+
+
+void
+ni_init_scheduler(NError* error) {
+#define EC ON_ERROR(error, return)
+    BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);    EC;
+#undef EC
+}
+
+
+void
+n_construct_scheduler(NScheduler* self, uint32_t time_slice) {
+    self->time_slice = time_slice > 0 ? time_slice : N_DEFAULT_TIME_SLICE;
+    self->first_ready = NULL;
+    self->last_ready = NULL;
+    self->tasks = NULL;
+}
+
+
+void
+n_destruct_scheduler(NScheduler* self) {
+    NTask *task = self->tasks;
+    while (task != NULL) {
+        NTask *next = task->next_task;
+        n_destroy_error(&task->error);
+        free(task);
+        task = next;
+    }
+    self->first_ready = NULL;
+    self->last_ready = NULL;
+    self->tasks = NULL;
+}
+
+
+NTask*
+n_scheduler_spawn(NScheduler* self, NEvaluator* evaluator, NError* error) {
+    NTask *task = malloc(sizeof(NTask));
+    if (task == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate task.");
+        return NULL;
+    }
+    task->evaluator = evaluator;
+    task->state = evaluator->halted ? N_TASK_DONE : N_TASK_READY;
+    task->steps = 0;
+    task->error = n_error_ok();
+
+    task->next_task = self->tasks;
+    self->tasks = task;
+    if (task->state == N_TASK_READY) {
+        push_ready(self, task);
+    }
+    return task;
+}
+
+
+/* A task that is still running once its slice is over goes to the back of
+ * the queue. The major collection in progress in the heap of its isolate,
+ * if any, gets a step in between. */
+int
+n_scheduler_run_slice(NScheduler* self) {
+    NTask *task = pop_ready(self);
+    if (task == NULL) {
+        return 0;
+    }
+
+    n_run_task_slice(task, self->time_slice);
+    if (task->evaluator->isolate != NULL) {
+        n_heap_step(&task->evaluator->isolate->heap);
+    }
+    if (task->state == N_TASK_READY) {
+        push_ready(self, task);
+    }
+    return 1;
+}
+
+
+void
+n_scheduler_run(NScheduler* self) {
+    while (n_scheduler_run_slice(self)) {
+    }
+}
+
+
+void
+n_run_task_slice(NTask* task, uint32_t time_slice) {
+    uint32_t left = n_evaluator_run_for(task->evaluator, time_slice,
+                                        &task->error);
+    task->steps += time_slice - left;
+
+    if (task->evaluator->halted) {
+        task->state = N_TASK_DONE;
+    }
+    else if (n_is_blocked(&task->error)) {
+        n_destroy_error(&task->error);
+        task->error = n_error_ok();
+        task->state = N_TASK_PARKED;
+    }
+}
+
+
+void
+n_scheduler_wake(NScheduler* self, NTask* task) {
+    if (task->state == N_TASK_PARKED) {
+        task->state = N_TASK_READY;
+        push_ready(self, task);
+    }
+}
+
+
+static void
+push_ready(NScheduler* self, NTask* task) {
+    task->next_ready = NULL;
+    if (self->last_ready == NULL) {
+        self->first_ready = task;
+    }
+    else {
+        self->last_ready->next_ready = task;
+    }
+    self->last_ready = task;
+}
+
+
+static NTask*
+pop_ready(NScheduler* self) {
+    NTask *task = self->first_ready;
+    if (task != NULL) {
+        self->first_ready = task->next_ready;
+        if (self->first_ready == NULL) {
+            self->last_ready = NULL;
+        }
+    }
+    return task;
+}
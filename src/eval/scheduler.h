@@ -0,0 +1,80 @@
+#ifndef N_E_SCHEDULER_H
+#define N_E_SCHEDULER_H
+
+#include "../common/compatibility/stdint.h"
+#include "../common/errors.h"
+
+#include "evaluator.h"
+
+/* Evaluators are given this much fuel per slice unless told otherwise. */
+#define N_DEFAULT_TIME_SLICE 1000
+
+typedef struct NScheduler NScheduler;
+typedef struct NTask NTask;
+
+typedef enum {
+    N_TASK_READY,
+    N_TASK_PARKED,
+    N_TASK_DONE
+} NTaskState;
+
+/* An evaluator run by a scheduler. Steps counts the fuel it has spent so
+ * far, see n_evaluator_run_for. Error holds the error it halted with once
+ * it is done. */
+struct NTask {
+    NEvaluator *evaluator;
+    NTaskState state;
+    uint64_t steps;
+    NError error;
+
+    NTask *next_ready;
+    NTask *next_task;
+};
+
+/* Runs many evaluators on a single OS thread, giving each ready one a time
+ * slice of fuel in turn. Evaluators that call a blocked primitive are
+ * parked until the host wakes them up, see n_block_primitive. Incremental
+ * collections of the heaps of their isolates are stepped between slices,
+ * see n_heap_step. */
+struct NScheduler {
+    uint32_t time_slice;
+    NTask *first_ready;
+    NTask *last_ready;
+    NTask *tasks;
+};
+
+
+void
+ni_init_scheduler(NError* error);
+
+void
+n_construct_scheduler(NScheduler* self, uint32_t time_slice);
+
+/* Destroys the tasks, but not their evaluators. */
+void
+n_destruct_scheduler(NScheduler* self);
+
+/* Adds a prepared evaluator to the back of the run queue. The evaluator
+ * must outlive the scheduler. */
+NTask*
+n_scheduler_spawn(NScheduler* self, NEvaluator* evaluator, NError* error);
+
+/* Runs a time slice of the task at the front of the run queue. Returns
+ * false when no task is ready. */
+int
+n_scheduler_run_slice(NScheduler* self);
+
+/* Runs slices until no task is ready. Parked tasks are left parked. */
+void
+n_scheduler_run(NScheduler* self);
+
+/* Runs a ready task for the given fuel, updating its state and steps. */
+void
+n_run_task_slice(NTask* task, uint32_t time_slice);
+
+/* Puts a parked task back on the run queue. The blocked call is made again
+ * when it runs. */
+void
+n_scheduler_wake(NScheduler* self, NTask* task);
+
+#endif /* N_E_SCHEDULER_H */
@@ -3,9 +3,11 @@
 
 #include "values.h"
 
-extern NValue N_TRUE;
-extern NValue N_FALSE;
-extern NValue N_UNKNOWN;
+/* The singletons are immediate constants, so they can be compared against
+ * without loading anything from memory. */
+#define N_FALSE   n_make_constant(N_BOOLEAN_KIND, 0)
+#define N_TRUE    n_make_constant(N_BOOLEAN_KIND, 1)
+#define N_UNKNOWN n_make_constant(N_UNKNOWN_KIND, 0)
 
 void
 ni_init_singletons(NError* error);
@@ -16,6 +18,9 @@ n_is_unknown(NValue value);
 int
 n_is_boolean(NValue value);
 
+NType*
+ni_constant_type(NValue value);
+
 #define n_wrap_boolean(STT) (STT? N_TRUE : N_FALSE)
 
 #define n_unwrap_boolean(VAL) (VAL == N_TRUE ? 1 : 0)
@@ -6,6 +6,7 @@
 #include "../common/common.h"
 #include "../common/errors.h"
 #include "../common/name-registry.h"
+#include "../common/threads.h"
 
 #include "type-registry.h"
 
@@ -21,11 +22,28 @@ struct NTypeRegistry {
 static
 NTypeRegistry DEFAULT_REGISTRY;
 
+/* Serializes registrations into the default registry, lookups don't need
+ * it. Other registries belong to a single isolate, and don't take it. */
+static
+NMutex REGISTRY_LOCK = N_MUTEX_INIT;
+
+/* Types by id. Entries are published before the id is given, and never
+ * change afterwards. */
+static
+NType* TYPES_BY_ID[N_MAX_TYPES];
+
+static
+uint16_t NUM_TYPE_IDS = 1;
+
+static
+NMutex TYPE_IDS_LOCK = N_MUTEX_INIT;
+
 
 static NErrorType ERROR_TYPES[] = {
     { "nuvm.types.InvalidName" },
     { "nuvm.types.RepeatedName" },
     { "nuvm.types.UnknownType" },
+    { "nuvm.types.TooManyTypes" },
     { NULL }
 };
 
@@ -38,6 +56,9 @@ NErrorType* REPEATED_NAME = ERROR_TYPES+1;
 static
 NErrorType* UNKNOWN_TYPE = ERROR_TYPES+2;
 
+static
+NErrorType* TOO_MANY_TYPES = ERROR_TYPES+3;
+
 static
 NErrorType* ILLEGAL_ARGUMENT = NULL;
 
@@ -76,6 +97,8 @@ ni_init_type_registry(NError* error) {
 void
 n_construct_type(NType* type, const char* name) {
     type->name = name;
+    type->trace = NULL;
+    type->id = 0;
 }
 
 
@@ -87,38 +110,90 @@ n_find_type(const char* name, NError* error) {
 
 void
 n_register_type(NType* type, NError* error) {
+    n_lock(&REGISTRY_LOCK);
     register_type(&DEFAULT_REGISTRY, type, error);
+    n_unlock(&REGISTRY_LOCK);
 }
 
 
-#ifdef N_TEST
-static void
-destruct_registry(NTypeRegistry* self) {
-    ni_destruct_name_registry(&self->reg);
-}
-
-
-NTypeRegistry* nt_create_type_registry() {
-    NError error = n_error_ok();
+NTypeRegistry*
+n_create_type_registry(NError* error) {
     NTypeRegistry* self = malloc(sizeof(NTypeRegistry));
     if (self == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Can't allocate registry.");
         return NULL;
     }
 
-    construct_registry(self, &error);
-    if (!n_is_ok(&error)) {
-        n_destroy_error(&error);
+    construct_registry(self, error);
+    if (!n_is_ok(error)) {
         free(self);
         return NULL;
     }
+    return self;
+}
+
 
+void
+n_destroy_type_registry(NTypeRegistry* self) {
+    if (self != NULL) {
+        ni_destruct_name_registry(&self->reg);
+        free(self);
+    }
+}
+
+
+NType*
+n_registry_find_type(NTypeRegistry* self, const char* name, NError* error) {
+    return find_type(self, name, error);
+}
+
+
+void
+n_registry_register_type(NTypeRegistry* self, NType* type, NError* error) {
+    register_type(self, type, error);
+}
+
+
+uint16_t
+ni_type_id(NType* type, NError* error) {
+    uint16_t id = N_LOAD_ACQUIRE(&type->id);
+    if (id != 0) {
+        return id;
+    }
+
+    n_lock(&TYPE_IDS_LOCK);
+    id = type->id;
+    if (id == 0 && NUM_TYPE_IDS < N_MAX_TYPES) {
+        id = NUM_TYPE_IDS++;
+        TYPES_BY_ID[id] = type;
+        N_STORE_RELEASE(&type->id, id);
+    }
+    n_unlock(&TYPE_IDS_LOCK);
+
+    if (id == 0) {
+        n_set_error(error, TOO_MANY_TYPES, "No type ids are left.");
+    }
+    return id;
+}
+
+
+NType*
+ni_type_by_id(uint16_t id) {
+    return TYPES_BY_ID[id];
+}
+
+
+#ifdef N_TEST
+NTypeRegistry* nt_create_type_registry() {
+    NError error = n_error_ok();
+    NTypeRegistry* self = n_create_type_registry(&error);
+    n_destroy_error(&error);
     return self;
 }
 
 
 void nt_destroy_type_registry(NTypeRegistry* registry) {
-    destruct_registry(registry);
-    free(registry);
+    n_destroy_type_registry(registry);
 }
 
 
@@ -145,9 +220,13 @@ construct_registry(NTypeRegistry* self, NError* error) {
 }
 
 
+/* Registries other than the default one fall back to it. */
 static NType*
 find_type(NTypeRegistry* self, const char* name, NError* error) {
     NType* found = (NType*) ni_find_named_object(&self->reg, name);
+    if (found == NULL && self != &DEFAULT_REGISTRY) {
+        found = (NType*) ni_find_named_object(&DEFAULT_REGISTRY.reg, name);
+    }
     if (found == NULL) {
         n_set_error(error, UNKNOWN_TYPE, "Could not find the given "
                     "name in the type registry.");
@@ -164,7 +243,13 @@ register_type(NTypeRegistry* self, NType* type, NError* error) {
         return;
     }
 
-    status = ni_register_named_object(&self->reg, type->name, type);
+    if (self != &DEFAULT_REGISTRY && type->name != NULL
+        && ni_find_named_object(&DEFAULT_REGISTRY.reg, type->name) != NULL) {
+        status = N_NAMED_REG_REPEATED_NAME;
+    }
+    else {
+        status = ni_register_named_object(&self->reg, type->name, type);
+    }
     if (status == N_NAMED_REG_INVALID_NAME) {
         n_set_error(error, INVALID_NAME, "The name of a type must "
                     "be non-NULL, non-empty and contain only alphanumeric "
@@ -177,4 +262,7 @@ register_type(NTypeRegistry* self, NType* type, NError* error) {
         n_set_error(error, BAD_ALLOCATION, "Could not grow the type "
                     "registry storage area for insertion.");
     }
+    else {
+        ni_type_id(type, error);
+    }
 }
@@ -16,9 +16,37 @@ n_construct_type(NType* type, const char* name);
 NType*
 n_find_type(const char* name, NError* error);
 
+/* Registering a type also gives it an id, if it had none. */
 void
 n_register_type(NType* type, NError* error);
 
+/* Creates a registry of its own, for the types of an isolate. The types
+ * registered with n_register_type are found through it too, and their
+ * names can't be taken by its own types. Only the default registry can be
+ * used from several threads. */
+NTypeRegistry*
+n_create_type_registry(NError* error);
+
+void
+n_destroy_type_registry(NTypeRegistry* self);
+
+NType*
+n_registry_find_type(NTypeRegistry* self, const char* name, NError* error);
+
+void
+n_registry_register_type(NTypeRegistry* self, NType* type, NError* error);
+
+/* Returns the id of the type, giving it the next free one if it had none
+ * yet. Ids are shared by all registries, so that tables can be indexed by
+ * them. Fails with nuvm.types.TooManyTypes, returning 0, once N_MAX_TYPES
+ * is reached. */
+uint16_t
+ni_type_id(NType* type, NError* error);
+
+/* Returns the type with the given id, which must have been given. */
+NType*
+ni_type_by_id(uint16_t id);
+
 
 #ifdef N_TEST
 
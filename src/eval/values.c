@@ -2,8 +2,7 @@
 
 #include "values.h"
 #include "type-registry.h"
-#include "primitives.h"
-#include "procedures.h"
+#include "singletons.h"
 
 static NType  _fixnum_type;
 
@@ -25,7 +24,7 @@ n_wrap_fixnum(NFixnum fixnum) {
 
 NValue
 n_wrap_object(NObject* pointer) {
-    return ((NValue) pointer) | 1;
+    return ((NValue) pointer) | N_OBJECT_TAG;
 }
 
 
@@ -37,7 +36,7 @@ n_unwrap_fixnum(NValue value) {
 
 NObject*
 n_unwrap_object(NValue value) {
-    return (NObject*) (value & ~1);
+    return (NObject*) (value & ~((NValue) N_TAG_MASK));
 }
 
 
@@ -49,7 +48,7 @@ n_is_fixnum(NValue value) {
 
 int
 n_is_immediate(NValue value) {
-    return n_is_fixnum(value);
+    return (value & N_TAG_MASK) != N_OBJECT_TAG;
 }
 
 
@@ -58,6 +57,26 @@ n_type_of(NValue value) {
     if (n_is_fixnum(value)) {
         return &_fixnum_type;
     }
-    return n_unwrap_object(value)->type;
+    else if ((value & N_TAG_MASK) == N_CONSTANT_TAG) {
+        return ni_constant_type(value);
+    }
+    return n_object_type(n_unwrap_object(value));
+}
+
+
+NType*
+n_object_type(NObject* object) {
+    return ni_type_by_id(object->type_id);
+}
+
+
+/* Derived from the address the object had when first asked for it. */
+uint32_t
+n_object_hash(NObject* object) {
+    if (object->hash == 0) {
+        uint32_t hash = (uint32_t) ((size_t) object >> 3) * 2654435761u;
+        object->hash = hash != 0 ? hash : 1;
+    }
+    return object->hash;
 }
 
@@ -7,6 +7,8 @@
 typedef struct NObject NObject;
 typedef struct NType NType;
 
+struct NHeap;
+
 typedef intptr_t NValue;
 typedef int32_t NFixnum;
 
@@ -15,13 +17,62 @@ typedef int32_t NFixnum;
 
 #define n_eq_values(LEFT, RIGHT) ((LEFT) == (RIGHT))
 
-
+/* Values are told apart by their lowest bits:
+ *
+ *   ...0   a fixnum, shifted one bit to the left.
+ *   ..01   a pointer to an NObject.
+ *   ..11   an immediate constant, with no object behind it. The two bits
+ *          above the tag tell its kind, and the bits above those hold its
+ *          payload.
+ */
+#define N_OBJECT_TAG         0x1
+#define N_CONSTANT_TAG       0x3
+#define N_TAG_MASK           0x3
+
+#define N_BOOLEAN_KIND       0x3
+#define N_UNKNOWN_KIND       0x7
+#define N_CHARACTER_KIND     0xB
+/* Globals not loaded yet, see n_is_lazy_global. */
+#define N_LAZY_KIND          0xF
+#define N_KIND_MASK          0xF
+#define N_PAYLOAD_SHIFT      4
+
+#define n_make_constant(KIND, PAYLOAD) \
+    ((NValue) (((NValue) (PAYLOAD) << N_PAYLOAD_SHIFT) | (KIND)))
+
+/* Two values are both fixnums when the lowest bit of their bitwise or is
+ * clear. */
+#define n_both_fixnums(LEFT, RIGHT) ((((LEFT) | (RIGHT)) & 1) == 0)
+
+/* The fixnum zero is the only value with all its bits clear. */
+#define N_FIXNUM_ZERO ((NValue) 0)
+
+#define n_constant_kind(VALUE)    ((VALUE) & N_KIND_MASK)
+#define n_constant_payload(VALUE) ((VALUE) >> N_PAYLOAD_SHIFT)
+
+/* Type ids are below this, 0 standing for no id. */
+#ifndef N_MAX_TYPES
+#define N_MAX_TYPES 1024
+#endif
+
+
+/* The trace function traces the values an object of the type refers to,
+ * see n_trace_value. It is NULL for types whose objects refer to none. The
+ * id is given by the type registry, see ni_type_id. */
 struct NType {
     const char* name;
+    void (*trace)(NObject* object, struct NHeap* heap);
+    uint16_t id;
 };
 
+/* The header of every object is a single word: the id of its type, the
+ * bits the heap that allocated it keeps and its identity hash, which is 0
+ * until n_object_hash is first called on it. */
 struct NObject {
-    NType *type;
+    uint16_t type_id;
+    uint8_t gc_bits;
+    uint8_t size_class;
+    uint32_t hash;
 };
 
 void
@@ -41,6 +92,13 @@ n_is_immediate(NValue value);
 NType*
 n_type_of(NValue value);
 
+NType*
+n_object_type(NObject* object);
+
+/* Stays the same when the object is moved by its heap. */
+uint32_t
+n_object_hash(NObject* object);
+
 
 
 
@@ -0,0 +1,292 @@
+/* Needed for pthreads and sched_yield when building as C89. */
+#define _DEFAULT_SOURCE
+
+#include "worker-pool.h"
+
+#ifdef N_THREADS_ENABLED
+#include <pthread.h>
+#include <sched.h>
+
+/* The indices of the deques and the count of remaining tasks are shared
+ * between workers. The tasks in a deque are published by the store to its
+ * bottom, so the slots of the buffer themselves can be relaxed. */
+#define LOAD(P)             __atomic_load_n((P), __ATOMIC_SEQ_CST)
+#define STORE(P, V)         __atomic_store_n((P), (V), __ATOMIC_SEQ_CST)
+#define LOAD_RELAXED(P)     __atomic_load_n((P), __ATOMIC_RELAXED)
+#define STORE_RELAXED(P, V) __atomic_store_n((P), (V), __ATOMIC_RELAXED)
+#define CAS(P, E, D) \
+    __atomic_compare_exchange_n((P), &(E), (D), 0, \
+                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)
+#define DECREMENT(P)        __atomic_sub_fetch((P), 1, __ATOMIC_SEQ_CST)
+#define YIELD()             sched_yield()
+#else
+#define LOAD(P)             (*(P))
+#define STORE(P, V)         (*(P) = (V))
+#define LOAD_RELAXED(P)     (*(P))
+#define STORE_RELAXED(P, V) (*(P) = (V))
+#define CAS(P, E, D)        (*(P) == (E) ? (*(P) = (D), 1) : 0)
+#define DECREMENT(P)        (--*(P))
+#define YIELD()
+#endif /* N_THREADS_ENABLED */
+
+static
+NErrorType* BAD_ALLOCATION = NULL;
+
+static
+NErrorType* ILLEGAL_ARGUMENT = NULL;
+
+static void*
+worker_main(void* data);
+
+static void
+push_task(NWorker* self, NTask* task);
+
+static NTask*
+take_task(NWorker* self);
+
+static NTask*
+steal_task(NWorker* victim);
+
+static void
+destroy_workers(NWorkerPool* self);
+
+
+void
+ni_init_worker_pool(NError* error) {
+#define EC ON_ERROR(error, return)
+    BAD_ALLOCATION = n_error_type("nuvm.BadAllocation", error);    EC;
+    ILLEGAL_ARGUMENT = n_error_type("nuvm.IllegalArgument", error); EC;
+#undef EC
+}
+
+
+void
+n_construct_worker_pool(NWorkerPool* self, int num_workers,
+                        uint32_t time_slice) {
+#ifdef N_THREADS_ENABLED
+    self->num_workers = num_workers > 0 ? num_workers : 1;
+#else
+    self->num_workers = 1;
+#endif
+    self->time_slice = time_slice > 0 ? time_slice : N_DEFAULT_TIME_SLICE;
+    self->tasks = NULL;
+    self->num_tasks = 0;
+    self->workers = NULL;
+    self->remaining = 0;
+}
+
+
+void
+n_destruct_worker_pool(NWorkerPool* self) {
+    NTask *task = self->tasks;
+    while (task != NULL) {
+        NTask *next = task->next_task;
+        n_destroy_error(&task->error);
+        free(task);
+        task = next;
+    }
+    self->tasks = NULL;
+    self->num_tasks = 0;
+}
+
+
+NTask*
+n_worker_pool_spawn(NWorkerPool* self, NEvaluator* evaluator, NError* error) {
+    NTask *task;
+    if (evaluator->isolate != NULL) {
+        n_set_error(error, ILLEGAL_ARGUMENT, "Evaluators of an isolate "
+                    "can't run in a worker pool.");
+        return NULL;
+    }
+    task = malloc(sizeof(NTask));
+    if (task == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate task.");
+        return NULL;
+    }
+    task->evaluator = evaluator;
+    task->state = evaluator->halted ? N_TASK_DONE : N_TASK_READY;
+    task->steps = 0;
+    task->error = n_error_ok();
+    task->next_ready = NULL;
+
+    task->next_task = self->tasks;
+    self->tasks = task;
+    self->num_tasks++;
+    return task;
+}
+
+
+/* The ready tasks are dealt out to the workers before any of them starts,
+ * after their code is readied and their modules frozen. The calling thread
+ * is the first worker. If some of the others can't be started, their tasks
+ * get stolen. */
+void
+n_worker_pool_run(NWorkerPool* self, NError* error) {
+    NTask *task;
+    long capacity = 1;
+    int i;
+
+    while (capacity < (long) self->num_tasks) {
+        capacity *= 2;
+    }
+    self->workers = calloc(self->num_workers, sizeof(NWorker));
+    if (self->workers == NULL) {
+        n_set_error(error, BAD_ALLOCATION, "Unable to allocate workers.");
+        return;
+    }
+    for (i = 0; i < self->num_workers; i++) {
+        NWorker *worker = self->workers + i;
+        worker->pool = self;
+        worker->index = i;
+        worker->top = 0;
+        worker->bottom = 0;
+        worker->mask = capacity - 1;
+        worker->buffer = malloc(sizeof(NTask*) * capacity);
+        if (worker->buffer == NULL) {
+            n_set_error(error, BAD_ALLOCATION, "Unable to allocate the "
+                        "deque of a worker.");
+            destroy_workers(self);
+            return;
+        }
+    }
+
+    self->remaining = 0;
+    for (task = self->tasks, i = 0; task != NULL; task = task->next_task) {
+        if (task->state != N_TASK_READY) {
+            continue;
+        }
+        n_evaluator_prepare_code(task->evaluator, &task->error);
+        if (!n_is_ok(&task->error)) {
+            task->state = N_TASK_DONE;
+            continue;
+        }
+        task->evaluator->current_module->frozen = 1;
+        push_task(self->workers + i % self->num_workers, task);
+        self->remaining++;
+        i++;
+    }
+
+#ifdef N_THREADS_ENABLED
+    {
+        pthread_t *threads = malloc(sizeof(pthread_t) * self->num_workers);
+        int started = 1;
+        if (threads != NULL) {
+            while (started < self->num_workers
+                   && pthread_create(threads + started, NULL, worker_main,
+                                     self->workers + started) == 0) {
+                started++;
+            }
+        }
+        worker_main(self->workers);
+        for (i = 1; i < started; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        free(threads);
+    }
+#else
+    worker_main(self->workers);
+#endif
+
+    for (task = self->tasks; task != NULL; task = task->next_task) {
+        task->evaluator->current_module->frozen = 0;
+    }
+    destroy_workers(self);
+}
+
+
+void
+n_worker_pool_wake(NWorkerPool* self, NTask* task) {
+    if (task->state == N_TASK_PARKED) {
+        task->state = N_TASK_READY;
+    }
+}
+
+
+/* Runs the tasks of its own deque, and then steals from the others, until
+ * every task of the pool is done or parked. */
+static void*
+worker_main(void* data) {
+    NWorker *self = data;
+    NWorkerPool *pool = self->pool;
+
+    while (LOAD(&pool->remaining) > 0) {
+        NTask *task = take_task(self);
+        int i;
+        for (i = 1; task == NULL && i < pool->num_workers; i++) {
+            task = steal_task(pool->workers
+                              + (self->index + i) % pool->num_workers);
+        }
+        if (task == NULL) {
+            YIELD();
+            continue;
+        }
+
+        n_run_task_slice(task, pool->time_slice);
+        if (task->state == N_TASK_READY) {
+            push_task(self, task);
+        }
+        else {
+            DECREMENT(&pool->remaining);
+        }
+    }
+    return NULL;
+}
+
+
+static void
+push_task(NWorker* self, NTask* task) {
+    long bottom = LOAD_RELAXED(&self->bottom);
+    STORE_RELAXED(&self->buffer[bottom & self->mask], task);
+    STORE(&self->bottom, bottom + 1);
+}
+
+
+/* Only the owner takes from the bottom. Thieves may be after the last task
+ * too, so it is raced for on the top. */
+static NTask*
+take_task(NWorker* self) {
+    long bottom = LOAD_RELAXED(&self->bottom) - 1;
+    long top;
+    NTask *task = NULL;
+
+    STORE(&self->bottom, bottom);
+    top = LOAD(&self->top);
+    if (top <= bottom) {
+        task = LOAD_RELAXED(&self->buffer[bottom & self->mask]);
+        if (top == bottom) {
+            if (!CAS(&self->top, top, top + 1)) {
+                task = NULL;
+            }
+            STORE(&self->bottom, bottom + 1);
+        }
+    }
+    else {
+        STORE(&self->bottom, bottom + 1);
+    }
+    return task;
+}
+
+
+static NTask*
+steal_task(NWorker* victim) {
+    long top = LOAD(&victim->top);
+    long bottom = LOAD(&victim->bottom);
+    if (top < bottom) {
+        NTask *task = LOAD_RELAXED(&victim->buffer[top & victim->mask]);
+        if (CAS(&victim->top, top, top + 1)) {
+            return task;
+        }
+    }
+    return NULL;
+}
+
+
+static void
+destroy_workers(NWorkerPool* self) {
+    int i;
+    for (i = 0; i < self->num_workers; i++) {
+        free(self->workers[i].buffer);
+    }
+    free(self->workers);
+    self->workers = NULL;
+}
@@ -0,0 +1,77 @@
+#ifndef N_E_WORKER_POOL_H
+#define N_E_WORKER_POOL_H
+
+#include "../common/compatibility/stdint.h"
+#include "../common/errors.h"
+#include "../common/threads.h"
+
+#include "evaluator.h"
+#include "scheduler.h"
+
+typedef struct NWorkerPool NWorkerPool;
+typedef struct NWorker NWorker;
+
+/* A worker keeps its runnable tasks in a Chase-Lev deque: it pushes and
+ * takes them at the bottom, while idle workers steal them from the top.
+ * The deque never grows, it has room for every task of the pool. */
+struct NWorker {
+    NWorkerPool *pool;
+    int index;
+    long top;
+    long bottom;
+    NTask **buffer;
+    long mask;
+};
+
+/* Runs the tasks spawned in it on a fixed number of worker threads, giving
+ * each task a time slice of fuel at a time, like NScheduler does. Workers
+ * that run out of tasks steal them from the others.
+ *
+ * The modules of the tasks are frozen while they run, so evaluators on
+ * different threads can share them. They still share the globals of their
+ * module unless they have their own, see n_evaluator_own_globals. Tasks
+ * that block are parked, and n_worker_pool_wake puts them back once the
+ * run is over.
+ *
+ * Evaluators attached to an isolate are refused. Tasks of the same
+ * isolate could otherwise run on several workers at once, while an
+ * isolate may only be used by the thread it is pinned to, see
+ * n_enter_isolate.
+ *
+ * Without N_THREADS_ENABLED, see threads.h, a pool has a single worker,
+ * which runs on the thread that calls n_worker_pool_run. */
+struct NWorkerPool {
+    int num_workers;
+    uint32_t time_slice;
+    NTask *tasks;
+    uint32_t num_tasks;
+    NWorker *workers;
+    long remaining;
+};
+
+
+void
+ni_init_worker_pool(NError* error);
+
+void
+n_construct_worker_pool(NWorkerPool* self, int num_workers,
+                        uint32_t time_slice);
+
+/* Destroys the tasks, but not their evaluators. */
+void
+n_destruct_worker_pool(NWorkerPool* self);
+
+/* Adds a prepared evaluator to the pool. Tasks can't be spawned while the
+ * pool runs. Fails with nuvm.IllegalArgument if the evaluator is attached
+ * to an isolate. */
+NTask*
+n_worker_pool_spawn(NWorkerPool* self, NEvaluator* evaluator, NError* error);
+
+/* Runs all ready tasks until they are done or parked. */
+void
+n_worker_pool_run(NWorkerPool* self, NError* error);
+
+void
+n_worker_pool_wake(NWorkerPool* self, NTask* task);
+
+#endif /* N_E_WORKER_POOL_H */
@@ -260,6 +260,41 @@ TEST(call_emits_correctly) {
 }
 
 
+TEST(tail_call_emits_correctly) {
+    uint8_t args[] = { 8, 13 };
+    NProtoInstruction instr;
+    uint8_t opcode, target, n_args;
+    int i;
+
+    instr = n_proto_tail_call(1, 2, args, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(n_proto_instruction_size(&instr),
+                   n_get_opcode_size(N_OP_TAIL_CALL) + 2));
+
+    n_emit_instruction(WRITER, &instr, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    opcode = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    target = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_args = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode, N_OP_TAIL_CALL));
+    ASSERT(EQ_UINT(target, 1));
+    ASSERT(EQ_UINT(n_args, 2));
+
+    for (i = 0; i < 2; i++) {
+        uint8_t arg = n_read_byte(READER, &ERR);
+        ASSERT(IS_OK(ERR));
+        ASSERT(EQ_UINT(arg, args[i]));
+    }
+}
+
+
 TEST(return_has_correct_size) {
     NProtoInstruction instr = n_proto_return(1);
     uint16_t size = n_proto_instruction_size(&instr);
@@ -345,6 +380,119 @@ TEST(global_set_emits_correctly) {
 }
 
 
+TEST(arithmetic_emits_correctly) {
+    NProtoInstruction instr = n_proto_sub(3, 4, 5);
+    uint8_t opcode, dest, left, right;
+
+    ASSERT(IS_TRUE(nt_matches_proto_arithmetic(&instr, N_OP_SUB, 3, 4, 5)));
+    ASSERT(EQ_UINT(n_proto_instruction_size(&instr),
+                   n_get_opcode_size(N_OP_SUB)));
+
+    n_emit_instruction(WRITER, &instr, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    opcode = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    dest = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    left = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    right = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode, N_OP_SUB));
+    ASSERT(EQ_UINT(dest, 3));
+    ASSERT(EQ_UINT(left, 4));
+    ASSERT(EQ_UINT(right, 5));
+}
+
+
+TEST(jump_if_lt_emits_correctly) {
+    NProtoInstruction instr = n_proto_jump_if_lt(4, 5, 123);
+    uint8_t opcode, left, right;
+    int16_t offset;
+    NDummyAnchorMap anchor_map = create_anchor_map(123, 10);
+
+    ASSERT(IS_TRUE(nt_matches_proto_compare_and_jump(&instr, N_OP_JUMP_IF_LT,
+                                                     4, 5, 123)));
+    ASSERT(EQ_UINT(n_proto_instruction_size(&instr),
+                   n_get_opcode_size(N_OP_JUMP_IF_LT)));
+
+    n_resolve_instruction_anchors(&instr, 30, (NAnchorMap*) &anchor_map, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_emit_instruction(WRITER, &instr, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    opcode = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    left = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    right = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    offset = n_read_int16(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode, N_OP_JUMP_IF_LT));
+    ASSERT(EQ_UINT(left, 4));
+    ASSERT(EQ_UINT(right, 5));
+    ASSERT(EQ_INT(offset, -20));
+}
+
+
+TEST(jump_if_eq_needs_resolving) {
+    NProtoInstruction instr = n_proto_jump_if_eq(1, 2, 3);
+    n_emit_instruction(WRITER, &instr, &ERR);
+
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+}
+
+
+TEST(jump_if_le_needs_known_anchor) {
+    NDummyAnchorMap anchor_map = create_anchor_map(3, 55);
+    NProtoInstruction instr = n_proto_jump_if_le(1, 2, 4);
+
+    n_resolve_instruction_anchors(&instr, 1, (NAnchorMap*) &anchor_map, &ERR);
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+}
+
+
+TEST(jump_if_fixnum_zero_emits_correctly) {
+    NProtoInstruction instr = n_proto_jump_if_fixnum_zero(9, 7);
+    uint8_t opcode, cond;
+    int16_t offset;
+    NDummyAnchorMap anchor_map = create_anchor_map(7, 40);
+
+    ASSERT(EQ_UINT(n_proto_instruction_size(&instr),
+                   n_get_opcode_size(N_OP_JUMP_IF_FIXNUM_ZERO)));
+
+    n_resolve_instruction_anchors(&instr, 12, (NAnchorMap*) &anchor_map, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_emit_instruction(WRITER, &instr, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    opcode = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    cond = n_read_byte(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    offset = n_read_int16(READER, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode, N_OP_JUMP_IF_FIXNUM_ZERO));
+    ASSERT(EQ_UINT(cond, 9));
+    ASSERT(EQ_INT(offset, 28));
+}
+
+
 AtTest* tests[] = {
     &nop_has_correct_size,
     &nop_emits_correctly,
@@ -360,6 +508,12 @@ AtTest* tests[] = {
     &jump_needs_known_anchor,
     &call_has_correct_size,
     &call_emits_correctly,
+    &tail_call_emits_correctly,
+    &arithmetic_emits_correctly,
+    &jump_if_lt_emits_correctly,
+    &jump_if_eq_needs_resolving,
+    &jump_if_le_needs_known_anchor,
+    &jump_if_fixnum_zero_emits_correctly,
     &return_has_correct_size,
     &return_emits_correctly,
     &global_ref_has_correct_size,
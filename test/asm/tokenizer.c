@@ -190,6 +190,83 @@ TEST(reads_token_op_call) {
 }
 
 
+TEST(reads_token_op_tail_call) {
+    WITH_CONTENTS("tail-call");
+    EXPECT_TOKEN(N_TK_OP_TAIL_CALL);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_add) {
+    WITH_CONTENTS("add");
+    EXPECT_TOKEN(N_TK_OP_ADD);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_sub) {
+    WITH_CONTENTS("sub");
+    EXPECT_TOKEN(N_TK_OP_SUB);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_mul) {
+    WITH_CONTENTS("mul");
+    EXPECT_TOKEN(N_TK_OP_MUL);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_lt) {
+    WITH_CONTENTS("lt");
+    EXPECT_TOKEN(N_TK_OP_LT);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_le) {
+    WITH_CONTENTS("le");
+    EXPECT_TOKEN(N_TK_OP_LE);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_eq) {
+    WITH_CONTENTS("eq");
+    EXPECT_TOKEN(N_TK_OP_EQ);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_jump_if_lt) {
+    WITH_CONTENTS("jump-if-lt");
+    EXPECT_TOKEN(N_TK_OP_JUMP_IF_LT);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_jump_if_le) {
+    WITH_CONTENTS("jump-if-le");
+    EXPECT_TOKEN(N_TK_OP_JUMP_IF_LE);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_jump_if_eq) {
+    WITH_CONTENTS("jump-if-eq");
+    EXPECT_TOKEN(N_TK_OP_JUMP_IF_EQ);
+    EXPECT_EOF();
+}
+
+
+TEST(reads_token_op_jump_if_fixnum_zero) {
+    WITH_CONTENTS("jump-if-fixnum-zero");
+    EXPECT_TOKEN(N_TK_OP_JUMP_IF_FIXNUM_ZERO);
+    EXPECT_EOF();
+}
+
+
 TEST(reads_sequence_of_tokens) {
 	WITH_CONTENTS("  123 halt .procedure  ");
 	EXPECT_DETAILED_TOKEN(N_TK_INTEGER, "123");
@@ -248,6 +325,17 @@ AtTest* tests[] = {
     &reads_token_op_global_set,
     &reads_token_op_load_i16,
     &reads_token_op_call,
+    &reads_token_op_tail_call,
+    &reads_token_op_add,
+    &reads_token_op_sub,
+    &reads_token_op_mul,
+    &reads_token_op_lt,
+    &reads_token_op_le,
+    &reads_token_op_eq,
+    &reads_token_op_jump_if_lt,
+    &reads_token_op_jump_if_le,
+    &reads_token_op_jump_if_eq,
+    &reads_token_op_jump_if_fixnum_zero,
     &reads_sequence_of_tokens,
     &reads_label_def,
     &reads_label_def_named_as_op,
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+
+#include "../test.h"
+
+#include "common/arena.h"
+
+#define BLOCK_SIZE 256
+
+static
+NArena ARENA;
+
+
+SETUP(setup) {
+    n_construct_arena(&ARENA, BLOCK_SIZE);
+}
+
+
+TEARDOWN(teardown) {
+    n_destruct_arena(&ARENA);
+}
+
+
+TEST(allocations_are_aligned_and_accounted_for) {
+    void *first = n_arena_allocate(&ARENA, 3);
+    void *second = n_arena_allocate(&ARENA, 5);
+
+    ASSERT(IS_TRUE(first != NULL));
+    ASSERT(IS_TRUE(((size_t) first & 3) == 0));
+    ASSERT(IS_TRUE(((size_t) second & 3) == 0));
+    ASSERT(IS_TRUE((char*) second >= (char*) first + 3));
+    ASSERT(IS_TRUE(ARENA.allocated >= 8));
+}
+
+
+TEST(allocations_follow_each_other) {
+    char *first = n_arena_allocate(&ARENA, 16);
+    char *second = n_arena_allocate(&ARENA, 16);
+
+    ASSERT(IS_TRUE(second == first + 16));
+}
+
+
+TEST(full_blocks_are_replaced) {
+    char *first = n_arena_allocate(&ARENA, BLOCK_SIZE - 16);
+    char *second = n_arena_allocate(&ARENA, 32);
+    char *third = n_arena_allocate(&ARENA, 16);
+
+    ASSERT(IS_TRUE(first != NULL));
+    ASSERT(IS_TRUE(second != NULL));
+    ASSERT(IS_TRUE(third == second + 32));
+}
+
+
+TEST(big_allocations_leave_the_current_block_alone) {
+    char *first = n_arena_allocate(&ARENA, 16);
+    char *big = n_arena_allocate(&ARENA, BLOCK_SIZE * 2);
+    char *second = n_arena_allocate(&ARENA, 16);
+
+    ASSERT(IS_TRUE(big != NULL));
+    ASSERT(IS_TRUE(second == first + 16));
+    ASSERT(IS_TRUE(ARENA.allocated >= BLOCK_SIZE * 2 + 32));
+}
+
+
+TEST(destructed_arenas_are_empty) {
+    n_arena_allocate(&ARENA, BLOCK_SIZE * 2);
+    n_destruct_arena(&ARENA);
+
+    ASSERT(IS_TRUE(ARENA.blocks == NULL));
+    ASSERT(EQ_UINT(ARENA.allocated, 0));
+}
+
+
+AtTest* tests[] = {
+    &allocations_are_aligned_and_accounted_for,
+    &allocations_follow_each_other,
+    &full_blocks_are_replaced,
+    &big_allocations_leave_the_current_block_alone,
+    &destructed_arenas_are_empty,
+    NULL
+};
+
+
+TEST_RUNNER("Arena", tests, NULL, NULL, setup, teardown)
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "../test.h"
@@ -15,6 +16,8 @@ char TEST_DATA[256];
 static
 NError ERR;
 
+#define FILE_NAME "build/byte-reader-file"
+
 
 CONSTRUCTOR(constructor) {
     NT_INITIALIZE_MODULE(n_init_common);
@@ -26,6 +29,14 @@ CONSTRUCTOR(constructor) {
             TEST_DATA[i] = (i+1) % 255;
         }
     }
+    {
+        FILE* file = fopen(FILE_NAME, "wb");
+        if (file == NULL) {
+            ERROR("Can't create file for tests.", NULL);
+        }
+        fwrite(TEST_DATA, 1, 256, file);
+        fclose(file);
+    }
 
 }
 
@@ -184,6 +195,68 @@ TEST(has_data_is_false_when_at_end) {
 }
 
 
+TEST(map_bytes_returns_bytes_in_place) {
+    uint8_t *bytes;
+    n_skip_bytes(READER, 2, &ERR);
+
+    bytes = n_map_bytes(READER, 4, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE((char*) bytes == TEST_DATA + 2));
+    ASSERT(EQ_UINT(n_read_byte(READER, &ERR), 7));
+    ASSERT(IS_TRUE(n_byte_reader_mapping(READER) == NULL));
+}
+
+
+TEST(map_bytes_checks_bounds) {
+    n_skip_bytes(READER, 250, &ERR);
+
+    ASSERT(IS_TRUE(n_map_bytes(READER, 8, &ERR) == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.UnexpectedEoF"));
+}
+
+
+TEST(file_readers_read_the_file) {
+    NByteReader *reader = n_new_byte_reader_from_file(FILE_NAME, &ERR);
+    uint8_t *bytes;
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(n_read_uint16(reader, &ERR), 0x0201));
+    bytes = n_map_bytes(reader, 253, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(memcmp(bytes, TEST_DATA + 2, 253) == 0));
+    ASSERT(EQ_UINT(n_read_byte(reader, &ERR), 1));
+    ASSERT(IS_TRUE(!n_has_bytes_to_read(reader)));
+    ASSERT(IS_TRUE(n_byte_reader_mapping(reader) != NULL));
+    n_destroy_byte_reader(reader, &ERR);
+}
+
+
+TEST(mappings_outlive_their_reader) {
+    NByteReader *reader = n_new_byte_reader_from_file(FILE_NAME, &ERR);
+    NMapping *mapping;
+    uint8_t *bytes;
+    ASSERT(IS_OK(ERR));
+
+    mapping = n_byte_reader_mapping(reader);
+    n_retain_mapping(mapping);
+    bytes = n_map_bytes(reader, 256, &ERR);
+    n_destroy_byte_reader(reader, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(memcmp(bytes, TEST_DATA, 256) == 0));
+    n_release_mapping(mapping);
+}
+
+
+TEST(missing_files_cant_be_read) {
+    NByteReader *reader =
+        n_new_byte_reader_from_file("build/no-such-file", &ERR);
+
+    ASSERT(IS_TRUE(reader == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.IoError"));
+}
+
+
 AtTest* tests[] = {
     &read_byte_gets_right_value,
     &read_uint16_get_right_value,
@@ -201,6 +274,11 @@ AtTest* tests[] = {
     &read_uint32_checks_bounds,
     &has_data_is_true_when_not_at_end,
     &has_data_is_false_when_at_end,
+    &map_bytes_returns_bytes_in_place,
+    &map_bytes_checks_bounds,
+    &file_readers_read_the_file,
+    &mappings_outlive_their_reader,
+    &missing_files_cant_be_read,
     NULL
 };
 
@@ -201,6 +201,37 @@ TEST(decode_call_reverts_encode) {
 }
 
 
+TEST(encode_tail_call_has_right_opcode) {
+    n_encode_op_tail_call(BUFFER, 0, 0);
+
+    ASSERT(EQ_UINT(BUFFER[0], N_OP_TAIL_CALL));
+}
+
+
+TEST(encode_tail_call_uses_three_bytes) {
+    /* The opcode and arguments are irrelevant to this test. */
+    int used_bytes = n_encode_op_tail_call(BUFFER, 0, 0);
+
+    ASSERT(EQ_INT(used_bytes, 3));
+}
+
+
+TEST(decode_tail_call_reverts_encode) {
+    uint8_t target = 22;
+    uint8_t d_target;
+    uint8_t n_args = 5;
+    uint8_t d_n_args;
+    int used_bytes;
+
+    n_encode_op_tail_call(BUFFER, target, n_args);
+    used_bytes = n_decode_op_tail_call(BUFFER, &d_target, &d_n_args);
+
+    ASSERT(EQ_INT(used_bytes, 3));
+    ASSERT(EQ_UINT(target, d_target));
+    ASSERT(EQ_UINT(n_args, d_n_args));
+}
+
+
 TEST(encode_global_ref_has_right_opcode) {
     n_encode_op_global_ref(BUFFER, 0, 0);
 
@@ -316,6 +347,91 @@ TEST(decode_return_reverts_encode) {
 }
 
 
+typedef struct {
+    int (*encode)(unsigned char*, uint8_t, uint8_t, uint8_t);
+    uint8_t opcode;
+} ArithmeticEncoder;
+
+ArithmeticEncoder arithmetic_array[] = {
+    { n_encode_op_add, N_OP_ADD },
+    { n_encode_op_sub, N_OP_SUB },
+    { n_encode_op_mul, N_OP_MUL },
+    { n_encode_op_lt,  N_OP_LT },
+    { n_encode_op_le,  N_OP_LE },
+    { n_encode_op_eq,  N_OP_EQ }
+};
+AtArrayIterator arithmetic_iter = at_static_array_iterator(arithmetic_array);
+
+DD_TEST(encode_arithmetic_has_right_opcode, arithmetic_iter,
+        ArithmeticEncoder, encoder) {
+    int used_bytes = encoder->encode(BUFFER, 0, 0, 0);
+
+    ASSERT(EQ_UINT(BUFFER[0], encoder->opcode));
+    ASSERT(EQ_INT(used_bytes, 4));
+}
+
+
+DD_TEST(decode_arithmetic_reverts_encode, arithmetic_iter,
+        ArithmeticEncoder, encoder) {
+    uint8_t d_dest, d_left, d_right;
+    int used_bytes;
+
+    encoder->encode(BUFFER, 0x12, 0x34, 0x56);
+    used_bytes = n_decode_op_arithmetic(BUFFER, &d_dest, &d_left, &d_right);
+
+    ASSERT(EQ_INT(used_bytes, 4));
+    ASSERT(EQ_UINT(d_dest, 0x12));
+    ASSERT(EQ_UINT(d_left, 0x34));
+    ASSERT(EQ_UINT(d_right, 0x56));
+}
+
+
+typedef struct {
+    int (*encode)(unsigned char*, uint8_t, uint8_t, int16_t);
+    uint8_t opcode;
+} CompareAndJumpEncoder;
+
+CompareAndJumpEncoder compare_and_jump_array[] = {
+    { n_encode_op_jump_if_lt, N_OP_JUMP_IF_LT },
+    { n_encode_op_jump_if_le, N_OP_JUMP_IF_LE },
+    { n_encode_op_jump_if_eq, N_OP_JUMP_IF_EQ }
+};
+AtArrayIterator compare_and_jump_iter =
+    at_static_array_iterator(compare_and_jump_array);
+
+DD_TEST(decode_compare_and_jump_reverts_encode, compare_and_jump_iter,
+        CompareAndJumpEncoder, encoder) {
+    uint8_t d_left, d_right;
+    int16_t d_offset;
+    int used_bytes = encoder->encode(BUFFER, 0x12, 0x34, -1234);
+
+    ASSERT(EQ_UINT(BUFFER[0], encoder->opcode));
+    ASSERT(EQ_INT(used_bytes, 5));
+
+    used_bytes = n_decode_op_compare_and_jump(BUFFER, &d_left, &d_right,
+                                              &d_offset);
+    ASSERT(EQ_INT(used_bytes, 5));
+    ASSERT(EQ_UINT(d_left, 0x12));
+    ASSERT(EQ_UINT(d_right, 0x34));
+    ASSERT(EQ_INT(d_offset, -1234));
+}
+
+
+TEST(decode_jump_if_fixnum_zero_reverts_encode) {
+    uint8_t d_cond;
+    int16_t d_offset;
+    int used_bytes = n_encode_op_jump_if_fixnum_zero(BUFFER, 0x56, 4321);
+
+    ASSERT(EQ_UINT(BUFFER[0], N_OP_JUMP_IF_FIXNUM_ZERO));
+    ASSERT(EQ_INT(used_bytes, 4));
+
+    used_bytes = n_decode_op_jump_if_fixnum_zero(BUFFER, &d_cond, &d_offset);
+    ASSERT(EQ_INT(used_bytes, 4));
+    ASSERT(EQ_UINT(d_cond, 0x56));
+    ASSERT(EQ_INT(d_offset, 4321));
+}
+
+
 AtTest* tests[] = {
     &encode_halt_has_right_opcode,
     &encode_halt_uses_one_byte,
@@ -342,6 +458,9 @@ AtTest* tests[] = {
     &encode_call_uses_four_bytes,
     &decode_call_uses_four_bytes,
     &decode_call_reverts_encode,
+    &encode_tail_call_has_right_opcode,
+    &encode_tail_call_uses_three_bytes,
+    &decode_tail_call_reverts_encode,
 
     &encode_global_ref_has_right_opcode,
     &encode_global_ref_uses_four_bytes,
@@ -357,6 +476,11 @@ AtTest* tests[] = {
     &encode_return_uses_two_bytes,
     &decode_return_uses_two_bytes,
     &decode_return_reverts_encode,
+
+    &encode_arithmetic_has_right_opcode,
+    &decode_arithmetic_reverts_encode,
+    &decode_compare_and_jump_reverts_encode,
+    &decode_jump_if_fixnum_zero_reverts_encode,
     NULL
 };
 
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "../test.h"
 
@@ -7,8 +8,17 @@
 
 NNameRegistry NR;
 
+#define NUM_NAMES 1000
+
+static
+char NAMES[NUM_NAMES][16];
+
 CONSTRUCTOR(constructor) {
+    int i;
     NT_INITIALIZE_MODULE(n_init_common);
+    for (i = 0; i < NUM_NAMES; i++) {
+        sprintf(NAMES[i], "name.n%d", i);
+    }
 }
 
 
@@ -156,6 +166,52 @@ TEST(cant_find_unknown_name) {
 
 
 
+TEST(can_register_and_find_many_names) {
+    int i;
+    for (i = 0; i < NUM_NAMES; i++) {
+        int status = ni_register_named_object(&NR, NAMES[i], NAMES[i]);
+        ASSERT(EQ_INT(status, N_NAMED_REG_SUCCESS));
+    }
+
+    for (i = 0; i < NUM_NAMES; i++) {
+        ASSERT(EQ_PTR(ni_find_named_object(&NR, NAMES[i]), NAMES[i]));
+        ASSERT(EQ_INT(ni_register_named_object(&NR, NAMES[i], NAMES[i]),
+                      N_NAMED_REG_REPEATED_NAME));
+    }
+    ASSERT(IS_NULL(ni_find_named_object(&NR, "name.unknown")));
+    ASSERT(EQ_INT(NR.num_objects, NUM_NAMES));
+}
+
+
+TEST(can_find_by_symbol) {
+    const char* name = "foo.Name";
+
+    ni_register_named_object(&NR, name, name);
+
+    ASSERT(EQ_PTR(ni_find_symbol_object(&NR, n_find_symbol("foo.Name")),
+                  name));
+    ASSERT(IS_NULL(ni_find_symbol_object(&NR, n_intern("foo.Other"))));
+}
+
+
+TEST(presized_registries_dont_grow) {
+    NNameRegistry registry;
+    int i;
+    ASSERT(EQ_INT(ni_construct_name_registry(&registry, NUM_NAMES),
+                  N_NAMED_REG_SUCCESS));
+
+    for (i = 0; i < NUM_NAMES; i++) {
+        ni_register_named_object(&registry, NAMES[i], NAMES[i]);
+    }
+    ASSERT(EQ_INT(registry.num_objects, NUM_NAMES));
+    ASSERT(EQ_INT(registry.num_retired, 0));
+
+    ni_register_named_object(&registry, "name.extra", "name.extra");
+    ASSERT(EQ_INT(registry.num_retired, 0));
+    ni_destruct_name_registry(&registry);
+}
+
+
 AtTest* tests[] = {
     &can_register_name_object,
     &rejects_null_name,
@@ -167,6 +223,9 @@ AtTest* tests[] = {
     &cant_find_unknown_name,
     &can_register_and_find_different_names,
     &can_register_and_find_more_than_initial_size,
+    &can_register_and_find_many_names,
+    &can_find_by_symbol,
+    &presized_registries_dont_grow,
     NULL
 };
 
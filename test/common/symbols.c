@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../test.h"
+
+#include "common/common.h"
+#include "common/symbols.h"
+
+#define NUM_NAMES 2000
+
+static
+char NAMES[NUM_NAMES][24];
+
+
+CONSTRUCTOR(constructor) {
+    int i;
+    NT_INITIALIZE_MODULE(n_init_common);
+    for (i = 0; i < NUM_NAMES; i++) {
+        sprintf(NAMES[i], "test.symbols.n%d", i);
+    }
+}
+
+
+TEST(equal_names_are_interned_once) {
+    char name[] = "test.symbols.Name";
+    NSymbol symbol = n_intern("test.symbols.Name");
+
+    ASSERT(IS_TRUE(symbol != N_NO_SYMBOL));
+    ASSERT(EQ_UINT(n_intern(name), symbol));
+    ASSERT(EQ_UINT(n_find_symbol(name), symbol));
+}
+
+
+TEST(different_names_get_different_symbols) {
+    NSymbol first = n_intern("test.symbols.First");
+    NSymbol second = n_intern("test.symbols.Second");
+
+    ASSERT(IS_TRUE(first != N_NO_SYMBOL));
+    ASSERT(IS_TRUE(second != N_NO_SYMBOL));
+    ASSERT(IS_TRUE(first != second));
+}
+
+
+TEST(names_are_copied) {
+    char name[] = "test.symbols.Copied";
+    NSymbol symbol = n_intern(name);
+    name[0] = 'x';
+
+    ASSERT(EQ_STR(n_symbol_name(symbol), "test.symbols.Copied"));
+    ASSERT(EQ_UINT(n_find_symbol("test.symbols.Copied"), symbol));
+    ASSERT(EQ_UINT(n_find_symbol(name), N_NO_SYMBOL));
+}
+
+
+TEST(names_need_not_be_interned_to_be_looked_up) {
+    ASSERT(EQ_UINT(n_find_symbol("test.symbols.Unknown"), N_NO_SYMBOL));
+    ASSERT(EQ_UINT(n_find_symbol("test.symbols.Unknown"), N_NO_SYMBOL));
+}
+
+
+TEST(many_names_can_be_interned) {
+    NSymbol symbols[NUM_NAMES];
+    int i;
+    for (i = 0; i < NUM_NAMES; i++) {
+        symbols[i] = n_intern(NAMES[i]);
+        ASSERT(IS_TRUE(symbols[i] != N_NO_SYMBOL));
+    }
+
+    for (i = 0; i < NUM_NAMES; i++) {
+        ASSERT(EQ_UINT(n_find_symbol(NAMES[i]), symbols[i]));
+        ASSERT(EQ_STR(n_symbol_name(symbols[i]), NAMES[i]));
+    }
+    for (i = 1; i < NUM_NAMES; i++) {
+        ASSERT(EQ_UINT(symbols[i], symbols[i - 1] + 1));
+    }
+}
+
+
+AtTest* tests[] = {
+    &equal_names_are_interned_once,
+    &different_names_get_different_symbols,
+    &names_are_copied,
+    &names_need_not_be_interned_to_be_looked_up,
+    &many_names_can_be_interned,
+    NULL
+};
+
+
+TEST_RUNNER("Symbols", tests, constructor, NULL, NULL, NULL)
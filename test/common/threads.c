@@ -0,0 +1,158 @@
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "../test.h"
+
+#include "common/common.h"
+#include "common/errors.h"
+#include "common/name-registry.h"
+#include "common/threads.h"
+
+
+#define NUM_NAMES 500
+#define NUM_READERS 4
+
+static
+NError ERR;
+
+static
+int CALLS;
+
+static
+NErrorType FAILURE = { "nuvm.test.Failure" };
+
+static
+char NAMES[NUM_NAMES][16];
+
+static void
+count_call(NError* error);
+
+static void
+fail_call(NError* error);
+
+
+CONSTRUCTOR(constructor) {
+    int i;
+    NT_INITIALIZE_MODULE(n_init_common);
+    for (i = 0; i < NUM_NAMES; i++) {
+        sprintf(NAMES[i], "name.n%d", i);
+    }
+}
+
+
+SETUP(setup) {
+    ERR = n_error_ok();
+    CALLS = 0;
+}
+
+
+TEARDOWN(teardown) {
+    n_destroy_error(&ERR);
+}
+
+
+TEST(call_once_runs_init_once) {
+    static NOnce once = N_ONCE_INIT;
+
+    n_call_once(&once, count_call, &ERR);
+    n_call_once(&once, count_call, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(CALLS, 1));
+}
+
+
+TEST(call_once_reports_the_first_error_to_every_caller) {
+    static NOnce once = N_ONCE_INIT;
+
+    n_call_once(&once, fail_call, &ERR);
+    ASSERT(IS_TRUE(ERR.type == &FAILURE));
+
+    ERR = n_error_ok();
+    n_call_once(&once, fail_call, &ERR);
+    ASSERT(IS_TRUE(ERR.type == &FAILURE));
+    ASSERT(EQ_INT(CALLS, 1));
+}
+
+
+TEST(init_can_be_called_again) {
+    n_init_common(&ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_error_type("nuvm.BadAllocation", &ERR);
+    ASSERT(IS_OK(ERR));
+}
+
+
+#ifdef N_THREADS_ENABLED
+static
+NNameRegistry NR;
+
+
+static void*
+look_up_first_name(void* data) {
+    int *misses = data;
+    int i;
+    for (i = 0; i < NUM_NAMES * 10; i++) {
+        if (ni_find_named_object(&NR, NAMES[0]) != NAMES[0]) {
+            (*misses)++;
+        }
+    }
+    return NULL;
+}
+
+
+TEST(lookups_run_alongside_registrations) {
+    pthread_t readers[NUM_READERS];
+    int misses[NUM_READERS];
+    int i;
+
+    ASSERT(EQ_INT(ni_construct_name_registry(&NR, 2), N_NAMED_REG_SUCCESS));
+    ni_register_named_object(&NR, NAMES[0], NAMES[0]);
+    for (i = 0; i < NUM_READERS; i++) {
+        misses[i] = 0;
+        pthread_create(readers + i, NULL, look_up_first_name, misses + i);
+    }
+    for (i = 1; i < NUM_NAMES; i++) {
+        ni_register_named_object(&NR, NAMES[i], NAMES[i]);
+    }
+    for (i = 0; i < NUM_READERS; i++) {
+        pthread_join(readers[i], NULL);
+    }
+
+    for (i = 0; i < NUM_READERS; i++) {
+        ASSERT(EQ_INT(misses[i], 0));
+    }
+    for (i = 0; i < NUM_NAMES; i++) {
+        ASSERT(IS_TRUE(ni_find_named_object(&NR, NAMES[i]) == NAMES[i]));
+    }
+    ni_destruct_name_registry(&NR);
+}
+#endif /* N_THREADS_ENABLED */
+
+
+AtTest* tests[] = {
+    &call_once_runs_init_once,
+    &call_once_reports_the_first_error_to_every_caller,
+    &init_can_be_called_again,
+#ifdef N_THREADS_ENABLED
+    &lookups_run_alongside_registrations,
+#endif
+    NULL
+};
+
+
+TEST_RUNNER("Threads", tests, constructor, NULL, setup, teardown)
+
+
+static void
+count_call(NError* error) {
+    CALLS++;
+}
+
+
+static void
+fail_call(NError* error) {
+    CALLS++;
+    n_set_error(error, &FAILURE, "Failed on purpose.");
+}
@@ -22,6 +22,25 @@ typedef struct {
     NFixnum value;
 } FixnumLoadData;
 
+typedef int (*ArithmeticEncoder)(unsigned char*, uint8_t, uint8_t, uint8_t);
+
+typedef struct {
+    ArithmeticEncoder encode;
+    NFixnum left;
+    NFixnum right;
+    NValue expected;
+} ArithmeticData;
+
+typedef int (*CompareAndJumpEncoder)(unsigned char*, uint8_t, uint8_t,
+                                     int16_t);
+
+typedef struct {
+    CompareAndJumpEncoder encode;
+    NFixnum left;
+    NFixnum right;
+    int taken;
+} CompareAndJumpData;
+
 
 static
 unsigned char *CODE;
@@ -57,6 +76,20 @@ NValue ENTRY_PROC;
 static
 int FLAG;
 
+static NValue
+run_arithmetic(ArithmeticEncoder encode, NValue left, NValue right,
+               int use_run_loop);
+
+static int
+run_compare_and_jump(CompareAndJumpEncoder encode, NValue left, NValue right,
+                     int use_run_loop);
+
+static int
+run_to_halt(int use_run_loop);
+
+static int
+run_jump_if_fixnum_zero(NValue cond, int use_run_loop);
+
 static NValue
 true_function(int n_args, NValue *args, NError *error);
 
@@ -110,7 +143,8 @@ SETUP(setup) {
         REGISTERS[i] = n_wrap_fixnum(0);
     }
 
-    nt_construct_evaluator(&EVAL);
+    n_construct_evaluator(&EVAL);
+    ERR = n_error_ok();
     MOD->entry_point = 15;
     REGISTERS[15] = ENTRY_PROC;
 
@@ -124,11 +158,11 @@ SETUP(setup) {
     }
     /* Make room for some locals. */
     EVAL.sp += 16;
-    ERR = n_error_ok();
 }
 
 
 TEARDOWN(teardown) {
+    n_destruct_evaluator(&EVAL);
     n_destroy_error(&ERR);
 }
 
@@ -226,14 +260,14 @@ TEST(call_proc_pushes_frame_pointer) {
     NValue proc = n_create_procedure(MOD, 0, 0, 0, 1, &ERR);
     ASSERT(IS_OK(ERR));
 
-    EVAL.fp = 12345;
+    EVAL.fp = 12;
 
     n_encode_op_call(CODE, 9, 1, 0);
     n_evaluator_set_local(&EVAL, 1, proc, &ERR);
     n_evaluator_step(&EVAL, &ERR);
 
     ASSERT(IS_OK(ERR));
-    ASSERT(EQ_INT(EVAL.stack[EVAL.sp -3], 12345));
+    ASSERT(EQ_INT(EVAL.stack[EVAL.sp -3], 12));
 }
 
 
@@ -519,6 +553,178 @@ TEST(global_set_copies_values) {
 
 
 
+/* Expected results are wrapped when the test runs, since fixnums can't be
+ * wrapped in a static initializer. Comparisons expect booleans. */
+ArithmeticData arithmetic_array[] = {
+    { n_encode_op_add, 2, 3, 5 },
+    { n_encode_op_add, -7, 3, -4 },
+    { n_encode_op_add, N_FIXNUM_MAX, -1, N_FIXNUM_MAX -1 },
+    { n_encode_op_sub, 2, 3, -1 },
+    { n_encode_op_sub, N_FIXNUM_MIN +1, 1, N_FIXNUM_MIN },
+    { n_encode_op_mul, 6, -7, -42 },
+    { n_encode_op_mul, -65536, 32768, N_FIXNUM_MIN },
+    { n_encode_op_lt, 1, 2, N_TRUE },
+    { n_encode_op_lt, 2, 2, N_FALSE },
+    { n_encode_op_lt, -3, 2, N_TRUE },
+    { n_encode_op_le, 2, 2, N_TRUE },
+    { n_encode_op_le, 3, 2, N_FALSE },
+    { n_encode_op_eq, 5, 5, N_TRUE },
+    { n_encode_op_eq, -5, 5, N_FALSE }
+};
+AtArrayIterator arithmetic_iter = at_static_array_iterator(arithmetic_array);
+
+DD_TEST(arithmetic_computes_result, arithmetic_iter, ArithmeticData, data) {
+    NValue expected = data->expected;
+    NValue left = n_wrap_fixnum(data->left);
+    NValue right = n_wrap_fixnum(data->right);
+    NValue stepped, ran;
+
+    if (!n_is_boolean(expected)) {
+        expected = n_wrap_fixnum((NFixnum) expected);
+    }
+
+    stepped = run_arithmetic(data->encode, left, right, 0);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(EVAL.pc, 4));
+    ASSERT(IS_TRUE(n_eq_values(stepped, expected)));
+
+    ran = run_arithmetic(data->encode, left, right, 1);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(EVAL.pc, 4));
+    ASSERT(IS_TRUE(n_eq_values(ran, expected)));
+}
+
+
+ArithmeticData overflow_array[] = {
+    { n_encode_op_add, N_FIXNUM_MAX, 1, 0 },
+    { n_encode_op_sub, N_FIXNUM_MIN, 1, 0 },
+    { n_encode_op_mul, N_FIXNUM_MAX, 2, 0 },
+    { n_encode_op_mul, N_FIXNUM_MIN, -1, 0 },
+    { n_encode_op_mul, N_FIXNUM_MIN, N_FIXNUM_MIN, 0 },
+    { n_encode_op_mul, N_FIXNUM_MAX, N_FIXNUM_MAX, 0 }
+};
+AtArrayIterator overflow_iter = at_static_array_iterator(overflow_array);
+
+DD_TEST(arithmetic_detects_overflow, overflow_iter, ArithmeticData, data) {
+    NValue left = n_wrap_fixnum(data->left);
+    NValue right = n_wrap_fixnum(data->right);
+
+    run_arithmetic(data->encode, left, right, 0);
+    ASSERT(IS_ERROR(ERR, "nuvm.Overflow"));
+
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    run_arithmetic(data->encode, left, right, 1);
+    ASSERT(IS_ERROR(ERR, "nuvm.Overflow"));
+    ASSERT(EQ_INT(EVAL.pc, 0));
+}
+
+
+TEST(arithmetic_rejects_non_fixnums) {
+    run_arithmetic(n_encode_op_add, n_wrap_fixnum(1), N_TRUE, 0);
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    run_arithmetic(n_encode_op_lt, N_UNKNOWN, n_wrap_fixnum(1), 1);
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+    ASSERT(EQ_INT(EVAL.pc, 0));
+}
+
+
+TEST(call_to_primitive_rejects_too_many_arguments) {
+    int i;
+    n_encode_op_call(CODE, 0, 5, N_ARGUMENTS_SIZE + 1);
+    for (i = 0; i <= N_ARGUMENTS_SIZE; i++) {
+        CODE[4 + i] = 1;
+    }
+    n_evaluator_set_local(&EVAL, 5, COPY_PRIMITIVE, &ERR);
+
+    ASSERT(EQ_INT(run_to_halt(0), 0));
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    ASSERT(EQ_INT(run_to_halt(1), 0));
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+}
+
+
+/* The entry procedure has a single local, but any register a byte can
+ * name must stay within the stack. */
+TEST(load_i16_writes_any_register_of_a_small_frame) {
+    NValue result;
+    n_encode_op_load_i16(CODE, 255, 7);
+    n_encode_op_halt(CODE+4);
+
+    ASSERT(EQ_INT(run_to_halt(0), 4));
+    ASSERT(IS_OK(ERR));
+    result = n_evaluator_get_local(&EVAL, 255, &ERR);
+    ASSERT(IS_TRUE(n_eq_values(result, n_wrap_fixnum(7))));
+
+    n_evaluator_set_local(&EVAL, 255, n_wrap_fixnum(0), &ERR);
+    ASSERT(EQ_INT(run_to_halt(1), 4));
+    ASSERT(IS_OK(ERR));
+    result = n_evaluator_get_local(&EVAL, 255, &ERR);
+    ASSERT(IS_TRUE(n_eq_values(result, n_wrap_fixnum(7))));
+}
+
+
+/* The jumps go to the pc 20, and fall through to the pc 5. */
+CompareAndJumpData compare_and_jump_array[] = {
+    { n_encode_op_jump_if_lt, 1, 2, 1 },
+    { n_encode_op_jump_if_lt, 2, 2, 0 },
+    { n_encode_op_jump_if_lt, -3, 2, 1 },
+    { n_encode_op_jump_if_le, 2, 2, 1 },
+    { n_encode_op_jump_if_le, 3, 2, 0 },
+    { n_encode_op_jump_if_eq, 5, 5, 1 },
+    { n_encode_op_jump_if_eq, -5, 5, 0 }
+};
+AtArrayIterator compare_and_jump_iter =
+    at_static_array_iterator(compare_and_jump_array);
+
+DD_TEST(compare_and_jump_jumps_when_comparison_holds, compare_and_jump_iter,
+        CompareAndJumpData, data) {
+    NValue left = n_wrap_fixnum(data->left);
+    NValue right = n_wrap_fixnum(data->right);
+    int expected_pc = data->taken ? 20 : 5;
+
+    ASSERT(EQ_INT(run_compare_and_jump(data->encode, left, right, 0),
+                  expected_pc));
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_INT(run_compare_and_jump(data->encode, left, right, 1),
+                  expected_pc));
+    ASSERT(IS_OK(ERR));
+}
+
+
+TEST(compare_and_jump_rejects_non_fixnums) {
+    run_compare_and_jump(n_encode_op_jump_if_lt, N_TRUE, n_wrap_fixnum(1), 0);
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    run_compare_and_jump(n_encode_op_jump_if_le, n_wrap_fixnum(1), N_UNKNOWN,
+                         1);
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+    ASSERT(EQ_INT(EVAL.pc, 0));
+}
+
+
+TEST(jump_if_fixnum_zero_jumps_only_on_zero) {
+    int i;
+    for (i = 0; i < 2; i++) {
+        ASSERT(EQ_INT(run_jump_if_fixnum_zero(n_wrap_fixnum(0), i), 20));
+        ASSERT(EQ_INT(run_jump_if_fixnum_zero(n_wrap_fixnum(1), i), 4));
+        ASSERT(EQ_INT(run_jump_if_fixnum_zero(n_wrap_fixnum(-1), i), 4));
+        ASSERT(EQ_INT(run_jump_if_fixnum_zero(N_FALSE, i), 4));
+        ASSERT(EQ_INT(run_jump_if_fixnum_zero(N_UNKNOWN, i), 4));
+        ASSERT(IS_OK(ERR));
+    }
+}
+
+
 AtTest* tests[] = {
     &load_i16_increments_pc_by_4,
     &load_i16_loads_correct_value,
@@ -553,6 +759,16 @@ AtTest* tests[] = {
     &global_set_copies_values,
     &global_set_adds_4_to_pc,
 
+    &arithmetic_computes_result,
+    &arithmetic_detects_overflow,
+    &arithmetic_rejects_non_fixnums,
+    &call_to_primitive_rejects_too_many_arguments,
+    &load_i16_writes_any_register_of_a_small_frame,
+
+    &compare_and_jump_jumps_when_comparison_holds,
+    &compare_and_jump_rejects_non_fixnums,
+    &jump_if_fixnum_zero_jumps_only_on_zero,
+
     NULL
 };
 
@@ -560,6 +776,21 @@ AtTest* tests[] = {
 
 TEST_RUNNER("BasicOperations", tests, constructor, NULL, setup, teardown)
 
+/* Runs the given arithmetic instruction on locals 1 and 2, storing into
+ * local 0, and returns the stored value. The instruction is either stepped
+ * over or run by the run loop, which stops on the halt following it. */
+static NValue
+run_arithmetic(ArithmeticEncoder encode, NValue left, NValue right,
+               int use_run_loop) {
+    encode(CODE, 0, 1, 2);
+    n_encode_op_halt(CODE+4);
+    n_evaluator_set_local(&EVAL, 0, N_UNKNOWN, &ERR);
+    n_evaluator_set_local(&EVAL, 1, left, &ERR);
+    n_evaluator_set_local(&EVAL, 2, right, &ERR);
+    run_to_halt(use_run_loop);
+    return n_evaluator_get_local(&EVAL, 0, &ERR);
+}
+
 static NValue
 true_function(int n_args, NValue *args, NError *error) {
     return N_TRUE;
@@ -581,3 +812,48 @@ copy_function(int n_args, NValue *args, NError *error) {
     }
     return N_UNKNOWN;
 }
+
+
+/* Steps over, or runs until the next halt, the code at the start of the
+ * module, and returns where it stopped. */
+static int
+run_to_halt(int use_run_loop) {
+    EVAL.pc = 0;
+    EVAL.halted = 0;
+
+    if (use_run_loop) {
+        n_predecode_module(MOD, &ERR);
+        if (!n_is_ok(&ERR)) {
+            return -1;
+        }
+        n_evaluator_run(&EVAL, &ERR);
+    }
+    else {
+        n_evaluator_step(&EVAL, &ERR);
+    }
+    return EVAL.pc;
+}
+
+
+/* Runs the given compare and jump instruction on locals 1 and 2, jumping
+ * to a halt at the pc 20 or falling through to a halt at the pc 5. */
+static int
+run_compare_and_jump(CompareAndJumpEncoder encode, NValue left, NValue right,
+                     int use_run_loop) {
+    encode(CODE, 1, 2, 20);
+    n_encode_op_halt(CODE+5);
+    n_encode_op_halt(CODE+20);
+    n_evaluator_set_local(&EVAL, 1, left, &ERR);
+    n_evaluator_set_local(&EVAL, 2, right, &ERR);
+    return run_to_halt(use_run_loop);
+}
+
+
+static int
+run_jump_if_fixnum_zero(NValue cond, int use_run_loop) {
+    n_encode_op_jump_if_fixnum_zero(CODE, 1, 20);
+    n_encode_op_halt(CODE+4);
+    n_encode_op_halt(CODE+20);
+    n_evaluator_set_local(&EVAL, 1, cond, &ERR);
+    return run_to_halt(use_run_loop);
+}
@@ -0,0 +1,182 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+#include "common/opcodes.h"
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/decoded-stream.h"
+
+
+#define CODE_SIZE 32
+
+static
+unsigned char CODE[CODE_SIZE];
+
+static
+NDecodedStream *STREAM;
+
+static
+NError ERR;
+
+
+CONSTRUCTOR(constructor) {
+    NT_INITIALIZE_MODULE(n_init_eval);
+}
+
+
+SETUP(setup) {
+    int i;
+    for (i = 0; i < CODE_SIZE; i++) {
+        n_encode_op_nop(CODE+i);
+    }
+    STREAM = NULL;
+    ERR = n_error_ok();
+}
+
+
+TEARDOWN(teardown) {
+    n_destroy_decoded_stream(STREAM);
+    n_destroy_error(&ERR);
+}
+
+
+static NDecodedInstruction*
+decode_at(uint32_t pc) {
+    STREAM = n_decode_stream(CODE, CODE_SIZE, &ERR);
+    if (STREAM == NULL) {
+        return NULL;
+    }
+    return STREAM->instructions + pc;
+}
+
+
+TEST(decodes_every_offset) {
+    NDecodedInstruction *instr;
+    n_encode_op_load_i16(CODE+4, 1, 0x0002);
+
+    instr = decode_at(0);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(STREAM->size, CODE_SIZE));
+    ASSERT(EQ_UINT(instr[4].opcode, N_OP_LOAD_I16));
+    /* The operand bytes of load-i16 are decoded as instructions too. */
+    ASSERT(EQ_UINT(instr[5].opcode, N_OP_HALT));
+    ASSERT(EQ_UINT(instr[6].opcode, N_OP_NOP));
+    ASSERT(EQ_UINT(instr[7].opcode, N_OP_LOAD_I16));
+}
+
+
+TEST(load_i16_value_is_widened) {
+    NDecodedInstruction *instr;
+    n_encode_op_load_i16(CODE+4, 3, -32768);
+
+    instr = decode_at(4);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr->u8s[0], 3));
+    ASSERT(EQ_INT(instr->wide, -32768));
+}
+
+
+TEST(jump_target_is_absolute) {
+    NDecodedInstruction *instr;
+    n_encode_op_jump(CODE+10, -6);
+
+    instr = decode_at(10);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr->opcode, N_OP_JUMP));
+    ASSERT(EQ_INT(instr->wide, 4));
+}
+
+
+TEST(jump_unless_target_is_absolute) {
+    NDecodedInstruction *instr;
+    n_encode_op_jump_unless(CODE+10, 7, 12);
+
+    instr = decode_at(10);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr->opcode, N_OP_JUMP_UNLESS));
+    ASSERT(EQ_UINT(instr->u8s[0], 7));
+    ASSERT(EQ_INT(instr->wide, 22));
+}
+
+
+TEST(jump_out_of_code_targets_end) {
+    NDecodedInstruction *instr;
+    n_encode_op_jump(CODE+10, -11);
+
+    instr = decode_at(10);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(instr->wide, CODE_SIZE));
+    ASSERT(EQ_UINT(STREAM->instructions[CODE_SIZE].opcode,
+                   N_DECODED_INVALID));
+}
+
+
+TEST(call_knows_next_instruction) {
+    NDecodedInstruction *instr;
+    n_encode_op_call(CODE+2, 1, 2, 3);
+
+    instr = decode_at(2);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr->opcode, N_OP_CALL));
+    ASSERT(EQ_UINT(instr->u8s[0], 1));
+    ASSERT(EQ_UINT(instr->u8s[1], 2));
+    ASSERT(EQ_UINT(instr->u8s[2], 3));
+    ASSERT(EQ_UINT(STREAM->num_call_sites, 1));
+    ASSERT(EQ_INT(instr->wide, 0));
+    ASSERT(EQ_UINT(STREAM->call_sites[0].next_pc, 2 + 4 + 3));
+    ASSERT(EQ_UINT(STREAM->call_sites[0].num_entries, 0));
+}
+
+
+TEST(global_operands_are_widened) {
+    NDecodedInstruction *instr;
+    n_encode_op_global_ref(CODE, 1, 0xFFEE);
+    n_encode_op_global_set(CODE+4, 0xEEFF, 2);
+
+    instr = decode_at(0);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr[0].u8s[0], 1));
+    ASSERT(EQ_INT(instr[0].wide, 0xFFEE));
+    ASSERT(EQ_UINT(instr[4].u8s[0], 2));
+    ASSERT(EQ_INT(instr[4].wide, 0xEEFF));
+}
+
+
+TEST(unknown_opcode_is_invalid) {
+    NDecodedInstruction *instr;
+    CODE[3] = 0xF0;
+
+    instr = decode_at(3);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr->opcode, N_DECODED_INVALID));
+}
+
+
+TEST(truncated_instruction_is_invalid) {
+    NDecodedInstruction *instr;
+    n_encode_op_call(CODE+CODE_SIZE-4, 0, 0, 2);
+
+    instr = decode_at(CODE_SIZE-4);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(instr->opcode, N_DECODED_INVALID));
+}
+
+
+AtTest* tests[] = {
+    &decodes_every_offset,
+    &load_i16_value_is_widened,
+    &jump_target_is_absolute,
+    &jump_unless_target_is_absolute,
+    &jump_out_of_code_targets_end,
+    &call_knows_next_instruction,
+    &global_operands_are_widened,
+    &unknown_opcode_is_invalid,
+    &truncated_instruction_is_invalid,
+    NULL
+};
+
+
+TEST_RUNNER("DecodedStream", tests, constructor, NULL, setup, teardown)
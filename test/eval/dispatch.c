@@ -0,0 +1,494 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/decoded-stream.h"
+#include "eval/primitives.h"
+#include "eval/procedures.h"
+#include "eval/singletons.h"
+#include "eval/values.h"
+
+
+#define CODE_SIZE 160
+#define NUM_GLOBALS 8
+
+#define G_COUNTDOWN 0
+#define G_CALLEE    1
+#define G_OUTPUT    2
+#define G_LOOP      3
+#define G_RECURSE   4
+#define G_ENTRY     7
+
+static
+NModule *MOD;
+
+static
+NEvaluator EVAL;
+
+static
+NError ERR;
+
+static
+int COUNTER;
+
+static
+int BLOCKED;
+
+static NValue
+countdown_function(int n_args, NValue *args, NError *error);
+
+
+CONSTRUCTOR(constructor) {
+    NT_INITIALIZE_MODULE(n_init_eval);
+    ERR = n_error_ok();
+
+    MOD = n_create_module(NUM_GLOBALS, CODE_SIZE, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module.", NULL);
+    }
+
+    MOD->globals[G_COUNTDOWN] =
+        n_create_primitive(countdown_function, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create countdown primitive.", NULL);
+    }
+
+    MOD->globals[G_CALLEE] = n_create_procedure(MOD, 64, 1, 1, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create callee procedure.", NULL);
+    }
+
+    MOD->globals[G_LOOP] = n_create_procedure(MOD, 96, 2, 2, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create loop procedure.", NULL);
+    }
+
+    MOD->globals[G_RECURSE] = n_create_procedure(MOD, 128, 2, 2, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create recursive procedure.", NULL);
+    }
+
+    MOD->globals[G_ENTRY] = n_create_procedure(MOD, 0, 4, 4, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module's entry procedure.", NULL);
+    }
+    MOD->entry_point = G_ENTRY;
+}
+
+
+SETUP(setup) {
+    unsigned char *code = MOD->code;
+    int i;
+    for (i = 0; i < CODE_SIZE; i++) {
+        n_encode_op_nop(code+i);
+    }
+
+    /* Entry procedure: calls the callee for as long as the countdown
+     * primitive returns true, storing the callee's result in a global. */
+    n_encode_op_global_ref(code+0, 0, G_COUNTDOWN);
+    n_encode_op_global_ref(code+4, 1, G_CALLEE);
+    n_encode_op_call(code+8, 2, 0, 0);
+    n_encode_op_jump_unless(code+12, 2, 8);
+    n_encode_op_halt(code+16);
+    n_encode_op_call(code+20, 3, 1, 1);
+    code[24] = 2;
+    n_encode_op_global_set(code+25, G_OUTPUT, 3);
+    n_encode_op_jump(code+29, -21);
+
+    /* Callee: returns a constant. */
+    n_encode_op_load_i16(code+64, 0, 42);
+    n_encode_op_return(code+68, 0);
+
+    /* Loop: tail-calls itself for as long as the countdown primitive
+     * returns true, then returns a constant. */
+    n_encode_op_global_ref(code+96, 0, G_COUNTDOWN);
+    n_encode_op_call(code+100, 1, 0, 0);
+    n_encode_op_jump_unless(code+104, 1, 12);
+    n_encode_op_load_i16(code+108, 0, 42);
+    n_encode_op_return(code+112, 0);
+    n_encode_op_global_ref(code+116, 0, G_LOOP);
+    n_encode_op_tail_call(code+120, 0, 0);
+
+    /* Recurse: the same as the loop, but with a call that pushes a new
+     * frame on each iteration. */
+    n_encode_op_global_ref(code+128, 0, G_COUNTDOWN);
+    n_encode_op_call(code+132, 1, 0, 0);
+    n_encode_op_jump_unless(code+136, 1, 12);
+    n_encode_op_load_i16(code+140, 0, 42);
+    n_encode_op_return(code+144, 0);
+    n_encode_op_global_ref(code+148, 0, G_RECURSE);
+    n_encode_op_call(code+152, 0, 0, 0);
+    n_encode_op_return(code+156, 0);
+
+    MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+    BLOCKED = 0;
+
+    ERR = n_error_ok();
+    n_predecode_module(MOD, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't predecode module.", NULL);
+    }
+
+    n_construct_evaluator(&EVAL);
+    n_prepare_evaluator(&EVAL, MOD, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't prepare evaluator to run the given module.", NULL);
+    }
+}
+
+
+TEARDOWN(teardown) {
+    n_destruct_evaluator(&EVAL);
+    n_destroy_error(&ERR);
+}
+
+
+TEST(run_executes_loop_to_halt) {
+    COUNTER = 10;
+    n_evaluator_run(&EVAL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(42))));
+}
+
+
+TEST(run_matches_stepping) {
+    NEvaluator stepped;
+    NError error = n_error_ok();
+
+    n_construct_evaluator(&stepped);
+    n_prepare_evaluator(&stepped, MOD, &error);
+    ASSERT(IS_OK(error));
+
+    COUNTER = 5;
+    while (!stepped.halted) {
+        n_evaluator_step(&stepped, &error);
+        ASSERT(IS_OK(error));
+    }
+
+    COUNTER = 5;
+    n_evaluator_run(&EVAL, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_INT(EVAL.pc, stepped.pc));
+    ASSERT(EQ_INT(EVAL.fp, stepped.fp));
+    ASSERT(EQ_INT(EVAL.sp, stepped.sp));
+    n_destruct_evaluator(&stepped);
+}
+
+
+/* Each iteration of the entry procedure spends three units of fuel: on the
+ * call to the countdown primitive, on the call to the callee and on the
+ * jump back. */
+TEST(run_for_stops_and_resumes) {
+    uint32_t fuel;
+    COUNTER = 10;
+
+    fuel = n_evaluator_run_for(&EVAL, 4, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(fuel, 0));
+    ASSERT(IS_TRUE(!EVAL.halted));
+    ASSERT(EQ_INT(COUNTER, 8));
+
+    n_evaluator_run(&EVAL, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(42))));
+}
+
+
+TEST(run_for_returns_fuel_left_on_halt) {
+    uint32_t fuel;
+    COUNTER = 2;
+
+    fuel = n_evaluator_run_for(&EVAL, 100, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_UINT(fuel, 100 - 7));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+}
+
+
+TEST(run_for_in_slices_matches_run) {
+    int slices = 0;
+    COUNTER = 5;
+
+    while (!EVAL.halted) {
+        n_evaluator_run_for(&EVAL, 1, &ERR);
+        ASSERT(IS_OK(ERR));
+        slices++;
+    }
+
+    ASSERT(EQ_INT(slices, 5 * 3 + 2));
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+    ASSERT(EQ_INT(EVAL.sp, 3 + 4));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(42))));
+}
+
+
+TEST(run_for_stops_inside_tail_call_loops) {
+    uint32_t fuel;
+    NValue callee = MOD->globals[G_CALLEE];
+    MOD->globals[G_CALLEE] = MOD->globals[G_LOOP];
+    COUNTER = 1000;
+
+    fuel = n_evaluator_run_for(&EVAL, 100, &ERR);
+    MOD->globals[G_CALLEE] = callee;
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(fuel, 0));
+    ASSERT(IS_TRUE(!EVAL.halted));
+    ASSERT(IS_TRUE(COUNTER > 900 && COUNTER < 1000));
+}
+
+
+TEST(run_stops_without_halting_on_blocked_primitive) {
+    COUNTER = 3;
+    BLOCKED = 1;
+    n_evaluator_run(&EVAL, &ERR);
+
+    ASSERT(IS_ERROR(ERR, "nuvm.Blocked"));
+    ASSERT(IS_TRUE(!EVAL.halted));
+    ASSERT(EQ_INT(EVAL.pc, 8));
+    ASSERT(EQ_INT(COUNTER, 3));
+
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    BLOCKED = 0;
+    n_evaluator_run(&EVAL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+}
+
+
+TEST(run_halts_on_unknown_opcode) {
+    MOD->code[16] = 0xFF;
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+    COUNTER = 0;
+
+    n_evaluator_run(&EVAL, &ERR);
+
+    ASSERT(IS_ERROR(ERR, "nuvm.UnknownOpcode"));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+}
+
+
+TEST(run_halts_on_invalid_condition) {
+    n_encode_op_load_i16(MOD->code+8, 2, 0);
+    n_encode_op_jump_unless(MOD->code+12, 2, 8);
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_evaluator_run(&EVAL, &ERR);
+
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_INT(EVAL.pc, 12));
+}
+
+
+TEST(tail_calls_run_in_constant_stack_space) {
+    NEvaluator stepped;
+    NError error = n_error_ok();
+    NValue callee = MOD->globals[G_CALLEE];
+    MOD->globals[G_CALLEE] = MOD->globals[G_LOOP];
+
+    /* Far more iterations than the stack could hold if each one of them
+     * pushed a frame. */
+    n_construct_evaluator(&stepped);
+    n_prepare_evaluator(&stepped, MOD, &error);
+    ASSERT(IS_OK(error));
+    COUNTER = N_STACK_MAX_SIZE;
+    while (!stepped.halted) {
+        n_evaluator_step(&stepped, &error);
+        ASSERT(IS_OK(error));
+    }
+
+    MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+    COUNTER = N_STACK_MAX_SIZE;
+    n_evaluator_run(&EVAL, &ERR);
+    MOD->globals[G_CALLEE] = callee;
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+    ASSERT(EQ_INT(EVAL.sp, 3 + 4));
+    ASSERT(EQ_INT(EVAL.sp, stepped.sp));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(42))));
+    n_destruct_evaluator(&stepped);
+}
+
+
+TEST(stack_grows_for_deep_recursion) {
+    NValue callee = MOD->globals[G_CALLEE];
+    MOD->globals[G_CALLEE] = MOD->globals[G_RECURSE];
+
+    COUNTER = N_STACK_INITIAL_SIZE * 4;
+    n_evaluator_run(&EVAL, &ERR);
+    MOD->globals[G_CALLEE] = callee;
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+    ASSERT(EQ_INT(EVAL.sp, 3 + 4));
+    ASSERT(IS_TRUE(EVAL.stack_size > N_STACK_INITIAL_SIZE));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(42))));
+}
+
+
+TEST(unbounded_recursion_overflows_stack) {
+    NValue callee = MOD->globals[G_CALLEE];
+    MOD->globals[G_CALLEE] = MOD->globals[G_RECURSE];
+
+    COUNTER = N_STACK_MAX_SIZE;
+    n_evaluator_run(&EVAL, &ERR);
+    MOD->globals[G_CALLEE] = callee;
+
+    ASSERT(IS_ERROR(ERR, "nuvm.StackOverflow"));
+    ASSERT(IS_TRUE(EVAL.halted));
+    ASSERT(EQ_INT(EVAL.pc, 152));
+    ASSERT(EQ_INT(EVAL.stack_size, N_STACK_MAX_SIZE));
+}
+
+
+TEST(tail_call_to_primitive_returns_its_result) {
+    n_encode_op_global_ref(MOD->code+64, 0, G_COUNTDOWN);
+    n_encode_op_tail_call(MOD->code+68, 0, 0);
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    COUNTER = 1;
+    n_evaluator_run(&EVAL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(EVAL.pc, 16));
+    ASSERT(EQ_INT(EVAL.sp, 3 + 4));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], N_FALSE)));
+}
+
+
+/* Stepping does not go through the decoded stream, so call sites are only
+ * filled in by the other dispatch strategies. */
+#ifndef N_DISPATCH_STEP
+static NCallSite*
+call_site_at(uint32_t pc) {
+    NDecodedStream *stream = MOD->decoded;
+    return stream->call_sites + stream->instructions[pc].wide;
+}
+
+
+TEST(run_caches_call_targets) {
+    NCallSite *site;
+    COUNTER = 3;
+    n_evaluator_run(&EVAL, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    site = call_site_at(8);
+    ASSERT(EQ_UINT(site->num_entries, 1));
+    ASSERT(IS_TRUE(n_eq_values(site->entries[0].callee,
+                               MOD->globals[G_COUNTDOWN])));
+    ASSERT(IS_TRUE(site->entries[0].function == countdown_function));
+
+    site = call_site_at(20);
+    ASSERT(EQ_UINT(site->num_entries, 1));
+    ASSERT(IS_TRUE(site->entries[0].function == NULL));
+    ASSERT(EQ_UINT(site->entries[0].entry, 64));
+    ASSERT(EQ_UINT(site->entries[0].num_locals, 1));
+}
+
+
+TEST(run_leaves_call_caches_of_frozen_modules_alone) {
+    COUNTER = 3;
+    MOD->frozen = 1;
+    n_evaluator_run(&EVAL, &ERR);
+    MOD->frozen = 0;
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(42))));
+    ASSERT(EQ_UINT(call_site_at(8)->num_entries, 0));
+    ASSERT(EQ_UINT(call_site_at(20)->num_entries, 0));
+}
+
+
+TEST(run_handles_polymorphic_call_sites) {
+    NValue original = MOD->globals[G_CALLEE];
+    int i;
+
+    /* Each run calls a new procedure from the same call site, so it ends
+     * up seeing more callees than it can cache. */
+    for (i = 0; i < N_CALL_CACHE_SIZE + 2; i++) {
+        MOD->globals[G_CALLEE] = n_create_procedure(MOD, 64, 1, 1, 1, &ERR);
+        ASSERT(IS_OK(ERR));
+        MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+
+        n_prepare_evaluator(&EVAL, MOD, &ERR);
+        ASSERT(IS_OK(ERR));
+        COUNTER = 1;
+        n_evaluator_run(&EVAL, &ERR);
+        ASSERT(IS_OK(ERR));
+        ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT],
+                                   n_wrap_fixnum(42))));
+    }
+    MOD->globals[G_CALLEE] = original;
+
+    ASSERT(EQ_UINT(call_site_at(20)->num_entries, N_CALL_CACHE_SIZE));
+    ASSERT(EQ_UINT(call_site_at(8)->num_entries, 1));
+}
+#endif /* N_DISPATCH_STEP */
+
+
+AtTest* tests[] = {
+    &run_executes_loop_to_halt,
+    &run_matches_stepping,
+    &run_for_stops_and_resumes,
+    &run_for_returns_fuel_left_on_halt,
+    &run_for_in_slices_matches_run,
+    &run_for_stops_inside_tail_call_loops,
+    &run_stops_without_halting_on_blocked_primitive,
+    &run_halts_on_unknown_opcode,
+    &run_halts_on_invalid_condition,
+    &tail_calls_run_in_constant_stack_space,
+    &tail_call_to_primitive_returns_its_result,
+    &stack_grows_for_deep_recursion,
+    &unbounded_recursion_overflows_stack,
+#ifndef N_DISPATCH_STEP
+    &run_caches_call_targets,
+    &run_leaves_call_caches_of_frozen_modules_alone,
+    &run_handles_polymorphic_call_sites,
+#endif
+    NULL
+};
+
+
+TEST_RUNNER("Dispatch", tests, constructor, NULL, setup, teardown)
+
+
+static NValue
+countdown_function(int n_args, NValue *args, NError *error) {
+    if (BLOCKED) {
+        n_block_primitive(error);
+        return N_UNKNOWN;
+    }
+    if (COUNTER > 0) {
+        COUNTER--;
+        return N_TRUE;
+    }
+    return N_FALSE;
+}
@@ -66,7 +66,7 @@ SETUP(setup) {
     for (i = 0; i < NUM_REGISTERS; i++) {
         REGISTERS[i] = n_wrap_fixnum(0);
     }
-    nt_construct_evaluator(&EVAL);
+    n_construct_evaluator(&EVAL);
 
     MOD->entry_point = 15;
 
@@ -74,6 +74,11 @@ SETUP(setup) {
 }
 
 
+TEARDOWN(teardown) {
+    n_destruct_evaluator(&EVAL);
+}
+
+
 TEST(pc_starts_negative) {
     ASSERT(IS_TRUE(EVAL.pc < 0));
 }
@@ -149,6 +154,8 @@ TEST(get_global_gives_correct_value) {
     NValue value;
     NError error = n_error_ok();
 
+    n_prepare_evaluator(&EVAL, MOD, &error);
+    ASSERT(IS_OK(error));
     REGISTERS[3] = n_wrap_fixnum(99);
 
     value = n_evaluator_get_global(&EVAL, 3, &error);
@@ -161,6 +168,9 @@ TEST(get_global_gives_correct_value) {
 
 TEST(get_global_detects_out_of_range) {
     NError error = n_error_ok();
+    n_prepare_evaluator(&EVAL, MOD, &error);
+    ASSERT(IS_OK(error));
+
     n_evaluator_get_global(&EVAL, NUM_REGISTERS, &error);
 
     ASSERT(IS_ERROR(error, "nuvm.IndexOutOfBounds"));
@@ -191,6 +201,23 @@ TEST(prepare_adds_num_locals_to_sp) {
 }
 
 
+TEST(stack_starts_unallocated) {
+    ASSERT(IS_NULL(EVAL.stack));
+    ASSERT(EQ_INT(EVAL.stack_size, 0));
+}
+
+
+TEST(prepare_allocates_initial_stack) {
+    NError error = n_error_ok();
+
+    n_prepare_evaluator(&EVAL, MOD, &error);
+    ASSERT(IS_OK(error));
+
+    ASSERT(IS_TRUE(EVAL.stack != NULL));
+    ASSERT(EQ_INT(EVAL.stack_size, N_STACK_INITIAL_SIZE));
+}
+
+
 TEST(prepare_sets_pc_to_proc_entry) {
     NError error = n_error_ok();
 
@@ -224,11 +251,13 @@ AtTest* tests[] = {
     &get_global_detects_out_of_range,
     &prepare_pushes_dummy_frame,
     &prepare_adds_num_locals_to_sp,
+    &stack_starts_unallocated,
+    &prepare_allocates_initial_stack,
     &prepare_sets_pc_to_proc_entry,
     &prepare_clears_halted_flag,
     NULL
 };
 
 
-TEST_RUNNER("Evaluator", tests, constructor, NULL, setup, NULL)
+TEST_RUNNER("Evaluator", tests, constructor, NULL, setup, teardown)
 
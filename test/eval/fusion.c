@@ -0,0 +1,300 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+#include "common/opcodes.h"
+#include "common/byte-readers.h"
+#include "common/byte-writers.h"
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/fusion.h"
+#include "eval/primitives.h"
+#include "eval/procedures.h"
+#include "eval/singletons.h"
+#include "eval/values.h"
+
+
+#define CODE_SIZE 128
+#define NUM_GLOBALS 8
+#define BUFFER_SIZE 256
+
+#define G_COUNTDOWN 0
+#define G_CALLEE    1
+#define G_OUTPUT    2
+#define G_ENTRY     7
+
+static
+NModule *MOD;
+
+static
+NDispatchProfile PROFILE;
+
+static
+uint8_t BUFFER[BUFFER_SIZE];
+
+static
+NError ERR;
+
+static
+int COUNTER;
+
+static NValue
+countdown_function(int n_args, NValue *args, NError *error);
+
+
+CONSTRUCTOR(constructor) {
+    NT_INITIALIZE_MODULE(n_init_eval);
+    ERR = n_error_ok();
+
+    MOD = n_create_module(NUM_GLOBALS, CODE_SIZE, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module.", NULL);
+    }
+
+    MOD->globals[G_COUNTDOWN] =
+        n_create_primitive(countdown_function, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create countdown primitive.", NULL);
+    }
+
+    MOD->globals[G_CALLEE] = n_create_procedure(MOD, 64, 1, 1, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create callee procedure.", NULL);
+    }
+
+    MOD->globals[G_ENTRY] = n_create_procedure(MOD, 0, 4, 4, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module's entry procedure.", NULL);
+    }
+    MOD->entry_point = G_ENTRY;
+}
+
+
+SETUP(setup) {
+    unsigned char *code = MOD->code;
+    int i;
+    for (i = 0; i < CODE_SIZE; i++) {
+        n_encode_op_nop(code+i);
+    }
+
+    /* Entry procedure: while the countdown primitive returns true, passes
+     * a constant to the callee and stores its result in a global. Every
+     * fused pattern shows up at least once. */
+    n_encode_op_global_ref(code+0, 0, G_COUNTDOWN);
+    n_encode_op_global_ref(code+4, 1, G_CALLEE);
+    n_encode_op_call(code+8, 2, 0, 0);
+    n_encode_op_load_i16(code+12, 3, 7);
+    n_encode_op_jump_unless(code+16, 2, 8);
+    n_encode_op_halt(code+20);
+    n_encode_op_load_i16(code+24, 3, 5);
+    n_encode_op_call(code+28, 2, 1, 1);
+    code[32] = 3;
+    n_encode_op_global_set(code+33, G_OUTPUT, 2);
+    n_encode_op_jump(code+37, -37);
+
+    /* Callee: returns its argument. */
+    n_encode_op_return(code+64, 1);
+
+    MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+
+    n_set_active_fusions(N_ALL_FUSIONS);
+    n_reset_dispatch_profile(&PROFILE);
+    ERR = n_error_ok();
+}
+
+
+TEARDOWN(teardown) {
+    n_set_active_fusions(N_ALL_FUSIONS);
+    n_destroy_error(&ERR);
+}
+
+
+static void
+run_module(NEvaluator *eval, NFusionSet fusions) {
+    n_set_active_fusions(fusions);
+    n_predecode_module(MOD, &ERR);
+    if (!n_is_ok(&ERR)) {
+        return;
+    }
+
+    n_construct_evaluator(eval);
+    n_prepare_evaluator(eval, MOD, &ERR);
+    if (!n_is_ok(&ERR)) {
+        return;
+    }
+
+    COUNTER = 3;
+    n_evaluator_run(eval, &ERR);
+}
+
+
+#ifndef N_PROFILE_DISPATCH
+static uint8_t
+opcode_at(uint32_t pc) {
+    return MOD->decoded->instructions[pc].opcode;
+}
+
+
+TEST(triples_win_over_pairs) {
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode_at(0), N_FUSED_GLOBAL_REF_GLOBAL_REF_CALL));
+    ASSERT(EQ_UINT(opcode_at(4), N_FUSED_GLOBAL_REF_CALL));
+    ASSERT(EQ_UINT(opcode_at(8), N_OP_CALL));
+    ASSERT(EQ_UINT(opcode_at(12), N_FUSED_LOAD_I16_JUMP_UNLESS));
+    ASSERT(EQ_UINT(opcode_at(24), N_FUSED_LOAD_I16_CALL));
+    ASSERT(EQ_UINT(opcode_at(33), N_FUSED_GLOBAL_SET_JUMP));
+}
+
+
+TEST(fuses_only_active_patterns) {
+    n_set_active_fusions(n_fusion_bit(N_FUSED_GLOBAL_REF_CALL));
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode_at(0), N_OP_GLOBAL_REF));
+    ASSERT(EQ_UINT(opcode_at(4), N_FUSED_GLOBAL_REF_CALL));
+    ASSERT(EQ_UINT(opcode_at(12), N_OP_LOAD_I16));
+}
+
+
+TEST(does_not_fuse_past_end_of_code) {
+    n_encode_op_global_ref(MOD->code+CODE_SIZE-8, 0, G_COUNTDOWN);
+    n_encode_op_global_ref(MOD->code+CODE_SIZE-4, 0, G_COUNTDOWN);
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(opcode_at(CODE_SIZE-8), N_FUSED_GLOBAL_REF_GLOBAL_REF));
+    ASSERT(EQ_UINT(opcode_at(CODE_SIZE-4), N_OP_GLOBAL_REF));
+}
+
+
+TEST(fused_run_matches_unfused_run) {
+    NEvaluator fused, unfused;
+
+    run_module(&unfused, N_NO_FUSIONS);
+    ASSERT(IS_OK(ERR));
+    MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+
+    run_module(&fused, N_ALL_FUSIONS);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_INT(COUNTER, 0));
+    ASSERT(EQ_INT(fused.pc, 20));
+    ASSERT(EQ_INT(fused.pc, unfused.pc));
+    ASSERT(EQ_INT(fused.fp, unfused.fp));
+    ASSERT(EQ_INT(fused.sp, unfused.sp));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(5))));
+    n_destruct_evaluator(&fused);
+    n_destruct_evaluator(&unfused);
+}
+
+#else
+
+TEST(counts_sequences_that_fall_through) {
+    NEvaluator eval;
+    NDispatchProfile *profile = n_global_dispatch_profile();
+    n_reset_dispatch_profile(profile);
+
+    run_module(&eval, N_ALL_FUSIONS);
+    ASSERT(IS_OK(ERR));
+
+    /* The entry procedure runs its loop three times, then once more until
+     * it halts. */
+    ASSERT(EQ_UINT(profile->pairs[N_OP_GLOBAL_REF][N_OP_CALL], 4));
+    ASSERT(EQ_UINT(
+        profile->triples[N_OP_GLOBAL_REF][N_OP_GLOBAL_REF][N_OP_CALL], 4));
+    ASSERT(EQ_UINT(profile->pairs[N_OP_LOAD_I16][N_OP_CALL], 3));
+    /* The jump back to the start does not fall through. */
+    ASSERT(EQ_UINT(profile->pairs[N_OP_JUMP][N_OP_GLOBAL_REF], 0));
+    n_destruct_evaluator(&eval);
+}
+
+#endif /* N_PROFILE_DISPATCH */
+
+
+TEST(selects_fusions_over_threshold) {
+    NFusionSet selected;
+    PROFILE.pairs[N_OP_GLOBAL_REF][N_OP_CALL] = 10;
+    PROFILE.pairs[N_OP_LOAD_I16][N_OP_JUMP_UNLESS] = 4;
+    PROFILE.triples[N_OP_GLOBAL_REF][N_OP_LOAD_I16][N_OP_CALL] = 5;
+
+    selected = n_select_fusions(&PROFILE, 5);
+
+    ASSERT(EQ_UINT(selected, n_fusion_bit(N_FUSED_GLOBAL_REF_CALL)
+                           | n_fusion_bit(N_FUSED_GLOBAL_REF_LOAD_I16_CALL)));
+}
+
+
+TEST(profile_survives_round_trip) {
+    NDispatchProfile read;
+    NByteWriter *writer;
+    NByteReader *reader;
+    PROFILE.pairs[N_OP_GLOBAL_REF][N_OP_CALL] = 10;
+    PROFILE.triples[N_OP_LOAD_I16][N_OP_GLOBAL_REF][N_OP_CALL] = 70000;
+
+    writer = n_create_memory_byte_writer(BUFFER, BUFFER_SIZE, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_write_dispatch_profile(writer, &PROFILE, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_destroy_byte_writer(writer, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    reader = n_new_byte_reader_from_data(BUFFER, BUFFER_SIZE, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_read_dispatch_profile(reader, &read, &ERR);
+    n_destroy_byte_reader(reader, NULL);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(EQ_UINT(read.pairs[N_OP_GLOBAL_REF][N_OP_CALL], 10));
+    ASSERT(EQ_UINT(
+        read.triples[N_OP_LOAD_I16][N_OP_GLOBAL_REF][N_OP_CALL], 70000));
+    ASSERT(EQ_UINT(read.pairs[N_OP_CALL][N_OP_GLOBAL_REF], 0));
+}
+
+
+TEST(profile_from_other_version_is_rejected) {
+    NDispatchProfile read;
+    NByteReader *reader;
+    BUFFER[0] = 0x7F;
+
+    reader = n_new_byte_reader_from_data(BUFFER, BUFFER_SIZE, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_read_dispatch_profile(reader, &read, &ERR);
+    n_destroy_byte_reader(reader, NULL);
+
+    ASSERT(IS_ERROR(ERR, "nuvm.InvalidProfileFormat"));
+}
+
+
+AtTest* tests[] = {
+#ifndef N_PROFILE_DISPATCH
+    &triples_win_over_pairs,
+    &fuses_only_active_patterns,
+    &does_not_fuse_past_end_of_code,
+    &fused_run_matches_unfused_run,
+#else
+    &counts_sequences_that_fall_through,
+#endif
+    &selects_fusions_over_threshold,
+    &profile_survives_round_trip,
+    &profile_from_other_version_is_rejected,
+    NULL
+};
+
+
+TEST_RUNNER("Fusion", tests, constructor, NULL, setup, teardown)
+
+
+static NValue
+countdown_function(int n_args, NValue *args, NError *error) {
+    if (COUNTER > 0) {
+        COUNTER--;
+        return N_TRUE;
+    }
+    return N_FALSE;
+}
@@ -0,0 +1,642 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/heap.h"
+#include "eval/isolate.h"
+#include "eval/primitives.h"
+#include "eval/procedures.h"
+#include "eval/scheduler.h"
+#include "eval/singletons.h"
+#include "eval/type-registry.h"
+#include "eval/values.h"
+
+
+#define NUM_GLOBALS 4
+#define CODE_SIZE 64
+#define LONG_LIST 100000
+#define SHORT_LIST 2000
+
+#define G_ENTRY   0
+#define G_INNER   1
+#define G_COLLECT 2
+#define G_OTHER   3
+
+typedef struct {
+    NObject header;
+    NValue first;
+    NValue second;
+} Pair;
+
+static
+NHeap HEAP;
+
+static
+NIsolate *ISO;
+
+static
+NError ERR;
+
+static
+NType PAIR_TYPE;
+
+static void
+trace_pair(NObject* object, NHeap* heap);
+
+static NValue
+make_pair(NValue first, NValue second);
+
+static NValue
+make_list(int length);
+
+static int
+finish_collection(NHeap* heap);
+
+static NValue
+collect_function(int n_args, NValue *args, NError *error);
+
+
+CONSTRUCTOR(constructor) {
+    NT_INITIALIZE_MODULE(n_init_eval);
+    n_construct_type(&PAIR_TYPE, "test.heap.Pair");
+    PAIR_TYPE.trace = trace_pair;
+}
+
+
+SETUP(setup) {
+    ERR = n_error_ok();
+    n_construct_heap(&HEAP, NULL, NULL);
+    ISO = n_create_isolate(&ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create isolate.", NULL);
+    }
+}
+
+
+TEARDOWN(teardown) {
+    n_destroy_isolate(ISO);
+    n_destruct_heap(&HEAP);
+    n_destroy_error(&ERR);
+}
+
+
+TEST(new_objects_are_allocated_in_the_nursery) {
+    make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(HEAP.nursery_used > 0));
+    ASSERT(EQ_UINT(HEAP.allocated, 0));
+}
+
+
+TEST(unreachable_objects_are_collected) {
+    make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_collect(&HEAP);
+    ASSERT(EQ_UINT(HEAP.nursery_used, 0));
+    ASSERT(EQ_UINT(HEAP.allocated, 0));
+    ASSERT(EQ_UINT(HEAP.minor_collections, 1));
+    ASSERT(EQ_UINT(HEAP.collections, 1));
+}
+
+
+TEST(garbage_dies_young) {
+    int i;
+    for (i = 0; i < N_NURSERY_SIZE / 16; i++) {
+        make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    }
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(HEAP.minor_collections > 0));
+    ASSERT(EQ_UINT(HEAP.collections, 0));
+    ASSERT(EQ_UINT(HEAP.allocated, 0));
+}
+
+
+TEST(minor_collections_promote_what_survives) {
+    NValue root = make_pair(n_wrap_fixnum(7), N_TRUE);
+    NValue young = root;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(IS_TRUE(n_heap_collect_young(&HEAP)));
+    ASSERT(EQ_UINT(HEAP.nursery_used, 0));
+    ASSERT(IS_TRUE(HEAP.allocated >= sizeof(Pair)));
+    ASSERT(EQ_UINT(HEAP.collections, 0));
+    ASSERT(IS_TRUE(!n_eq_values(root, young)));
+    ASSERT(IS_TRUE(n_eq_values(((Pair*) n_unwrap_object(root))->first,
+                               n_wrap_fixnum(7))));
+}
+
+
+TEST(object_headers_take_a_word) {
+    ASSERT(EQ_UINT(sizeof(NObject), 8));
+}
+
+
+TEST(hashes_survive_promotion) {
+    NValue root = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    uint32_t hash;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+    hash = n_object_hash(n_unwrap_object(root));
+
+    ASSERT(IS_TRUE(n_heap_collect_young(&HEAP)));
+    ASSERT(IS_TRUE(hash != 0));
+    ASSERT(EQ_UINT(n_object_hash(n_unwrap_object(root)), hash));
+    ASSERT(EQ_PTR(n_type_of(root), &PAIR_TYPE));
+}
+
+
+TEST(roots_keep_objects_alive) {
+    NValue root = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    size_t allocated;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_collect(&HEAP);
+    allocated = HEAP.allocated;
+    ASSERT(IS_TRUE(allocated > 0));
+    n_heap_collect(&HEAP);
+    ASSERT(EQ_UINT(HEAP.allocated, allocated));
+
+    n_heap_remove_root(&HEAP, &root);
+    n_heap_collect(&HEAP);
+    ASSERT(EQ_UINT(HEAP.allocated, 0));
+}
+
+
+TEST(objects_keep_what_they_refer_to_alive) {
+    NValue leaf = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    NValue root = make_pair(leaf, make_pair(leaf, N_TRUE));
+    NValue cycle;
+    Pair *pair;
+    size_t allocated;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_collect(&HEAP);
+    allocated = HEAP.allocated;
+    cycle = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    ((Pair*) n_unwrap_object(cycle))->first = cycle;
+    n_heap_collect(&HEAP);
+
+    ASSERT(EQ_UINT(HEAP.allocated, allocated));
+    pair = (Pair*) n_unwrap_object(root);
+    ASSERT(IS_TRUE(n_eq_values(
+        pair->first, ((Pair*) n_unwrap_object(pair->second))->first)));
+}
+
+
+TEST(long_chains_are_traced) {
+    NValue root = N_FIXNUM_ZERO;
+    size_t allocated;
+    int i;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    for (i = 0; i < LONG_LIST; i++) {
+        root = make_pair(n_wrap_fixnum(i), root);
+    }
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(HEAP.minor_collections > 0));
+
+    n_heap_collect(&HEAP);
+    allocated = HEAP.allocated;
+    n_heap_collect(&HEAP);
+    ASSERT(EQ_UINT(HEAP.allocated, allocated));
+    for (i = LONG_LIST - 1; i >= 0; i--) {
+        Pair *pair = (Pair*) n_unwrap_object(root);
+        ASSERT(IS_TRUE(n_eq_values(pair->first, n_wrap_fixnum(i))));
+        root = pair->second;
+    }
+}
+
+
+TEST(old_objects_stored_into_keep_young_ones_alive) {
+    NValue root = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    NValue young;
+    Pair *old;
+    size_t allocated;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_heap_collect_young(&HEAP);
+    allocated = HEAP.allocated;
+
+    young = make_pair(n_wrap_fixnum(7), N_TRUE);
+    old = (Pair*) n_unwrap_object(root);
+    n_heap_write_barrier(&HEAP, (NObject*) old);
+    old->first = young;
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(IS_TRUE(n_heap_collect_young(&HEAP)));
+    ASSERT(IS_TRUE(HEAP.allocated > allocated));
+    ASSERT(IS_TRUE(!n_eq_values(old->first, young)));
+    ASSERT(IS_TRUE(n_eq_values(((Pair*) n_unwrap_object(old->first))->first,
+                               n_wrap_fixnum(7))));
+    ASSERT(EQ_UINT(HEAP.num_remembered, 0));
+}
+
+
+TEST(freed_cells_are_reused) {
+    NValue root = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    NValue first;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_heap_collect(&HEAP);
+    first = root;
+
+    root = N_FIXNUM_ZERO;
+    n_heap_collect(&HEAP);
+    root = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    n_heap_collect(&HEAP);
+
+    ASSERT(IS_TRUE(n_eq_values(root, first)));
+}
+
+
+TEST(large_objects_go_straight_to_the_old_generation) {
+    n_allocate_object(&HEAP, N_LARGEST_SIZE_CLASS * 4, &PAIR_TYPE, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(HEAP.allocated, N_LARGEST_SIZE_CLASS * 4));
+    ASSERT(EQ_UINT(HEAP.nursery_used, 0));
+
+    n_heap_collect(&HEAP);
+    ASSERT(EQ_UINT(HEAP.allocated, 0));
+}
+
+
+TEST(collections_follow_the_allocated_bytes) {
+    NValue root = N_FIXNUM_ZERO;
+    int i;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    for (i = 0; i < N_GC_MIN_THRESHOLD / 16; i++) {
+        root = make_pair(N_FIXNUM_ZERO, root);
+    }
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(HEAP.collections > 0));
+    ASSERT(IS_TRUE(HEAP.allocated < HEAP.threshold));
+}
+
+
+TEST(objects_without_a_heap_are_left_alone) {
+    NValue primitive = n_create_primitive(collect_function, &ERR);
+    NValue root = make_pair(primitive, N_FIXNUM_ZERO);
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_collect(&HEAP);
+    ASSERT(IS_TRUE(n_eq_values(((Pair*) n_unwrap_object(root))->first,
+                               primitive)));
+}
+
+
+TEST(module_globals_keep_objects_alive) {
+    NModule *module = n_create_module_in(ISO, 2, 4, &ERR);
+    size_t allocated;
+    ASSERT(IS_OK(ERR));
+
+    module->globals[0] = n_create_procedure(module, 0, 1, 1, 4, &ERR);
+    n_heap_collect(&ISO->heap);
+    allocated = ISO->heap.allocated;
+    n_create_procedure(module, 0, 1, 1, 4, &ERR);
+    n_create_primitive_in(ISO, collect_function, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_collect(&ISO->heap);
+    ASSERT(EQ_UINT(ISO->heap.allocated, allocated));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[0])));
+    ASSERT(IS_TRUE(((NProcedure*) n_unwrap_object(module->globals[0]))->module
+                   == module));
+}
+
+
+TEST(evaluator_stacks_keep_objects_alive) {
+    NEvaluator evaluator;
+    NModule *module = n_create_module_in(ISO, 2, 4, &ERR);
+    NValue local;
+    ASSERT(IS_OK(ERR));
+
+    module->globals[0] = n_create_procedure(module, 0, 1, 1, 4, &ERR);
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    n_evaluator_set_local(&evaluator, 0,
+                          n_create_primitive_in(ISO, collect_function, &ERR),
+                          &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(evaluator.isolate == ISO));
+
+    n_heap_collect(&ISO->heap);
+    n_create_primitive_in(ISO, collect_function, &ERR);
+    n_heap_collect(&ISO->heap);
+    local = n_evaluator_get_local(&evaluator, 0, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_is_primitive(local)));
+    ASSERT(IS_TRUE(
+        ((NPrimitive*) n_unwrap_object(local))->func == collect_function));
+
+    n_destruct_evaluator(&evaluator);
+    ASSERT(IS_TRUE(ISO->evaluators == NULL));
+}
+
+
+/* The inner procedure keeps a procedure only on its own frame while the
+ * primitive it calls runs a collection. */
+TEST(collections_inside_primitives_see_every_frame) {
+    NEvaluator evaluator;
+    NModule *module = n_create_module_in(ISO, NUM_GLOBALS, CODE_SIZE, &ERR);
+    unsigned char *code;
+    int pc = 0;
+    ASSERT(IS_OK(ERR));
+
+    code = module->code;
+    module->globals[G_ENTRY] = n_create_procedure(module, 0, 1, 1, 8, &ERR);
+    module->globals[G_INNER] = n_create_procedure(module, 16, 3, 3, 24, &ERR);
+    module->globals[G_COLLECT] =
+        n_create_primitive_in(ISO, collect_function, &ERR);
+    module->globals[G_OTHER] = n_create_procedure(module, 40, 2, 2, 8, &ERR);
+    module->entry_point = G_ENTRY;
+    ASSERT(IS_OK(ERR));
+
+    pc += n_encode_op_global_ref(code+pc, 0, G_INNER);
+    pc += n_encode_op_call(code+pc, 0, 0, 0);
+    n_encode_op_halt(code+pc);
+
+    pc = 16;
+    pc += n_encode_op_global_ref(code+pc, 0, G_OTHER);
+    pc += n_encode_op_load_i16(code+pc, 1, 0);
+    pc += n_encode_op_global_set(code+pc, G_OTHER, 1);
+    pc += n_encode_op_global_ref(code+pc, 2, G_COLLECT);
+    pc += n_encode_op_call(code+pc, 1, 2, 0);
+    pc += n_encode_op_global_set(code+pc, G_OTHER, 0);
+    n_encode_op_return(code+pc, 1);
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    n_evaluator_run(&evaluator, &ERR);
+    n_destruct_evaluator(&evaluator);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(ISO->heap.collections > 0));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[G_OTHER])));
+    ASSERT(EQ_INT(
+        ((NProcedure*) n_unwrap_object(module->globals[G_OTHER]))->entry, 40));
+}
+
+
+/* The primitive returns its argument after a collection moved it. */
+TEST(primitives_see_their_arguments_moved) {
+    NEvaluator evaluator;
+    NModule *module = n_create_module_in(ISO, NUM_GLOBALS, CODE_SIZE, &ERR);
+    unsigned char *code;
+    int pc = 0;
+    ASSERT(IS_OK(ERR));
+
+    code = module->code;
+    module->globals[G_ENTRY] = n_create_procedure(module, 0, 3, 3, 16, &ERR);
+    module->globals[G_COLLECT] =
+        n_create_primitive_in(ISO, collect_function, &ERR);
+    module->globals[G_OTHER] = n_create_procedure(module, 40, 2, 2, 8, &ERR);
+    module->entry_point = G_ENTRY;
+    ASSERT(IS_OK(ERR));
+
+    pc += n_encode_op_global_ref(code+pc, 0, G_OTHER);
+    pc += n_encode_op_global_ref(code+pc, 1, G_COLLECT);
+    pc += n_encode_op_call(code+pc, 2, 1, 1);
+    code[pc++] = 0;
+    pc += n_encode_op_global_set(code+pc, G_INNER, 2);
+    n_encode_op_halt(code+pc);
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    n_evaluator_run(&evaluator, &ERR);
+    n_destruct_evaluator(&evaluator);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[G_INNER],
+                               module->globals[G_OTHER])));
+}
+
+
+TEST(incremental_collections_run_in_steps) {
+    NValue root = make_list(SHORT_LIST);
+    size_t allocated;
+    int steps = 0;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_heap_collect(&HEAP);
+    allocated = HEAP.allocated;
+
+    n_heap_start_collection(&HEAP);
+    ASSERT(EQ_INT(HEAP.phase, N_GC_MARKING));
+    steps = finish_collection(&HEAP);
+
+    ASSERT(IS_TRUE(steps > SHORT_LIST / N_GC_STEP_WORK));
+    ASSERT(EQ_INT(HEAP.phase, N_GC_IDLE));
+    ASSERT(EQ_UINT(HEAP.collections, 2));
+    ASSERT(EQ_UINT(HEAP.allocated, allocated));
+}
+
+
+TEST(incremental_collections_sweep_garbage) {
+    NValue root = make_list(SHORT_LIST);
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_heap_collect(&HEAP);
+
+    root = N_FIXNUM_ZERO;
+    n_heap_start_collection(&HEAP);
+    finish_collection(&HEAP);
+    ASSERT(EQ_UINT(HEAP.allocated, 0));
+}
+
+
+/* The inner pair is only reachable from a root added after marking began
+ * once the outer one lets go of it. */
+TEST(stores_while_marking_keep_what_was_reachable) {
+    NValue root = make_pair(make_pair(n_wrap_fixnum(7), N_TRUE),
+                            N_FIXNUM_ZERO);
+    NValue inner = N_FIXNUM_ZERO;
+    Pair *outer;
+    size_t allocated;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    n_heap_add_root(&HEAP, &inner, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_heap_collect(&HEAP);
+    allocated = HEAP.allocated;
+
+    n_heap_start_collection(&HEAP);
+    outer = (Pair*) n_unwrap_object(root);
+    inner = outer->first;
+    n_heap_write_barrier(&HEAP, (NObject*) outer);
+    outer->first = N_FIXNUM_ZERO;
+    finish_collection(&HEAP);
+
+    ASSERT(EQ_UINT(HEAP.allocated, allocated));
+}
+
+
+TEST(objects_promoted_while_marking_survive) {
+    NValue root = N_FIXNUM_ZERO;
+    n_heap_add_root(&HEAP, &root, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_start_collection(&HEAP);
+    root = make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    ASSERT(IS_TRUE(n_heap_collect_young(&HEAP)));
+    ASSERT(EQ_INT(HEAP.phase, N_GC_MARKING));
+    finish_collection(&HEAP);
+
+    ASSERT(IS_TRUE(HEAP.allocated >= sizeof(Pair)));
+}
+
+
+TEST(pauses_are_counted) {
+    uint32_t pauses = 0;
+    int i;
+    n_heap_collect(&HEAP);
+    for (i = 0; i < N_NURSERY_SIZE / 16; i++) {
+        make_pair(N_FIXNUM_ZERO, N_FIXNUM_ZERO);
+    }
+    ASSERT(IS_OK(ERR));
+
+    for (i = 0; i < N_PAUSE_BUCKETS; i++) {
+        pauses += HEAP.pauses[i];
+    }
+    ASSERT(EQ_UINT(pauses, HEAP.minor_collections));
+    ASSERT(IS_TRUE(HEAP.longest_pause < 1000000));
+}
+
+
+TEST(schedulers_step_incremental_collections) {
+    NEvaluator evaluator;
+    NScheduler scheduler;
+    NModule *module = n_create_module_in(ISO, NUM_GLOBALS, CODE_SIZE, &ERR);
+    unsigned char *code;
+    ASSERT(IS_OK(ERR));
+
+    /* Entry procedure: counts up to 100, spending a unit of fuel per
+     * number. */
+    code = module->code;
+    module->globals[G_ENTRY] = n_create_procedure(module, 0, 4, 4, 36, &ERR);
+    module->entry_point = G_ENTRY;
+    n_encode_op_load_i16(code+0, 0, 100);
+    n_encode_op_load_i16(code+4, 1, 0);
+    n_encode_op_load_i16(code+8, 2, 0);
+    n_encode_op_load_i16(code+12, 3, 1);
+    n_encode_op_jump_if_le(code+16, 0, 1, 16);
+    n_encode_op_add(code+21, 2, 2, 1);
+    n_encode_op_add(code+25, 1, 1, 3);
+    n_encode_op_jump(code+29, -13);
+    n_encode_op_halt(code+32);
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    n_construct_scheduler(&scheduler, 16);
+    n_scheduler_spawn(&scheduler, &evaluator, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_heap_start_collection(&ISO->heap);
+    ASSERT(EQ_INT(ISO->heap.phase, N_GC_MARKING));
+    n_scheduler_run(&scheduler);
+    n_destruct_scheduler(&scheduler);
+    n_destruct_evaluator(&evaluator);
+
+    ASSERT(EQ_INT(ISO->heap.phase, N_GC_IDLE));
+    ASSERT(EQ_UINT(ISO->heap.collections, 1));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[G_ENTRY])));
+}
+
+
+AtTest* tests[] = {
+    &new_objects_are_allocated_in_the_nursery,
+    &unreachable_objects_are_collected,
+    &garbage_dies_young,
+    &minor_collections_promote_what_survives,
+    &object_headers_take_a_word,
+    &hashes_survive_promotion,
+    &roots_keep_objects_alive,
+    &objects_keep_what_they_refer_to_alive,
+    &long_chains_are_traced,
+    &old_objects_stored_into_keep_young_ones_alive,
+    &freed_cells_are_reused,
+    &large_objects_go_straight_to_the_old_generation,
+    &collections_follow_the_allocated_bytes,
+    &objects_without_a_heap_are_left_alone,
+    &module_globals_keep_objects_alive,
+    &evaluator_stacks_keep_objects_alive,
+    &collections_inside_primitives_see_every_frame,
+    &primitives_see_their_arguments_moved,
+    &incremental_collections_run_in_steps,
+    &incremental_collections_sweep_garbage,
+    &stores_while_marking_keep_what_was_reachable,
+    &objects_promoted_while_marking_survive,
+    &pauses_are_counted,
+    &schedulers_step_incremental_collections,
+    NULL
+};
+
+TEST_RUNNER("Heap", tests, constructor, NULL, setup, teardown)
+
+
+static void
+trace_pair(NObject* object, NHeap* heap) {
+    Pair *pair = (Pair*) object;
+    n_trace_value(heap, &pair->first);
+    n_trace_value(heap, &pair->second);
+}
+
+
+/* The fields are roots while the pair is allocated, since the objects they
+ * refer to may move. */
+static NValue
+make_pair(NValue first, NValue second) {
+    Pair *pair;
+    n_heap_add_root(&HEAP, &first, &ERR);
+    n_heap_add_root(&HEAP, &second, &ERR);
+    pair = (Pair*) n_allocate_object(&HEAP, sizeof(Pair), &PAIR_TYPE, &ERR);
+    n_heap_remove_root(&HEAP, &second);
+    n_heap_remove_root(&HEAP, &first);
+    if (pair == NULL) {
+        return N_FIXNUM_ZERO;
+    }
+    pair->first = first;
+    pair->second = second;
+    return n_wrap_object((NObject*) pair);
+}
+
+
+/* Returns its first argument, if any. */
+static NValue
+collect_function(int n_args, NValue *args, NError *error) {
+    n_heap_collect(&ISO->heap);
+    return n_args > 0 ? args[0] : N_FIXNUM_ZERO;
+}
+
+
+static NValue
+make_list(int length) {
+    NValue list = N_FIXNUM_ZERO;
+    int i;
+    for (i = 0; i < length; i++) {
+        list = make_pair(n_wrap_fixnum(i), list);
+    }
+    return list;
+}
+
+
+/* Steps through the collection in progress, returning the number of
+ * steps it took. */
+static int
+finish_collection(NHeap* heap) {
+    int steps = 1;
+    while (n_heap_step(heap)) {
+        steps++;
+    }
+    return steps;
+}
@@ -0,0 +1,242 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+#include "common/byte-readers.h"
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/isolate.h"
+#include "eval/loader.h"
+#include "eval/procedures.h"
+#include "eval/values.h"
+
+
+static
+NIsolate *ISO;
+
+static
+NError ERR;
+
+
+CONSTRUCTOR(constructor) {
+    NT_INITIALIZE_MODULE(n_init_eval);
+}
+
+
+SETUP(setup) {
+    ERR = n_error_ok();
+    ISO = n_create_isolate(&ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create isolate.", NULL);
+    }
+}
+
+
+TEARDOWN(teardown) {
+    n_destroy_isolate(ISO);
+    n_destroy_error(&ERR);
+}
+
+
+TEST(allocations_are_aligned_and_accounted_for) {
+    void *first = n_isolate_allocate(ISO, 3, &ERR);
+    void *second = n_isolate_allocate(ISO, 5, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(((size_t) first & 3) == 0));
+    ASSERT(IS_TRUE(((size_t) second & 3) == 0));
+    ASSERT(IS_TRUE((char*) second >= (char*) first + 3));
+    ASSERT(IS_TRUE(ISO->arena.allocated >= 8));
+}
+
+
+TEST(big_allocations_leave_the_current_block_alone) {
+    char *first = n_isolate_allocate(ISO, 16, &ERR);
+    char *big = n_isolate_allocate(ISO, N_HEAP_BLOCK_SIZE * 2, &ERR);
+    char *second = n_isolate_allocate(ISO, 16, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(big != NULL));
+    ASSERT(IS_TRUE(second == first + 16));
+    ASSERT(IS_TRUE(ISO->arena.allocated >= N_HEAP_BLOCK_SIZE * 2 + 32));
+}
+
+
+TEST(modules_and_their_procedures_live_in_the_heap) {
+    NModule *module = n_create_module_in(ISO, 2, 8, &ERR);
+    size_t allocated;
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(module->isolate == ISO));
+    ASSERT(IS_TRUE(ISO->modules == module));
+
+    allocated = ISO->heap.nursery_used;
+    module->globals[0] = n_create_procedure(module, 0, 1, 1, 8, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(ISO->heap.nursery_used >= allocated + sizeof(NProcedure)));
+    ASSERT(IS_TRUE(((NProcedure*) n_unwrap_object(module->globals[0]))->module
+                   == module));
+}
+
+
+TEST(modules_can_be_read_into_an_isolate) {
+    NModule* module;
+    uint8_t data[] = {
+        /* num_globals = 1 */
+        0x01, 0x00,
+        /* code_size = 2 */
+        0x02, 0x00, 0x00, 0x00,
+        /* global[0] = procedure(0, 1, 1, 2) */
+        0x01, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x02, 0x00,
+        0x81, 0x82
+    };
+    NByteReader* reader =
+        n_new_byte_reader_from_data(data, sizeof(data)/sizeof(uint8_t), &ERR);
+    ASSERT(IS_OK(ERR));
+
+    module = n_read_module_in(ISO, reader, &ERR);
+    n_destroy_byte_reader(reader, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(module->isolate == ISO));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[0])));
+    ASSERT(EQ_INT(module->code[1], 0x82));
+}
+
+
+TEST(evaluators_run_modules_of_an_isolate) {
+    NEvaluator evaluator;
+    NModule *module = n_create_module_in(ISO, 2, 12, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    module->globals[0] = n_create_procedure(module, 0, 1, 1, 12, &ERR);
+    ASSERT(IS_OK(ERR));
+    module->entry_point = 0;
+    n_encode_op_load_i16(module->code+0, 0, 42);
+    n_encode_op_global_set(module->code+4, 1, 0);
+    n_encode_op_halt(module->code+8);
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    n_evaluator_run(&evaluator, &ERR);
+    n_destruct_evaluator(&evaluator);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[1], n_wrap_fixnum(42))));
+}
+
+
+TEST(destroying_a_module_of_an_isolate_keeps_it_in_the_heap) {
+    NModule *module = n_create_module_in(ISO, 1, 4, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_predecode_module(module, &ERR);
+    ASSERT(IS_OK(ERR));
+
+    n_destroy_module(module);
+    ASSERT(IS_TRUE(module->decoded == NULL));
+    ASSERT(IS_TRUE(ISO->modules == module));
+}
+
+
+TEST(types_registered_in_an_isolate_stay_in_it) {
+    NIsolate *other = n_create_isolate(&ERR);
+    NType type;
+    ASSERT(IS_OK(ERR));
+
+    n_construct_type(&type, "test.isolate.Type");
+    n_isolate_register_type(ISO, &type, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_isolate_find_type(ISO, "test.isolate.Type", &ERR)
+                   == &type));
+    ASSERT(IS_OK(ERR));
+
+    n_isolate_find_type(other, "test.isolate.Type", &ERR);
+    ASSERT(IS_ERROR(ERR, "nuvm.types.UnknownType"));
+    ERR = n_error_ok();
+
+    n_find_type("test.isolate.Type", &ERR);
+    ASSERT(IS_ERROR(ERR, "nuvm.types.UnknownType"));
+    n_destroy_isolate(other);
+}
+
+
+TEST(isolates_see_the_built_in_types) {
+    ASSERT(IS_TRUE(n_isolate_find_type(ISO, "nuvm.Boolean", &ERR)
+                   == n_find_type("nuvm.Boolean", &ERR)));
+    ASSERT(IS_OK(ERR));
+}
+
+
+TEST(isolates_cant_shadow_the_built_in_types) {
+    NType type;
+
+    n_construct_type(&type, "nuvm.Boolean");
+    n_isolate_register_type(ISO, &type, &ERR);
+    ASSERT(IS_ERROR(ERR, "nuvm.types.RepeatedName"));
+}
+
+
+TEST(isolates_can_be_entered_again_by_the_same_thread) {
+    n_enter_isolate(ISO, &ERR);
+    n_enter_isolate(ISO, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(ISO->entered, 2));
+
+    n_exit_isolate(ISO);
+    n_exit_isolate(ISO);
+    ASSERT(EQ_INT(ISO->entered, 0));
+}
+
+
+#ifdef N_THREADS_ENABLED
+static void*
+enter_isolate(void* data) {
+    NError *error = data;
+    n_enter_isolate(ISO, error);
+    if (n_is_ok(error)) {
+        n_exit_isolate(ISO);
+    }
+    return NULL;
+}
+
+
+TEST(isolates_are_pinned_to_the_thread_that_entered_them) {
+    pthread_t thread;
+    NError error = n_error_ok();
+
+    n_enter_isolate(ISO, &ERR);
+    ASSERT(IS_OK(ERR));
+    pthread_create(&thread, NULL, enter_isolate, &error);
+    pthread_join(thread, NULL);
+    ASSERT(IS_ERROR(error, "nuvm.IsolateBusy"));
+    n_destroy_error(&error);
+
+    n_exit_isolate(ISO);
+    error = n_error_ok();
+    pthread_create(&thread, NULL, enter_isolate, &error);
+    pthread_join(thread, NULL);
+    ASSERT(IS_OK(error));
+}
+#endif /* N_THREADS_ENABLED */
+
+
+AtTest* tests[] = {
+    &allocations_are_aligned_and_accounted_for,
+    &big_allocations_leave_the_current_block_alone,
+    &modules_and_their_procedures_live_in_the_heap,
+    &modules_can_be_read_into_an_isolate,
+    &evaluators_run_modules_of_an_isolate,
+    &destroying_a_module_of_an_isolate_keeps_it_in_the_heap,
+    &types_registered_in_an_isolate_stay_in_it,
+    &isolates_see_the_built_in_types,
+    &isolates_cant_shadow_the_built_in_types,
+    &isolates_can_be_entered_again_by_the_same_thread,
+#ifdef N_THREADS_ENABLED
+    &isolates_are_pinned_to_the_thread_that_entered_them,
+#endif
+    NULL
+};
+
+TEST_RUNNER("Isolate", tests, constructor, NULL, setup, teardown)
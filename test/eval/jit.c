@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/jit.h"
+#include "eval/loader.h"
+#include "eval/modules.h"
+#include "eval/procedures.h"
+#include "eval/singletons.h"
+#include "eval/values.h"
+
+
+#define CODE_SIZE 256
+#define NUM_GLOBALS 10
+
+#define G_TARGET    0
+#define G_OUTPUT    1
+#define G_SUM       2
+#define G_FIB       3
+#define G_OVERFLOW  4
+#define G_BIG       5
+#define G_ARGUMENT  6
+#define G_ENTRY     7
+#define G_BACKWARD  8
+#define G_FORWARD   9
+
+#define SUM_ENTRY      64
+#define FIB_ENTRY      128
+#define OVERFLOW_ENTRY 192
+#define BACKWARD_ENTRY 224
+#define FORWARD_ENTRY  240
+
+static
+NModule *MOD;
+
+static
+NEvaluator EVAL;
+
+static
+NError ERR;
+
+static void
+create_procedure(int global, uint32_t entry, uint8_t num_locals,
+                 uint16_t size);
+
+static void
+prepare_target(int global, NFixnum argument);
+
+static void
+run_target(int global, NFixnum argument);
+
+static int
+is_compiled(uint32_t entry);
+
+
+CONSTRUCTOR(constructor) {
+    NT_INITIALIZE_MODULE(n_init_eval);
+    ERR = n_error_ok();
+
+    MOD = n_create_module(NUM_GLOBALS, CODE_SIZE, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module.", NULL);
+    }
+
+    create_procedure(G_ENTRY, 0, 3, 18);
+    create_procedure(G_SUM, SUM_ENTRY, 4, 30);
+    create_procedure(G_FIB, FIB_ENTRY, 4, 43);
+    create_procedure(G_OVERFLOW, OVERFLOW_ENTRY, 2, 10);
+    create_procedure(G_BACKWARD, BACKWARD_ENTRY, 1, 4);
+    create_procedure(G_FORWARD, FORWARD_ENTRY, 1, 4);
+    MOD->entry_point = G_ENTRY;
+}
+
+
+SETUP(setup) {
+    unsigned char *code = MOD->code;
+    int i;
+    for (i = 0; i < CODE_SIZE; i++) {
+        n_encode_op_nop(code+i);
+    }
+
+    /* Entry procedure: calls the procedure in G_TARGET with the one in
+     * G_ARGUMENT, and stores its result in G_OUTPUT. */
+    n_encode_op_global_ref(code+0, 0, G_TARGET);
+    n_encode_op_global_ref(code+4, 1, G_ARGUMENT);
+    n_encode_op_call(code+8, 2, 0, 1);
+    code[12] = 1;
+    n_encode_op_global_set(code+13, G_OUTPUT, 2);
+    n_encode_op_halt(code+17);
+
+    /* Sum: adds the numbers below its argument in a loop. */
+    n_encode_op_load_i16(code+64, 0, 0);
+    n_encode_op_load_i16(code+68, 2, 0);
+    n_encode_op_load_i16(code+72, 3, 1);
+    n_encode_op_jump_if_le(code+76, 4, 0, 16);
+    n_encode_op_add(code+81, 2, 2, 0);
+    n_encode_op_add(code+85, 0, 0, 3);
+    n_encode_op_jump(code+89, -13);
+    n_encode_op_return(code+92, 2);
+
+    /* Fib: the naive recursive Fibonacci, calling itself twice. */
+    n_encode_op_load_i16(code+128, 0, 2);
+    n_encode_op_jump_if_lt(code+132, 4, 0, 37);
+    n_encode_op_load_i16(code+137, 1, 1);
+    n_encode_op_sub(code+141, 1, 4, 1);
+    n_encode_op_global_ref(code+145, 2, G_FIB);
+    n_encode_op_call(code+149, 3, 2, 1);
+    code[153] = 1;
+    n_encode_op_sub(code+154, 1, 4, 0);
+    n_encode_op_call(code+158, 1, 2, 1);
+    code[162] = 1;
+    n_encode_op_add(code+163, 3, 3, 1);
+    n_encode_op_return(code+167, 3);
+    n_encode_op_return(code+169, 4);
+
+    /* Overflow: doubles the biggest fixnum. */
+    n_encode_op_global_ref(code+192, 0, G_BIG);
+    n_encode_op_add(code+196, 1, 0, 0);
+    n_encode_op_return(code+200, 1);
+
+    /* Jumps out of the code, before its start and past its end. */
+    n_encode_op_jump(code+225, -300);
+    n_encode_op_jump(code+241, 100);
+
+    MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+    MOD->globals[G_BIG] = n_wrap_fixnum(N_FIXNUM_MAX);
+
+    ERR = n_error_ok();
+    n_predecode_module(MOD, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't predecode module.", NULL);
+    }
+    n_set_jit_threshold(1);
+    n_construct_evaluator(&EVAL);
+}
+
+
+TEARDOWN(teardown) {
+    n_set_jit_threshold(N_JIT_DEFAULT_THRESHOLD);
+    n_destruct_evaluator(&EVAL);
+    n_destroy_error(&ERR);
+}
+
+
+TEST(hot_procedure_is_compiled) {
+    run_target(G_SUM, 1000);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(EVAL.pc, 17));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT],
+                               n_wrap_fixnum(499500))));
+#ifdef N_JIT_ENABLED
+    ASSERT(IS_TRUE(is_compiled(SUM_ENTRY)));
+#else
+    ASSERT(IS_NULL(MOD->code_cache));
+#endif
+}
+
+
+TEST(procedure_is_not_compiled_before_threshold) {
+    n_set_jit_threshold(2);
+    run_target(G_SUM, 10);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(!is_compiled(SUM_ENTRY)));
+
+    run_target(G_SUM, 10);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(45))));
+#ifdef N_JIT_ENABLED
+    ASSERT(IS_TRUE(is_compiled(SUM_ENTRY)));
+#endif
+}
+
+
+TEST(native_and_interpreted_frames_call_each_other) {
+    run_target(G_FIB, 20);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(EVAL.pc, 17));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(6765))));
+#ifdef N_JIT_ENABLED
+    ASSERT(IS_TRUE(is_compiled(FIB_ENTRY)));
+#endif
+}
+
+
+TEST(overflow_in_native_code_is_reported_at_its_instruction) {
+    run_target(G_OVERFLOW, 0);
+
+    ASSERT(IS_ERROR(ERR, "nuvm.Overflow"));
+    ASSERT(EQ_INT(EVAL.pc, 196));
+}
+
+
+TEST(native_loops_spend_fuel) {
+    uint32_t fuel;
+    prepare_target(G_SUM, 1000);
+    ASSERT(IS_OK(ERR));
+
+    fuel = n_evaluator_run_for(&EVAL, 100, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_UINT(fuel, 0));
+    ASSERT(IS_TRUE(!EVAL.halted));
+#ifdef N_JIT_ENABLED
+    ASSERT(IS_TRUE(is_compiled(SUM_ENTRY)));
+#endif
+
+    n_evaluator_run(&EVAL, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT],
+                               n_wrap_fixnum(499500))));
+}
+
+
+TEST(predecode_drops_native_code) {
+    run_target(G_SUM, 10);
+    ASSERT(IS_OK(ERR));
+
+    n_predecode_module(MOD, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_NULL(MOD->code_cache));
+}
+
+
+TEST(lazy_globals_are_left_to_the_interpreter) {
+    static unsigned char records[NUM_GLOBALS * N_IMAGE_GLOBAL_SIZE];
+    unsigned char *fib = records + G_FIB * N_IMAGE_GLOBAL_SIZE;
+    NValue target = MOD->globals[G_FIB];
+    run_target(G_FIB, 10);
+    ASSERT(IS_OK(ERR));
+
+    /* A procedure record for Fib, see n_write_module_image. */
+    fib[0] = 0x01;
+    fib[1] = 4;
+    fib[2] = 4;
+    fib[4] = FIB_ENTRY;
+    fib[8] = 43;
+    MOD->lazy_globals = records;
+    MOD->globals[G_FIB] = N_LAZY_GLOBAL;
+    MOD->globals[G_TARGET] = target;
+    MOD->globals[G_ARGUMENT] = n_wrap_fixnum(10);
+    n_prepare_evaluator(&EVAL, MOD, &ERR);
+    n_evaluator_run(&EVAL, &ERR);
+    MOD->lazy_globals = NULL;
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(55))));
+    ASSERT(IS_TRUE(n_is_procedure(MOD->globals[G_FIB])));
+}
+
+
+/* Stepping does not go through the decoded stream, which is what clamps
+ * jumps out of the code. */
+#ifndef N_DISPATCH_STEP
+TEST(jumps_out_of_the_code_are_reported_at_its_end) {
+    run_target(G_BACKWARD, 0);
+    ASSERT(IS_ERROR(ERR, "nuvm.UnknownOpcode"));
+    ASSERT(EQ_INT(EVAL.pc, CODE_SIZE));
+
+    ERR = n_error_ok();
+    run_target(G_FORWARD, 0);
+    ASSERT(IS_ERROR(ERR, "nuvm.UnknownOpcode"));
+    ASSERT(EQ_INT(EVAL.pc, CODE_SIZE));
+#ifdef N_JIT_ENABLED
+    ASSERT(IS_TRUE(is_compiled(BACKWARD_ENTRY)));
+    ASSERT(IS_TRUE(is_compiled(FORWARD_ENTRY)));
+#endif
+}
+#endif /* N_DISPATCH_STEP */
+
+
+AtTest* tests[] = {
+    &hot_procedure_is_compiled,
+    &procedure_is_not_compiled_before_threshold,
+    &native_and_interpreted_frames_call_each_other,
+    &overflow_in_native_code_is_reported_at_its_instruction,
+    &native_loops_spend_fuel,
+    &predecode_drops_native_code,
+    &lazy_globals_are_left_to_the_interpreter,
+#ifndef N_DISPATCH_STEP
+    &jumps_out_of_the_code_are_reported_at_its_end,
+#endif
+    NULL
+};
+
+TEST_RUNNER("Jit", tests, constructor, NULL, setup, teardown)
+
+
+static void
+create_procedure(int global, uint32_t entry, uint8_t num_locals,
+                 uint16_t size) {
+    MOD->globals[global] =
+        n_create_procedure(MOD, entry, num_locals, num_locals, size, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create procedure.", NULL);
+    }
+}
+
+
+/* Prepares the entry procedure to call the procedure in the given
+ * global. */
+static void
+prepare_target(int global, NFixnum argument) {
+    MOD->globals[G_TARGET] = MOD->globals[global];
+    MOD->globals[G_ARGUMENT] = n_wrap_fixnum(argument);
+    n_prepare_evaluator(&EVAL, MOD, &ERR);
+}
+
+
+/* Runs the entry procedure from the start, calling the procedure in the
+ * given global. */
+static void
+run_target(int global, NFixnum argument) {
+    prepare_target(global, argument);
+    if (!n_is_ok(&ERR)) {
+        return;
+    }
+    n_evaluator_run(&EVAL, &ERR);
+}
+
+
+static int
+is_compiled(uint32_t entry) {
+    return MOD->code_cache != NULL && MOD->code_cache->entries[entry] != NULL;
+}
@@ -1,5 +1,6 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "../test.h"
 
 #include "common/common.h"
@@ -7,7 +8,10 @@
 
 #include "common/byte-readers.h"
 
+#include "common/instruction-encoders.h"
+
 #include "eval/eval.h"
+#include "eval/evaluator.h"
 #include "eval/loader.h"
 #include "eval/procedures.h"
 
@@ -201,6 +205,368 @@ TEST(load_full_module_works) {
 
 
 
+TEST(modules_read_from_files_keep_their_code_mapped) {
+    NModule* module = NULL;
+    NByteReader* reader = NULL;
+    uint8_t data[] = {
+        /* num_globals = 1, code_size = 4 */
+        0x01, 0x00, 0x04, 0x00, 0x00, 0x00,
+        /* global[0] = fixnum32(7) */
+        0x00, 0x07, 0x00, 0x00, 0x00,
+        0x81, 0x82, 0x83, 0x84
+    };
+    FILE* file = fopen("build/loader-module", "wb");
+    ASSERT(IS_TRUE(file != NULL));
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    reader = n_new_byte_reader_from_file("build/loader-module", &ERR);
+    ASSERT(IS_OK(ERR));
+    module = n_read_module(reader, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_destroy_byte_reader(reader, &ERR);
+
+    ASSERT(IS_TRUE(module->mapping != NULL));
+    ASSERT(IS_TRUE(module->code == (unsigned char*) module->mapping->data
+                                   + 11));
+    ASSERT(EQ_INT(module->code_size, 4));
+    ASSERT(EQ_UINT(module->code[3], 0x84));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[0], n_wrap_fixnum(7))));
+    n_destroy_module(module);
+}
+
+
+TEST(truncated_module_files_are_rejected) {
+    NByteReader* reader = NULL;
+    uint8_t data[] = {
+        0x00, 0x00, 0x08, 0x00, 0x00, 0x00,
+        0x81, 0x82
+    };
+    FILE* file = fopen("build/loader-module", "wb");
+    ASSERT(IS_TRUE(file != NULL));
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    reader = n_new_byte_reader_from_file("build/loader-module", &ERR);
+    ASSERT(IS_OK(ERR));
+
+    ASSERT(IS_TRUE(n_read_module(reader, &ERR) == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.UnexpectedEoF"));
+    n_destroy_byte_reader(reader, &ERR);
+}
+
+
+static NModule*
+make_image_module(void) {
+    NModule* module = n_create_module(2, 6, &ERR);
+    int i;
+    if (module == NULL) {
+        return NULL;
+    }
+    module->globals[0] = n_wrap_fixnum(-42);
+    module->globals[1] = n_create_procedure(module, 2, 1, 3, 4, &ERR);
+    module->entry_point = 1;
+    for (i = 0; i < 6; i++) {
+        module->code[i] = 0x81 + i;
+    }
+    return module;
+}
+
+
+static int
+write_image(NModule* module, uint8_t* image, size_t size) {
+    NByteWriter* writer = n_create_memory_byte_writer(image, size, &ERR);
+    n_write_module_image(writer, module, &ERR);
+    n_destroy_byte_writer(writer, &ERR);
+    return n_is_ok(&ERR);
+}
+
+
+static void
+assert_image_module(NModule* module) {
+    NProcedure* proc_ptr;
+    ASSERT(EQ_INT(module->num_globals, 2));
+    ASSERT(EQ_INT(module->code_size, 6));
+    ASSERT(EQ_UINT(module->entry_point, 1));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[0], n_wrap_fixnum(-42))));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[1])));
+
+    proc_ptr = (NProcedure*) n_unwrap_object(module->globals[1]);
+    ASSERT(IS_TRUE(proc_ptr->module == module));
+    ASSERT(EQ_INT(proc_ptr->entry, 2));
+    ASSERT(EQ_INT(proc_ptr->num_locals, 1));
+    ASSERT(EQ_INT(proc_ptr->max_locals, 3));
+    ASSERT(EQ_INT(proc_ptr->size, 4));
+    ASSERT(EQ_UINT(module->code[0], 0x81));
+    ASSERT(EQ_UINT(module->code[5], 0x86));
+}
+
+
+TEST(images_keep_modules_as_they_are) {
+    uint8_t image[128];
+    NModule* original = make_image_module();
+    NModule* module;
+    ASSERT(IS_TRUE(write_image(original, image, sizeof(image))));
+    n_destroy_module(original);
+
+    module = n_load_module_image(image, sizeof(image), NULL, 0, &ERR);
+    ASSERT(IS_OK(ERR));
+    assert_image_module(module);
+    ASSERT(IS_TRUE(module->mapping == NULL));
+    ASSERT(IS_TRUE(module->code < image || module->code >= image + 128));
+    n_destroy_module(module);
+}
+
+
+TEST(image_files_are_used_in_place) {
+    NModule* original = make_image_module();
+    NModule* module;
+    NByteWriter* writer =
+        n_create_file_byte_writer("build/loader-image", &ERR);
+    ASSERT(IS_OK(ERR));
+    n_write_module_image(writer, original, &ERR);
+    n_destroy_byte_writer(writer, &ERR);
+    n_destroy_module(original);
+    ASSERT(IS_OK(ERR));
+
+    module = n_load_module_file("build/loader-image", 0, &ERR);
+    ASSERT(IS_OK(ERR));
+    assert_image_module(module);
+    ASSERT(IS_TRUE(module->mapping != NULL));
+    ASSERT(IS_TRUE(module->code == (unsigned char*) module->mapping->data
+                                   + N_IMAGE_HEADER_SIZE
+                                   + 2 * N_IMAGE_SECTION_SIZE
+                                   + 2 * N_IMAGE_GLOBAL_SIZE));
+    ASSERT(EQ_UINT((size_t) module->code % N_IMAGE_ALIGNMENT, 0));
+    n_destroy_module(module);
+}
+
+
+TEST(module_files_can_be_streams_too) {
+    NModule* module;
+    uint8_t data[] = {
+        0x01, 0x00, 0x02, 0x00, 0x00, 0x00,
+        0x00, 0x07, 0x00, 0x00, 0x00,
+        0x81, 0x82
+    };
+    FILE* file = fopen("build/loader-module", "wb");
+    ASSERT(IS_TRUE(file != NULL));
+    fwrite(data, 1, sizeof(data), file);
+    fclose(file);
+
+    module = n_load_module_file("build/loader-module", 0, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(module->code_size, 2));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[0], n_wrap_fixnum(7))));
+    n_destroy_module(module);
+}
+
+
+TEST(images_are_checked) {
+    uint8_t image[128];
+    NModule* original = make_image_module();
+    ASSERT(IS_TRUE(write_image(original, image, sizeof(image))));
+    n_destroy_module(original);
+
+    /* Unknown version. */
+    image[4] = 2;
+    ASSERT(IS_TRUE(n_load_module_image(image, sizeof(image), NULL, 0, &ERR)
+                   == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.InvalidModuleFormat"));
+    image[4] = 1;
+
+    /* Code section out of the image. */
+    ERR = n_error_ok();
+    ASSERT(IS_TRUE(n_load_module_image(image, 80, NULL, 0, &ERR) == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.InvalidModuleFormat"));
+
+    /* Entry point out of the globals. */
+    ERR = n_error_ok();
+    image[10] = 0x01;
+    ASSERT(IS_TRUE(n_load_module_image(image, sizeof(image), NULL, 0, &ERR)
+                   == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.InvalidModuleFormat"));
+    image[10] = 0;
+
+    ERR = n_error_ok();
+    image[8] = 2;
+    ASSERT(IS_TRUE(n_load_module_image(image, sizeof(image), NULL, 0, &ERR)
+                   == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.InvalidModuleFormat"));
+    image[8] = 1;
+
+    /* Misaligned globals section. */
+    ERR = n_error_ok();
+    image[N_IMAGE_HEADER_SIZE + 4] += 4;
+    ASSERT(IS_TRUE(n_load_module_image(image, sizeof(image), NULL, 0, &ERR)
+                   == NULL));
+    ASSERT(IS_ERROR(ERR, "nuvm.InvalidModuleFormat"));
+}
+
+
+/* Its entry procedure stores the procedure in its last global into the
+ * first one. */
+static NModule*
+make_lazy_module(void) {
+    NModule* original = n_create_module(3, 12, &ERR);
+    NByteWriter* writer;
+    if (original == NULL) {
+        return NULL;
+    }
+    original->globals[0] = n_wrap_fixnum(-42);
+    original->globals[1] = n_create_procedure(original, 0, 1, 1, 12, &ERR);
+    original->globals[2] = n_create_procedure(original, 10, 1, 1, 2, &ERR);
+    original->entry_point = 1;
+    n_encode_op_global_ref(original->code, 0, 2);
+    n_encode_op_global_set(original->code + 4, 0, 0);
+    n_encode_op_halt(original->code + 8);
+    n_encode_op_nop(original->code + 9);
+    n_encode_op_return(original->code + 10, 0);
+
+    writer = n_create_file_byte_writer("build/loader-lazy", &ERR);
+    if (writer == NULL) {
+        n_destroy_module(original);
+        return NULL;
+    }
+    n_write_module_image(writer, original, &ERR);
+    n_destroy_byte_writer(writer, &ERR);
+    n_destroy_module(original);
+    if (!n_is_ok(&ERR)) {
+        return NULL;
+    }
+    return n_load_module_file("build/loader-lazy", N_LOAD_LAZY_GLOBALS, &ERR);
+}
+
+
+TEST(lazy_images_create_procedures_on_first_read) {
+    NEvaluator evaluator;
+    NValue global;
+    NModule* module = make_lazy_module();
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[0], n_wrap_fixnum(-42))));
+    ASSERT(IS_TRUE(n_is_lazy_global(module->globals[1])));
+    ASSERT(IS_TRUE(n_is_lazy_global(module->globals[2])));
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[1])));
+    ASSERT(IS_TRUE(n_is_lazy_global(module->globals[2])));
+
+    global = n_evaluator_get_global(&evaluator, 2, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_is_procedure(global)));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[2], global)));
+    ASSERT(EQ_INT(((NProcedure*) n_unwrap_object(global))->entry, 10));
+    n_destruct_evaluator(&evaluator);
+    n_destroy_module(module);
+}
+
+
+TEST(lazy_globals_are_created_by_the_code_that_reads_them) {
+    NEvaluator evaluator;
+    NModule* module = make_lazy_module();
+    ASSERT(IS_OK(ERR));
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    n_evaluator_run(&evaluator, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[0])));
+    ASSERT(IS_TRUE(n_eq_values(module->globals[0], module->globals[2])));
+    n_destruct_evaluator(&evaluator);
+    n_destroy_module(module);
+}
+
+
+TEST(lazy_modules_write_the_images_they_came_from) {
+    uint8_t image[128];
+    NModule* copy;
+    NModule* module = make_lazy_module();
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(write_image(module, image, sizeof(image))));
+    ASSERT(IS_TRUE(memcmp(image, module->mapping->data,
+                          module->mapping->size) == 0));
+
+    copy = n_load_module_image(image, sizeof(image), NULL,
+                               N_LOAD_LAZY_GLOBALS, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_NULL(copy->lazy_globals));
+    ASSERT(IS_TRUE(n_is_procedure(copy->globals[2])));
+    n_destroy_module(copy);
+
+    ni_materialize_globals(module, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_NULL(module->lazy_globals));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[1])));
+    ASSERT(IS_TRUE(n_is_procedure(module->globals[2])));
+    n_destroy_module(module);
+}
+
+
+static int
+is_invalid_format(NError* error) {
+    return error->type != NULL
+        && strcmp(error->type->name, "nuvm.InvalidModuleFormat") == 0;
+}
+
+
+/* Loads the image from a file, eagerly and lazily, expecting both to
+ * fail. */
+static int
+rejects_image(uint8_t* image, size_t size) {
+    int rejected;
+    FILE* file = fopen("build/loader-malformed", "wb");
+    if (file == NULL) {
+        return 0;
+    }
+    fwrite(image, 1, size, file);
+    fclose(file);
+
+    rejected = n_load_module_file("build/loader-malformed", 0, &ERR) == NULL
+        && is_invalid_format(&ERR);
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    rejected = rejected
+        && n_load_module_file("build/loader-malformed", N_LOAD_LAZY_GLOBALS,
+                              &ERR) == NULL
+        && is_invalid_format(&ERR);
+    n_destroy_error(&ERR);
+    ERR = n_error_ok();
+    return rejected;
+}
+
+
+TEST(lazy_procedures_are_checked_when_loaded) {
+    uint8_t image[128];
+    uint8_t* record = image + N_IMAGE_HEADER_SIZE + 2 * N_IMAGE_SECTION_SIZE
+                      + N_IMAGE_GLOBAL_SIZE;
+    NModule* original = make_image_module();
+    ASSERT(IS_TRUE(write_image(original, image, sizeof(image))));
+    n_destroy_module(original);
+    ASSERT(EQ_UINT(record[0], 0x01));
+
+    /* No code. */
+    record[8] = 0;
+    ASSERT(IS_TRUE(rejects_image(image, sizeof(image))));
+    record[8] = 4;
+
+    /* Fewer locals at most than at least. */
+    record[2] = 0;
+    ASSERT(IS_TRUE(rejects_image(image, sizeof(image))));
+    record[2] = 3;
+
+    /* Entry out of the code. */
+    record[4] = 6;
+    ASSERT(IS_TRUE(rejects_image(image, sizeof(image))));
+    record[4] = 2;
+
+    /* Unknown kind. */
+    record[0] = 0x02;
+    ASSERT(IS_TRUE(rejects_image(image, sizeof(image))));
+}
+
+
 AtTest* tests[] = {
     &load_fixnum32_needs_4_bytes,
     &load_fixnum32_loads_min,
@@ -212,6 +578,16 @@ AtTest* tests[] = {
     &load_global_detects_procedure,
     &load_global_detects_fixnum32,
     &load_full_module_works,
+    &modules_read_from_files_keep_their_code_mapped,
+    &truncated_module_files_are_rejected,
+    &images_keep_modules_as_they_are,
+    &image_files_are_used_in_place,
+    &module_files_can_be_streams_too,
+    &images_are_checked,
+    &lazy_images_create_procedures_on_first_read,
+    &lazy_globals_are_created_by_the_code_that_reads_them,
+    &lazy_modules_write_the_images_they_came_from,
+    &lazy_procedures_are_checked_when_loaded,
     NULL
 };
 
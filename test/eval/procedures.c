@@ -5,6 +5,7 @@
 #include "common/errors.h"
 
 #include "eval/eval.h"
+#include "eval/modules.h"
 #include "eval/type-registry.h"
 #include "eval/singletons.h"
 #include "eval/procedures.h"
@@ -124,6 +125,26 @@ TEST(max_locals_gte_num_locals) {
 }
 
 
+TEST(procedures_follow_the_globals_of_their_module) {
+    NModule *module = n_create_module(2, 4, &ERR);
+    NValue first, second;
+    ASSERT(IS_OK(ERR));
+
+    first = n_create_procedure(module, 0, 1, 1, 4, &ERR);
+    second = n_create_procedure(module, 0, 1, 1, 4, &ERR);
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE((char*) n_unwrap_object(first)
+                   > (char*) (module->globals + 2)));
+    ASSERT(IS_TRUE((char*) n_unwrap_object(second)
+                   > (char*) n_unwrap_object(first)));
+    ASSERT(IS_TRUE((char*) n_unwrap_object(second)
+                   < (char*) module + N_MODULE_BLOCK_SIZE));
+    ASSERT(IS_TRUE(module->arena.allocated >= 2 * sizeof(NProcedure)));
+
+    n_destroy_module(module);
+}
+
+
 AtTest* tests[] = {
     &procedure_type_is_registered,
     &is_procedure_detects_procedure,
@@ -135,6 +156,7 @@ AtTest* tests[] = {
     &create_procedure_sets_size,
     &procedure_needs_positive_size,
     &max_locals_gte_num_locals,
+    &procedures_follow_the_globals_of_their_module,
     NULL
 };
 
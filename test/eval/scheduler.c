@@ -0,0 +1,241 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/primitives.h"
+#include "eval/procedures.h"
+#include "eval/scheduler.h"
+#include "eval/singletons.h"
+#include "eval/values.h"
+
+
+#define CODE_SIZE 32
+#define NUM_GLOBALS 2
+#define NUM_EVALUATORS 3
+
+#define G_WAIT   0
+#define G_ENTRY  1
+
+/* The entry procedure calls the wait primitive a hundred times, spending
+ * two units of fuel on every iteration but the last. */
+#define TOTAL_STEPS (100 * 2 - 1)
+#define TIME_SLICE 10
+
+static
+NModule *MOD;
+
+static
+NValue WAIT_PRIMITIVE;
+
+static
+NEvaluator EVALS[NUM_EVALUATORS];
+
+static
+NScheduler SCHED;
+
+static
+NError ERR;
+
+static
+int BLOCKED;
+
+static NValue
+wait_function(int n_args, NValue *args, NError *error);
+
+static NTask*
+spawn(int index);
+
+
+CONSTRUCTOR(constructor) {
+    unsigned char *code;
+    NT_INITIALIZE_MODULE(n_init_eval);
+    ERR = n_error_ok();
+
+    MOD = n_create_module(NUM_GLOBALS, CODE_SIZE, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module.", NULL);
+    }
+
+    WAIT_PRIMITIVE = n_create_primitive(wait_function, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create wait primitive.", NULL);
+    }
+
+    MOD->globals[G_ENTRY] = n_create_procedure(MOD, 0, 4, 4, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module's entry procedure.", NULL);
+    }
+    MOD->entry_point = G_ENTRY;
+
+    code = MOD->code;
+    n_encode_op_load_i16(code+0, 0, 100);
+    n_encode_op_load_i16(code+4, 1, 1);
+    n_encode_op_global_ref(code+8, 2, G_WAIT);
+    n_encode_op_call(code+12, 3, 2, 0);
+    n_encode_op_sub(code+16, 0, 0, 1);
+    n_encode_op_jump_if_fixnum_zero(code+20, 0, 8);
+    n_encode_op_jump(code+24, -16);
+    n_encode_op_halt(code+28);
+    n_encode_op_nop(code+29);
+    n_encode_op_nop(code+30);
+    n_encode_op_nop(code+31);
+}
+
+
+SETUP(setup) {
+    int i;
+    ERR = n_error_ok();
+    BLOCKED = 0;
+    MOD->globals[G_WAIT] = WAIT_PRIMITIVE;
+
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        n_construct_evaluator(EVALS + i);
+        n_prepare_evaluator(EVALS + i, MOD, &ERR);
+        if (!n_is_ok(&ERR)) {
+            ERROR("Can't prepare evaluator.", NULL);
+        }
+    }
+    n_construct_scheduler(&SCHED, TIME_SLICE);
+}
+
+
+TEARDOWN(teardown) {
+    int i;
+    n_destruct_scheduler(&SCHED);
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        n_destruct_evaluator(EVALS + i);
+    }
+    n_destroy_error(&ERR);
+}
+
+
+TEST(run_completes_all_tasks) {
+    NTask *tasks[NUM_EVALUATORS];
+    int i;
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        tasks[i] = spawn(i);
+    }
+
+    n_scheduler_run(&SCHED);
+
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        ASSERT(EQ_INT(tasks[i]->state, N_TASK_DONE));
+        ASSERT(IS_OK(tasks[i]->error));
+        ASSERT(EQ_UINT(tasks[i]->steps, TOTAL_STEPS));
+        ASSERT(IS_TRUE(EVALS[i].halted));
+        ASSERT(EQ_INT(EVALS[i].pc, 28));
+    }
+    ASSERT(IS_TRUE(!n_scheduler_run_slice(&SCHED)));
+}
+
+
+TEST(slices_go_round_robin) {
+    NTask *tasks[NUM_EVALUATORS];
+    int i;
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        tasks[i] = spawn(i);
+    }
+
+    ASSERT(IS_TRUE(n_scheduler_run_slice(&SCHED)));
+    ASSERT(EQ_UINT(tasks[0]->steps, TIME_SLICE));
+    ASSERT(EQ_UINT(tasks[1]->steps, 0));
+    ASSERT(EQ_UINT(tasks[2]->steps, 0));
+
+    ASSERT(IS_TRUE(n_scheduler_run_slice(&SCHED)));
+    ASSERT(IS_TRUE(n_scheduler_run_slice(&SCHED)));
+    ASSERT(IS_TRUE(n_scheduler_run_slice(&SCHED)));
+    ASSERT(EQ_UINT(tasks[0]->steps, 2 * TIME_SLICE));
+    ASSERT(EQ_UINT(tasks[1]->steps, TIME_SLICE));
+    ASSERT(EQ_UINT(tasks[2]->steps, TIME_SLICE));
+    ASSERT(EQ_INT(tasks[0]->state, N_TASK_READY));
+}
+
+
+TEST(blocked_tasks_are_parked_until_woken) {
+    NTask *task = spawn(0);
+    BLOCKED = 1;
+
+    n_scheduler_run(&SCHED);
+    ASSERT(EQ_INT(task->state, N_TASK_PARKED));
+    ASSERT(IS_OK(task->error));
+    ASSERT(EQ_UINT(task->steps, 0));
+    ASSERT(IS_TRUE(!EVALS[0].halted));
+    ASSERT(EQ_INT(EVALS[0].pc, 12));
+
+    BLOCKED = 0;
+    n_scheduler_wake(&SCHED, task);
+    ASSERT(EQ_INT(task->state, N_TASK_READY));
+    n_scheduler_run(&SCHED);
+
+    ASSERT(EQ_INT(task->state, N_TASK_DONE));
+    ASSERT(EQ_UINT(task->steps, TOTAL_STEPS));
+    ASSERT(EQ_INT(EVALS[0].pc, 28));
+}
+
+
+TEST(parked_tasks_do_not_hold_up_others) {
+    NTask *blocked;
+    NTask *other;
+    BLOCKED = 1;
+    blocked = spawn(0);
+    n_scheduler_run(&SCHED);
+    ASSERT(EQ_INT(blocked->state, N_TASK_PARKED));
+
+    BLOCKED = 0;
+    other = spawn(1);
+    n_scheduler_run(&SCHED);
+
+    ASSERT(EQ_INT(other->state, N_TASK_DONE));
+    ASSERT(EQ_INT(blocked->state, N_TASK_PARKED));
+}
+
+
+TEST(task_keeps_the_error_it_halted_with) {
+    NTask *task;
+    MOD->globals[G_WAIT] = n_wrap_fixnum(0);
+    task = spawn(0);
+
+    n_scheduler_run(&SCHED);
+
+    ASSERT(EQ_INT(task->state, N_TASK_DONE));
+    ASSERT(IS_ERROR(task->error, "nuvm.IllegalArgument"));
+    ASSERT(EQ_INT(EVALS[0].pc, 12));
+}
+
+
+AtTest* tests[] = {
+    &run_completes_all_tasks,
+    &slices_go_round_robin,
+    &blocked_tasks_are_parked_until_woken,
+    &parked_tasks_do_not_hold_up_others,
+    &task_keeps_the_error_it_halted_with,
+    NULL
+};
+
+TEST_RUNNER("Scheduler", tests, constructor, NULL, setup, teardown)
+
+
+static NValue
+wait_function(int n_args, NValue *args, NError *error) {
+    if (BLOCKED) {
+        n_block_primitive(error);
+        return N_UNKNOWN;
+    }
+    return N_TRUE;
+}
+
+
+static NTask*
+spawn(int index) {
+    NTask *task = n_scheduler_spawn(&SCHED, EVALS + index, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't spawn task.", NULL);
+    }
+    return task;
+}
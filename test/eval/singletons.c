@@ -101,6 +101,27 @@ TEST(unknown_has_unknown_type) {
 }
 
 
+TEST(singletons_are_immediate) {
+    ASSERT(IS_TRUE(n_is_immediate(N_TRUE)));
+    ASSERT(IS_TRUE(n_is_immediate(N_FALSE)));
+    ASSERT(IS_TRUE(n_is_immediate(N_UNKNOWN)));
+}
+
+
+TEST(singletons_are_not_fixnums) {
+    ASSERT(IS_TRUE(!n_is_fixnum(N_TRUE)));
+    ASSERT(IS_TRUE(!n_is_fixnum(N_FALSE)));
+    ASSERT(IS_TRUE(!n_is_fixnum(N_UNKNOWN)));
+}
+
+
+TEST(fixnums_are_not_boolean) {
+    ASSERT(IS_TRUE(!n_is_boolean(n_wrap_fixnum(0))));
+    ASSERT(IS_TRUE(!n_is_boolean(n_wrap_fixnum(1))));
+    ASSERT(IS_TRUE(!n_is_boolean(n_wrap_fixnum(-1))));
+}
+
+
 AtTest* tests[] = {
     &boolean_type_is_registered,
     &unknown_type_is_registered,
@@ -118,6 +139,9 @@ AtTest* tests[] = {
     &boolean_true_has_boolean_type,
     &boolean_false_has_boolean_type,
     &unknown_has_unknown_type,
+    &singletons_are_immediate,
+    &singletons_are_not_fixnums,
+    &fixnums_are_not_boolean,
     NULL
 };
 
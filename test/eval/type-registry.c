@@ -2,9 +2,11 @@
 
 #include "../test.h"
 
+#include "common/arena.h"
 #include "common/errors.h"
 
 #include "eval/eval.h"
+#include "eval/heap.h"
 #include "eval/type-registry.h"
 
 NTypeRegistry* TR = NULL;
@@ -149,6 +151,62 @@ TEST(can_register_and_find_different_types) {
 }
 
 
+TEST(registered_types_get_distinct_ids) {
+    NError error = n_error_ok();
+    NType type1;
+    NType type2;
+
+    n_construct_type(&type1, "foo.Type1");
+    nt_register_type(TR, &type1, &error);
+    n_construct_type(&type2, "foo.Type2");
+    nt_register_type(TR, &type2, &error);
+
+    ASSERT(IS_OK(error));
+    ASSERT(IS_TRUE(type1.id != 0));
+    ASSERT(IS_TRUE(type2.id != 0));
+    ASSERT(IS_TRUE(type1.id != type2.id));
+    ASSERT(EQ_PTR(ni_type_by_id(type1.id), &type1));
+    ASSERT(EQ_PTR(ni_type_by_id(type2.id), &type2));
+}
+
+
+TEST(type_ids_are_given_once) {
+    NError error = n_error_ok();
+    NType type;
+    uint16_t id;
+
+    n_construct_type(&type, "foo.Type");
+    id = ni_type_id(&type, &error);
+
+    ASSERT(IS_OK(error));
+    ASSERT(IS_TRUE(id != 0));
+    ASSERT(EQ_UINT(ni_type_id(&type, &error), id));
+
+    nt_register_type(TR, &type, &error);
+
+    ASSERT(IS_OK(error));
+    ASSERT(EQ_UINT(type.id, id));
+}
+
+
+TEST(unregistered_types_get_an_id_on_allocation) {
+    NError error = n_error_ok();
+    NType type;
+    NArena arena;
+    NObject *object;
+
+    n_construct_type(&type, "foo.Type");
+    n_construct_arena(&arena, 64);
+    object = n_allocate_arena_object(&arena, sizeof(NObject), &type, &error);
+
+    ASSERT(IS_OK(error));
+    ASSERT(IS_TRUE(type.id != 0));
+    ASSERT(EQ_UINT(object->type_id, type.id));
+    ASSERT(EQ_PTR(n_object_type(object), &type));
+    n_destruct_arena(&arena);
+}
+
+
 AtTest* tests[] = {
     &can_register_type,
     &rejects_empty_name,
@@ -158,6 +216,9 @@ AtTest* tests[] = {
     &rejects_repeated_name,
     &can_find_by_name,
     &can_register_and_find_different_types,
+    &registered_types_get_distinct_ids,
+    &type_ids_are_given_once,
+    &unregistered_types_get_an_id_on_allocation,
     NULL
 };
 
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "../test.h"
+
+#include "common/errors.h"
+
+#include "common/instruction-encoders.h"
+
+#include "eval/eval.h"
+#include "eval/evaluator.h"
+#include "eval/isolate.h"
+#include "eval/procedures.h"
+#include "eval/singletons.h"
+#include "eval/values.h"
+#include "eval/worker-pool.h"
+
+
+#define CODE_SIZE 40
+#define NUM_GLOBALS 3
+#define NUM_EVALUATORS 64
+#define NUM_WORKERS 4
+#define TIME_SLICE 16
+
+#define G_ARGUMENT 0
+#define G_OUTPUT   1
+#define G_ENTRY    2
+
+static
+NModule *MOD;
+
+static
+NEvaluator EVALS[NUM_EVALUATORS];
+
+static
+NTask *TASKS[NUM_EVALUATORS];
+
+static
+NWorkerPool POOL;
+
+static
+NError ERR;
+
+static void
+spawn_all(int num_workers);
+
+
+CONSTRUCTOR(constructor) {
+    unsigned char *code;
+    int i;
+    NT_INITIALIZE_MODULE(n_init_eval);
+    ERR = n_error_ok();
+
+    MOD = n_create_module(NUM_GLOBALS, CODE_SIZE, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module.", NULL);
+    }
+
+    MOD->globals[G_ENTRY] = n_create_procedure(MOD, 0, 4, 4, 1, &ERR);
+    if (!n_is_ok(&ERR)) {
+        ERROR("Can't create module's entry procedure.", NULL);
+    }
+    MOD->entry_point = G_ENTRY;
+
+    /* Entry procedure: stores the sum of the numbers below its argument
+     * in the output, spending a unit of fuel per number. */
+    code = MOD->code;
+    for (i = 0; i < CODE_SIZE; i++) {
+        n_encode_op_nop(code+i);
+    }
+    n_encode_op_global_ref(code+0, 0, G_ARGUMENT);
+    n_encode_op_load_i16(code+4, 1, 0);
+    n_encode_op_load_i16(code+8, 2, 0);
+    n_encode_op_load_i16(code+12, 3, 1);
+    n_encode_op_jump_if_le(code+16, 0, 1, 16);
+    n_encode_op_add(code+21, 2, 2, 1);
+    n_encode_op_add(code+25, 1, 1, 3);
+    n_encode_op_jump(code+29, -13);
+    n_encode_op_global_set(code+32, G_OUTPUT, 2);
+    n_encode_op_halt(code+36);
+}
+
+
+SETUP(setup) {
+    int i;
+    ERR = n_error_ok();
+    MOD->globals[G_ARGUMENT] = n_wrap_fixnum(0);
+    MOD->globals[G_OUTPUT] = n_wrap_fixnum(0);
+
+    /* Each evaluator sums up to a different number, in its own
+     * globals. */
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        n_construct_evaluator(EVALS + i);
+        n_prepare_evaluator(EVALS + i, MOD, &ERR);
+        if (!n_is_ok(&ERR)) {
+            ERROR("Can't prepare evaluator.", NULL);
+        }
+        n_evaluator_own_globals(EVALS + i, &ERR);
+        if (!n_is_ok(&ERR)) {
+            ERROR("Can't give evaluator its own globals.", NULL);
+        }
+        EVALS[i].globals[G_ARGUMENT] = n_wrap_fixnum(i * 10);
+    }
+}
+
+
+TEARDOWN(teardown) {
+    int i;
+    n_destruct_worker_pool(&POOL);
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        n_destruct_evaluator(EVALS + i);
+    }
+    n_destroy_error(&ERR);
+}
+
+
+static void
+assert_all_done(void) {
+    int i;
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        NFixnum n = i * 10;
+        ASSERT(EQ_INT(TASKS[i]->state, N_TASK_DONE));
+        ASSERT(IS_OK(TASKS[i]->error));
+        ASSERT(EQ_UINT(TASKS[i]->steps, n));
+        ASSERT(EQ_INT(EVALS[i].pc, 36));
+        ASSERT(IS_TRUE(n_eq_values(EVALS[i].globals[G_OUTPUT],
+                                   n_wrap_fixnum(n * (n - 1) / 2))));
+    }
+}
+
+
+TEST(pool_runs_all_tasks) {
+    spawn_all(NUM_WORKERS);
+    n_worker_pool_run(&POOL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    assert_all_done();
+}
+
+
+TEST(pool_with_a_single_worker_runs_all_tasks) {
+    spawn_all(1);
+    n_worker_pool_run(&POOL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    assert_all_done();
+}
+
+
+TEST(own_globals_leave_the_module_alone) {
+    spawn_all(NUM_WORKERS);
+    n_worker_pool_run(&POOL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(n_eq_values(MOD->globals[G_OUTPUT], n_wrap_fixnum(0))));
+}
+
+
+TEST(modules_are_thawed_after_a_run) {
+    spawn_all(NUM_WORKERS);
+    n_worker_pool_run(&POOL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(IS_TRUE(!MOD->frozen));
+}
+
+
+TEST(tasks_keep_the_errors_they_halt_with) {
+    spawn_all(NUM_WORKERS);
+    EVALS[3].globals[G_ARGUMENT] = N_TRUE;
+    n_worker_pool_run(&POOL, &ERR);
+
+    ASSERT(IS_OK(ERR));
+    ASSERT(EQ_INT(TASKS[3]->state, N_TASK_DONE));
+    ASSERT(IS_TRUE(!n_is_ok(&TASKS[3]->error)));
+    ASSERT(EQ_INT(EVALS[3].pc, 16));
+    ASSERT(EQ_INT(TASKS[4]->state, N_TASK_DONE));
+    ASSERT(IS_OK(TASKS[4]->error));
+}
+
+
+TEST(evaluators_of_isolates_are_refused) {
+    NEvaluator evaluator;
+    NIsolate *isolate = n_create_isolate(&ERR);
+    NModule *module;
+    ASSERT(IS_OK(ERR));
+    module = n_create_module_in(isolate, 1, 4, &ERR);
+    ASSERT(IS_OK(ERR));
+    module->globals[0] = n_create_procedure(module, 0, 1, 1, 4, &ERR);
+    ASSERT(IS_OK(ERR));
+    module->entry_point = 0;
+    n_encode_op_halt(module->code);
+
+    n_construct_evaluator(&evaluator);
+    n_prepare_evaluator(&evaluator, module, &ERR);
+    ASSERT(IS_OK(ERR));
+    n_construct_worker_pool(&POOL, NUM_WORKERS, TIME_SLICE);
+    ASSERT(IS_NULL(n_worker_pool_spawn(&POOL, &evaluator, &ERR)));
+    ASSERT(IS_ERROR(ERR, "nuvm.IllegalArgument"));
+    ASSERT(EQ_UINT(POOL.num_tasks, 0));
+
+    n_destruct_evaluator(&evaluator);
+    n_destroy_isolate(isolate);
+}
+
+
+AtTest* tests[] = {
+    &pool_runs_all_tasks,
+    &pool_with_a_single_worker_runs_all_tasks,
+    &own_globals_leave_the_module_alone,
+    &modules_are_thawed_after_a_run,
+    &tasks_keep_the_errors_they_halt_with,
+    &evaluators_of_isolates_are_refused,
+    NULL
+};
+
+TEST_RUNNER("WorkerPool", tests, constructor, NULL, setup, teardown)
+
+
+static void
+spawn_all(int num_workers) {
+    int i;
+    n_construct_worker_pool(&POOL, num_workers, TIME_SLICE);
+    for (i = 0; i < NUM_EVALUATORS; i++) {
+        TASKS[i] = n_worker_pool_spawn(&POOL, EVALS + i, &ERR);
+        if (!n_is_ok(&ERR)) {
+            ERROR("Can't spawn task.", NULL);
+        }
+    }
+}